@@ -5,13 +5,18 @@
 #include "ThreadLogger.h"
 #include "LogStream.h"
 #include "Level.h"
+#include "BackendConfig.h"
+#include "Metrics.h"
+
+template <typename BackendT>
+class LogContext;
 
 template <typename BackendT>
 class AsyncLogger
 {
 public:
-    explicit AsyncLogger(size_t bufSize, size_t queueSize = 32, std::string logDir = "")
-        : backend_(std::make_unique<BackendT>(bufSize, queueSize, std::move(logDir))),
+    explicit AsyncLogger(size_t bufSize, size_t queueSize = 32, std::string logDir = "", BackendConfig cfg = {})
+        : backend_(std::make_unique<BackendT>(bufSize, queueSize, std::move(logDir), cfg)),
           bufSize_(bufSize), queueSize_(queueSize)
     {
     }
@@ -28,11 +33,17 @@ public:
     // Returns the calling thread's ThreadLogger, registering one on first
     // use. Returns nullptr once shutdownAll() has run, instead of silently
     // registering a fresh ThreadLogger against an already-stopped backend.
+    // While a LogContext of this logger is attached to the thread, returns
+    // the context's logger instead.
     ThreadLogger<BackendT> *tls()
     {
         if (!alive_.load(std::memory_order_acquire))
             return nullptr;
 
+        const AttachedContext &ctx = attached();
+        if (ctx.backend == backend_.get())
+            return ctx.logger;
+
         auto [it, _] = tlsMap().try_emplace(backend_.get(), bufSize_, backend_.get());
         return &it->second;
     }
@@ -63,7 +74,37 @@ public:
             t->handoff();
     }
 
+    // Dumps the flight recorder (BackendConfig::flightRecorder) from the
+    // writer thread, soon after the call.
+    void dumpFlightRecorder()
+    {
+        if (backend_)
+            backend_->dumpFlightRecorder();
+    }
+
+    // Aggregated pipeline counters; see MetricsSnapshot. Empty after
+    // shutdownAll().
+    MetricsSnapshot metrics() const
+    {
+        return backend_ ? backend_->metrics() : MetricsSnapshot{};
+    }
+
 private:
+    friend class LogContext<BackendT>;
+
+    // The LogContext currently attached to this thread, if any. One slot per
+    // thread: attaching another context saves and later restores this one.
+    struct AttachedContext
+    {
+        BackendT *backend{nullptr};
+        ThreadLogger<BackendT> *logger{nullptr};
+    };
+    static AttachedContext &attached()
+    {
+        thread_local AttachedContext slot;
+        return slot;
+    }
+
     static std::unordered_map<BackendT *, ThreadLogger<BackendT>> &tlsMap()
     {
         thread_local std::unordered_map<BackendT *, ThreadLogger<BackendT>> map;
@@ -76,7 +117,7 @@ private:
     std::atomic<bool> alive_{true};
 };
 
-#define LOG_TO(logger, LEVEL) LogStream((logger).tls(), CaelanLogger::LEVEL)
+#define LOG_TO(logger, LEVEL) LogStream((logger).tls(), CaelanLogger::LEVEL, CAELAN_CALLSITE())
 #define LOG_INFO_TO(logger) LOG_TO(logger, INFO)
 #define LOG_WARN_TO(logger) LOG_TO(logger, WARNING)
 #define LOG_ERROR_TO(logger) LOG_TO(logger, ERROR)
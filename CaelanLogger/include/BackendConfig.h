@@ -0,0 +1,121 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include "ThreadPlacement.h"
+
+class WriterExecutor;
+
+// Runtime knobs for SharedBackend. Every default reproduces the original
+// behaviour, so AsyncLogger(bufSize, queueSize, dir) keeps working unchanged.
+struct BackendConfig
+{
+	// When non-zero, the writer appends a "metrics: ..." self-report line to
+	// the log at roughly this interval (checked once per writer wakeup).
+	std::chrono::milliseconds metricsInterval{0};
+
+	// Number of writer threads draining the submitted queue. Above 1 the
+	// backend switches to PwriteWriter, and each thread reserves its file range
+	// with an atomic offset and writes it with pwrite() in parallel.
+	size_t writerThreads{1};
+
+	// Segment size at which the writer rolls to a new file; 0 keeps
+	// FILE_MAX_SIZE (256 MB).
+	size_t maxFileSize{0};
+
+	// Open and fallocate() the next segment on a helper thread ahead of time,
+	// and trim/close finished ones there too, so a roll is just an fd swap.
+	bool preallocateSegments{false};
+
+	// Stamp every line and have the writer k-way merge the buffers it drains
+	// in one cycle, so lines reach the file in time order within that window
+	// (see ENGINEERING.md). Forces a single writer thread.
+	bool orderedOutput{false};
+
+	// Write a "<segment>.idx" sidecar of (time range, offset, line count) per
+	// written buffer, for findTimeRange() in TimeIndex.h.
+	bool timeIndex{false};
+
+	// Write segments with O_DIRECT through DirectWriter, keeping log data out
+	// of the page cache. Forces a single writer thread.
+	bool directIO{false};
+
+	// How long an idle writer spins on the submitted queue before parking on
+	// the condition variable. Producers only notify a parked writer, so while
+	// the writer spins or is busy a handoff costs no syscall.
+	std::chrono::microseconds writerSpin{0};
+	// Never park: writers poll the queue on a dedicated core. Lowest handoff
+	// latency, producers never notify; costs one core per writer thread.
+	bool writerBusyPoll{false};
+
+	// Give each ThreadLogger its own wait-free SPSC ring of submitted buffer
+	// indices instead of sharing the spinlocked MPSC queue. The writer
+	// round-robins over the rings. Threads beyond SharedBackend::kMaxRings
+	// fall back to the shared queue.
+	bool perProducerRings{false};
+
+	// Upper bound for one line. A line that outgrows a pool buffer continues
+	// in one of SharedBackend::kOverflowSlots large-record buffers, grown up
+	// to this size; past it the line is cut, so a record is at most this many
+	// bytes, its '\n' included. Raised to the pool's bufSize if smaller.
+	size_t maxRecordSize{1 << 20};
+
+	// CPU set, scheduling policy, nice/ioprio and name for the writer
+	// thread(s), and for helper threads such as the segment preparer. Pool
+	// writers beyond the first get "-<n>" appended to the name.
+	ThreadPlacement writerPlacement;
+	ThreadPlacement helperPlacement;
+
+	// Allocate pool buffers on first acquire instead of at construction. A
+	// producer only takes a never-used buffer when every recycled one is
+	// taken, so the pool grows to the peak in flight, not to queueSize.
+	bool lazyBuffers{false};
+	// When non-zero, pool buffers that sit free for this long have their
+	// pages returned with madvise(MADV_DONTNEED) and are reused last. The
+	// writer checks once per wakeup (it wakes at least this often).
+	std::chrono::milliseconds idleRelease{0};
+
+	// An ERROR or FATAL line hands its thread's buffer off as soon as it ends,
+	// and the writer's next cycle takes everything queued up to it regardless
+	// of the batch limit. Lower levels stay batched.
+	bool urgentHandoff{false};
+	// fdatasync() the segment after a cycle that wrote an urgent buffer.
+	bool syncUrgent{false};
+	// A FATAL line waits up to this long, on the logging thread, for its
+	// buffer to be written (and synced with syncUrgent). 0 does not wait.
+	std::chrono::milliseconds fatalWait{0};
+
+	// Line prefix, compiled once (see LinePattern.h); empty keeps
+	// LinePattern::kDefault. loggerName is what %n expands to.
+	std::string linePattern;
+	std::string loggerName;
+
+	// Send drained buffers to a local collector instead of segment files
+	// (see SocketWriter.h): "unix:/path", "udp:host:port" or
+	// "unix-stream:/path". Forces a single writer thread.
+	std::string socketSink;
+	// How long a send waits for a full receiver before the rest of the buffer
+	// is dropped, and the cap of the reconnect backoff.
+	std::chrono::milliseconds socketSendTimeout{50};
+	std::chrono::milliseconds socketMaxBackoff{1000};
+
+	// Keep the last flightRecorder bytes of drained output in memory instead
+	// of writing them (see FlightRecorder.h), and write them out only on an
+	// ERROR/FATAL line, SharedBackend::dumpFlightRecorder(), or delivery of
+	// flightRecorderSignal (0: none). A dump also takes every thread's
+	// unfinished buffer. Forces a single writer thread.
+	size_t flightRecorder{0};
+	int flightRecorderSignal{0};
+
+	// POSIX shared-memory pool that ShmBackend producers and the ShmCollector
+	// attach to (see ShmBackend.h), and how often the collector looks for
+	// slots held by producer processes that have died.
+	std::string shmName{"/caelogger"};
+	std::chrono::milliseconds shmReclaimInterval{100};
+
+	// Have these shared writer threads drain the backend instead of a
+	// thread of its own (see WriterExecutor.h). Forces a single writer;
+	// writerSpin, writerBusyPoll and writerPlacement do not apply.
+	std::shared_ptr<WriterExecutor> executor;
+};
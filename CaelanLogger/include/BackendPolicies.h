@@ -0,0 +1,162 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include "BackendConfig.h"
+#include "MPSCSpinLockQueue.h"
+#include "SPMCSpinLockQueue.h"
+#include "MPMCQueue.h"
+#include "NormalWriter.h"
+#include "PwriteWriter.h"
+#include "DirectWriter.h"
+#include "SocketWriter.h"
+#include "FlightRecorder.h"
+#include "TimeUtil.h"
+
+// Compile-time policies for BasicSharedBackend. Each is resolved at
+// instantiation, so the chosen queue, writer and clock calls inline into the
+// pipeline with no runtime dispatch. SharedBackend is the combination every
+// earlier release hard-wired.
+
+// QueuePolicy: the submitted (many producers, writer pops) and free (writer
+// pushes, many producers pop) index queues.
+struct SpinLockQueues
+{
+	template <typename T>
+	using Submitted = MPSCSpinLockQueue<T>;
+	template <typename T>
+	using Free = SPMCSpinLockQueue<T>;
+};
+
+// Lock-free on both sides; holds up when producers outnumber cores and a
+// spinlock holder can be preempted mid-push.
+struct LockFreeQueues
+{
+	template <typename T>
+	using Submitted = MPMCQueue<T>;
+	template <typename T>
+	using Free = MPMCQueue<T>;
+};
+
+// ClockPolicy: where a line's timestamp comes from.
+struct RealtimeClock
+{
+	static int64_t nowNanos() { return LogTime::nowNanos(); }
+};
+
+// Last-tick time: cheaper than a clocksource read, at millisecond-level
+// resolution. The printed timestamp has ms precision anyway.
+struct CoarseRealtimeClock
+{
+	static int64_t nowNanos() { return LogTime::coarseNowNanos(); }
+};
+
+// OverflowPolicy: what a producer does when the free queue is empty.
+struct DropWhenFull
+{
+	static constexpr bool kWait = false;
+};
+
+// Yield until the writer returns a buffer: nothing is dropped, producers are
+// throttled to disk speed. A spilling line still never waits (it holds a
+// buffer), so pool exhaustion mid-line cuts the line instead.
+struct WaitWhenFull
+{
+	static constexpr bool kWait = true;
+};
+
+// WriterPolicy: a FileUtil writer type used for every append, or
+// ConfiguredWriter to pick NormalWriter, PwriteWriter, DirectWriter or
+// SocketWriter from BackendConfig at construction.
+struct ConfiguredWriter
+{
+};
+
+template <typename W>
+class WriterHolder
+{
+public:
+	// A writer pool needs a writer whose append() is safe to call concurrently.
+	static size_t writerCount(const BackendConfig &cfg)
+	{
+		return W::kConcurrentAppend && cfg.writerThreads > 1 && !cfg.orderedOutput && !cfg.executor ? cfg.writerThreads : 1;
+	}
+	WriterHolder(const std::string &dir, size_t, const BackendConfig &cfg)
+	{
+		if constexpr (std::is_constructible_v<W, std::string, const BackendConfig &>)
+			w_ = std::make_unique<W>(dir, cfg);
+		else
+			w_ = std::make_unique<W>(dir);
+	}
+
+	template <typename F>
+	decltype(auto) visit(F &&f) { return f(*w_); }
+	template <typename F>
+	decltype(auto) visit(F &&f) const { return f(std::as_const(*w_)); }
+
+private:
+	std::unique_ptr<W> w_;
+};
+
+template <>
+class WriterHolder<ConfiguredWriter>
+{
+public:
+	static size_t writerCount(const BackendConfig &cfg)
+	{
+		const bool single = cfg.orderedOutput || cfg.directIO || !cfg.socketSink.empty() || cfg.flightRecorder > 0 || cfg.executor;
+		return cfg.writerThreads > 1 && !single ? cfg.writerThreads : 1;
+	}
+	WriterHolder(const std::string &dir, size_t writers, const BackendConfig &cfg)
+	{
+		if (cfg.flightRecorder > 0)
+			rfutil_ = std::make_unique<FlightRecorder>(dir, cfg);
+		else if (!cfg.socketSink.empty())
+			sfutil_ = std::make_unique<SocketWriter>(dir, cfg);
+		else if (writers > 1)
+			pfutil_ = std::make_unique<PwriteWriter>(dir);
+		else if (cfg.directIO)
+			dfutil_ = std::make_unique<DirectWriter>(dir);
+		else
+			futil_ = std::make_unique<NormalWriter>(dir);
+	}
+
+	template <typename F>
+	decltype(auto) visit(F &&f)
+	{
+		if (pfutil_)
+			return f(*pfutil_);
+		if (dfutil_)
+			return f(*dfutil_);
+		if (sfutil_)
+			return f(*sfutil_);
+		if (rfutil_)
+			return f(*rfutil_);
+		return f(*futil_);
+	}
+	template <typename F>
+	decltype(auto) visit(F &&f) const
+	{
+		if (pfutil_)
+			return f(std::as_const(*pfutil_));
+		if (dfutil_)
+			return f(std::as_const(*dfutil_));
+		if (sfutil_)
+			return f(std::as_const(*sfutil_));
+		if (rfutil_)
+			return f(std::as_const(*rfutil_));
+		return f(std::as_const(*futil_));
+	}
+
+private:
+	std::unique_ptr<NormalWriter> futil_;
+	// Set instead of futil_ with more than one writer thread.
+	std::unique_ptr<PwriteWriter> pfutil_;
+	// Set instead of futil_ when cfg.directIO.
+	std::unique_ptr<DirectWriter> dfutil_;
+	// Set instead of futil_ when cfg.socketSink is set.
+	std::unique_ptr<SocketWriter> sfutil_;
+	// Set instead of futil_ when cfg.flightRecorder is non-zero.
+	std::unique_ptr<FlightRecorder> rfutil_;
+};
@@ -1,36 +1,86 @@
 #pragma once
 #include <cstddef> // Add this line to ensure std::size_t is declared
+#include <cstdint>
 #include <memory>
 using std::size_t;
 
 // property of a buffer
 constexpr size_t maxSize{2000};
+// Storage is aligned to (and allocated in multiples of) this, so DirectWriter
+// can hand it straight to an O_DIRECT write().
+constexpr size_t kBufferAlign{4096};
+
+struct AlignedDelete
+{
+	// False for storage the buffer only borrows (a shared-memory slot).
+	bool owned{true};
+	void operator()(char *p) const;
+};
+using AlignedStorage = std::unique_ptr<char[], AlignedDelete>;
+// kBufferAlign-aligned block of at least bytes, rounded up to whole blocks.
+AlignedStorage allocateAligned(size_t bytes);
 
 class Buffer
 {
 public:
 	Buffer();
-	Buffer(size_t);
+	// allocate = false defers the storage to materialize().
+	Buffer(size_t capacity, bool allocate = true);
+	// Writes into storage owned elsewhere (see ShmPool), never freed here.
+	Buffer(char *storage, size_t capacity);
 	Buffer(const Buffer &) = delete;						// to prevent double free after copy construction
 	Buffer &operator=(const Buffer &) = delete; // to prevent double free after copy construction
 	bool add(const char *, size_t);
 	bool add(const char);
 	size_t size() const { return size_; }
 	void increaseSize(size_t inc) { size_ += inc; remaining_ -= inc; }
+	// Drops everything past newSize (an unfinished line moved elsewhere).
+	void truncate(size_t newSize) { remaining_ += size_ - newSize; size_ = newSize; }
+	// Grows the storage to at least capacity bytes, keeping the contents.
+	void reserve(size_t capacity);
 	size_t capacity() const { return capacity_; }
 	char *getBuffer() const { return buffer.get(); }
 	size_t remaining() const { return remaining_; }
 	size_t lineCount() const { return lineCount_; }
 	void incrementLineCount() { lineCount_++; }
+	// Wall-clock ns of the first and last line stamped into this buffer (0 when
+	// empty); the writer turns them into time-index records.
+	void noteTime(int64_t ns)
+	{
+		if (!firstNs_)
+			firstNs_ = ns;
+		lastNs_ = ns;
+	}
+	int64_t firstNs() const { return firstNs_; }
+	int64_t lastNs() const { return lastNs_; }
+	// Same clock, taken by the backend at submit() for the age histograms.
+	void setHandoffNs(int64_t ns) { handoffNs_ = ns; }
+	int64_t handoffNs() const { return handoffNs_; }
+	// Non-zero for a buffer handed off by an urgent line (see
+	// SharedBackend::submitUrgent()).
+	void setUrgentSeq(uint64_t seq) { urgentSeq_ = seq; }
+	uint64_t urgentSeq() const { return urgentSeq_; }
 	void reset();
+	// Whether the storage is allocated and its pages not given back.
+	bool resident() const { return buffer && !released_; }
+	// Allocates deferred storage; after releasePages() just marks it in use.
+	void materialize();
+	// madvise(MADV_DONTNEED) on the storage: the pages go back to the kernel
+	// and fault in again, zeroed, on the next write. The buffer must be empty.
+	void releasePages();
 	size_t idx() const { return idx_; }
 	void setIdx(size_t idx) { idx_ = idx; }
 
 private:
-	std::unique_ptr<char[]> buffer;
+	AlignedStorage buffer;
 	size_t size_;
 	size_t capacity_;
 	size_t remaining_;
 	size_t lineCount_{0};
+	int64_t firstNs_{0};
+	int64_t lastNs_{0};
+	int64_t handoffNs_{0};
+	uint64_t urgentSeq_{0};
+	bool released_{false};
 	size_t idx_;
 };
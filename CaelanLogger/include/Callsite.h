@@ -0,0 +1,38 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <source_location>
+#include <string>
+
+// One logging statement. LOG_TO interns its std::source_location once, into a
+// function-local static, so a line only carries a pointer to this record; the
+// text forms are rendered here once instead of per line.
+struct Callsite
+{
+	uint32_t id;	 // dense, from 1, in order of first use
+	uint32_t line;
+	const char *file;
+	const char *function;
+	std::string location; // "<file basename>:<line>", for %s
+	std::string idText;		// decimal id, for %i
+	size_t functionLen;		// for %F
+};
+
+// Process-wide registry behind CAELAN_CALLSITE(). Records are never freed, so
+// the references it hands out stay valid.
+namespace CallsiteRegistry
+{
+	const Callsite &intern(const std::source_location &loc);
+	// Records interned so far; ids 1..size() are valid.
+	size_t size();
+	const Callsite &at(uint32_t id);
+}
+
+// The calling statement's Callsite, interned on its first execution. The
+// lambda gives every expansion its own static; source_location::current()
+// is evaluated at the call site, so file, line and function are the caller's.
+#define CAELAN_CALLSITE()                                                     \
+	([](const std::source_location &caelanLoc) -> const Callsite *            \
+	 {                                                                        \
+		 static const Callsite *caelanSite = &CallsiteRegistry::intern(caelanLoc); \
+		 return caelanSite; }(std::source_location::current()))
@@ -0,0 +1,35 @@
+#pragma once
+#include "FileUtil.h"
+#include "Buffer.h"
+
+// FileUtil writer that opens segments with O_DIRECT, so log data goes to disk
+// without leaving a second copy in the page cache. O_DIRECT needs aligned
+// memory, length and file offset: an append goes out in whole kBufferAlign
+// blocks (straight from a pool buffer when nothing is carried over, else via
+// staging_) and the unaligned rest waits in staging_ for the next append.
+// roll() and the destructor write the final partial block with O_DIRECT
+// cleared. Where the filesystem refuses O_DIRECT it degrades to buffered
+// writes through the same path.
+class DirectWriter : public FileUtil<DirectWriter>
+{
+public:
+  explicit DirectWriter(std::string dir = "./log", std::string prefix = "caelogger");
+  ~DirectWriter();
+  void append(const char *data, size_t len, const TimeSpan *span = nullptr);
+  void writeDropMessage(const char *msg, int len);
+  // Makes everything appended so far durable, the staged tail included.
+  void sync();
+  // False once O_DIRECT was refused and writes fell back to buffered I/O.
+  bool direct() const { return direct_; }
+
+private:
+  static constexpr size_t kStagingSize = 256 * 1024;
+  AlignedStorage staging_;
+  // Bytes accepted but not yet written; always < kBufferAlign between appends.
+  size_t tailLen_{0};
+  bool direct_{true};
+
+  void stage(const char *data, size_t len);
+  void writeBlocks(const char *data, size_t len);
+  void flushTail();
+};
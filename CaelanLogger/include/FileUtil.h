@@ -1,7 +1,9 @@
 #pragma once
 #include <atomic>
+#include <cstdint>
 #include <cstring>
 #include <string>
+#include <string_view>
 #include <filesystem>
 #include <fcntl.h>
 #include <unistd.h>
@@ -10,7 +12,14 @@
 #include <cstdlib>
 #include <cstdio>
 #include <system_error>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
 #include "TimeUtil.h"
+#include "TimeIndex.h"
+#include "SegmentPreparer.h"
+#include "SpinGuard.h"
 
 constexpr size_t FILE_MAX_SIZE = 256ull * 1024 * 1024;
 
@@ -18,22 +27,92 @@ template <typename Derived>
 class FileUtil
 {
 public:
+	// Whether several writer threads may call append() at once; a derived
+	// writer that supports it says so.
+	static constexpr bool kConcurrentAppend = false;
+
 	explicit FileUtil(std::string dir = "./log", std::string prefix = "caelogger");
 	~FileUtil();
 
 	unsigned long getWrittenBytes() const { return writtenBytes; }
+	uint64_t getRollCount() const { return rolls_.load(std::memory_order_relaxed); }
+	uint64_t getWriteCalls() const { return writeCalls_.load(std::memory_order_relaxed); }
+	uint64_t getRollNsTotal() const { return rollNsTotal_.load(std::memory_order_relaxed); }
+	uint64_t getRollNsMax() const { return rollNsMax_.load(std::memory_order_relaxed); }
 	void add_dropped(size_t n = 1);
 	void roll();
 
+	// 0 restores FILE_MAX_SIZE. Call before the first append.
+	void setMaxFileSize(size_t bytes) { maxFileSize_ = bytes ? bytes : FILE_MAX_SIZE; }
+	// Starts a SegmentPreparer so each roll swaps in a pre-opened, fallocate()d
+	// segment and retires the old fd off the writer thread.
+	void enablePreallocation();
+	// CPU set, priority and name for the SegmentPreparer thread. Call before
+	// enablePreallocation().
+	void setHelperPlacement(ThreadPlacement p) { helperPlacement_ = std::move(p); }
+	// applyThreadPlacement()'s result on the helper thread, 0 without one.
+	int helperPlacementError() const { return preparer_ ? preparer_->placementError() : 0; }
+	// Writes a "<segment>.idx" sidecar (see TimeIndex.h) next to every segment.
+	// Call before enablePreallocation() and the first append.
+	void enableTimeIndex() { timeIndex_ = true; }
+	// Appends the records collected since the last call to the current
+	// sidecar. The backend calls it once per writer cycle; roll() calls it
+	// before cutting over.
+	void flushIndex();
+	// Appends to "<prefix>.callsites", the id dictionary of lines rendered
+	// with %i (see Callsite.h). One file for all segments: ids never change
+	// within a run. Ids depend on registration order, so the first call of a
+	// run truncates what an earlier run left there.
+	void appendCallsites(std::string_view entries);
+	// fdatasync() on the current segment (BackendConfig::syncUrgent).
+	void sync()
+	{
+		if (fd_ >= 0)
+			::fdatasync(fd_);
+	}
+
 protected:
 	std::filesystem::path pick_log_dir(std::filesystem::path);
+	// Drops flag from openFlags_ after the first open, and from the segments
+	// the SegmentPreparer opens ahead, e.g. O_DIRECT once the device refused it.
+	void clearOpenFlag(int flag)
+	{
+		openFlags_ &= ~flag;
+		if (preparer_)
+			preparer_->setOpenFlags(openFlags_);
+	}
 	std::atomic<size_t> dropped_{0};
+	// Writer-thread-only counters, atomic so metrics readers can load them.
+	std::atomic<uint64_t> rolls_{0};
+	std::atomic<uint64_t> writeCalls_{0};
+	std::atomic<uint64_t> rollNsTotal_{0};
+	std::atomic<uint64_t> rollNsMax_{0};
 	std::filesystem::path dir_;
 	std::string prefix_;
 
 	int fd_{-1};
+	// Derived writers adjust these before the first openFile(), e.g. to drop
+	// O_APPEND for positional writes.
+	int openFlags_{O_CREAT | O_APPEND | O_WRONLY | O_CLOEXEC};
 	unsigned long writtenBytes{0};
+	size_t maxFileSize_{FILE_MAX_SIZE};
+	std::unique_ptr<SegmentPreparer> preparer_;
+	ThreadPlacement helperPlacement_;
+
+	bool timeIndex_{false};
+	int idxFd_{-1};
+	int callsiteFd_{-1};
+	// Pool writers record concurrently under the spin lock; one flusher at a
+	// time swaps the batch out and writes it without holding it.
+	std::atomic_flag indexLock_ = ATOMIC_FLAG_INIT;
+	std::vector<TimeIndexRecord> pendingIndex_;
+	std::mutex flushMutex_;
+	std::vector<TimeIndexRecord> flushingIndex_;
+	// Derived append() calls this with the offset its batch landed at.
+	void recordIndex(const TimeSpan *span, uint64_t offset, size_t len);
+
 	bool shouldRoll(size_t bufSize);
+	bool switchSegment();
 	bool openFile(const std::string &filename);
 	void closeFile();
 	std::string makeFullPath(const std::string &filename) const;
@@ -72,10 +151,67 @@ FileUtil<Derived>::FileUtil(std::string dir, std::string prefix)
 template <typename Derived>
 FileUtil<Derived>::~FileUtil()
 {
+	flushIndex();
+	if (idxFd_ >= 0)
+		::close(idxFd_);
+	if (callsiteFd_ >= 0)
+		::close(callsiteFd_);
+	if (preparer_ && fd_ >= 0)
+	{
+		preparer_->retire(fd_);
+		fd_ = -1;
+	}
+	// Closes and unlinks the segment it prepared but never handed out.
+	preparer_.reset();
 	if (fd_ >= 0)
 		::close(fd_);
 }
 
+template <typename Derived>
+void FileUtil<Derived>::enablePreallocation()
+{
+	if (preparer_)
+		return;
+	preparer_ = std::make_unique<SegmentPreparer>(
+			dir_.string(),
+			[this]
+			{ return makeFullPath(generateFileName()); },
+			openFlags_, maxFileSize_, timeIndex_, helperPlacement_);
+}
+
+template <typename Derived>
+void FileUtil<Derived>::recordIndex(const TimeSpan *span, uint64_t offset, size_t len)
+{
+	if (!timeIndex_ || !span || span->lines == 0)
+		return;
+	SpinGuard guard(indexLock_);
+	pendingIndex_.push_back({span->firstNs, span->lastNs, offset, static_cast<uint32_t>(len), span->lines});
+}
+
+template <typename Derived>
+void FileUtil<Derived>::flushIndex()
+{
+	if (!timeIndex_)
+		return;
+	// Another pool writer is flushing; whatever it misses goes out next cycle.
+	std::unique_lock<std::mutex> flushing(flushMutex_, std::try_to_lock);
+	if (!flushing.owns_lock())
+		return;
+	{
+		SpinGuard guard(indexLock_);
+		if (pendingIndex_.empty())
+			return;
+		flushingIndex_.swap(pendingIndex_);
+	}
+	if (idxFd_ >= 0)
+	{
+		// Best effort, like the drop message: a short index only costs seeks.
+		ssize_t n = ::write(idxFd_, flushingIndex_.data(), flushingIndex_.size() * sizeof(TimeIndexRecord));
+		(void)n;
+	}
+	flushingIndex_.clear();
+}
+
 template <typename Derived>
 void FileUtil<Derived>::add_dropped(size_t n)
 {
@@ -85,33 +221,80 @@ void FileUtil<Derived>::add_dropped(size_t n)
 template <typename Derived>
 void FileUtil<Derived>::roll()
 {
+	auto start = std::chrono::steady_clock::now();
 	size_t n = dropped_.exchange(0, std::memory_order_relaxed);
 	if (fd_ >= 0)
 	{
-		constexpr size_t kDropMsgCap = 64;
-		char *msg = new char[kDropMsgCap];
-		int len = std::snprintf(msg, kDropMsgCap, "dropped: %zu\n", n);
+		char msg[64];
+		int len = std::snprintf(msg, sizeof(msg), "dropped: %zu\n", n);
 		if (len > 0)
 		{
 			static_cast<Derived *>(this)->writeDropMessage(msg, len);
 		}
-		else
-		{
-			delete[] msg;
-		}
 	}
+	flushIndex();
 
-	if (!openFile(generateFileName()))
+	if (!switchSegment())
 	{
 		throw std::runtime_error(std::string("write() failed: ") + std::strerror(errno));
 	}
 	writtenBytes = 0;
+
+	uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+										std::chrono::steady_clock::now() - start)
+										.count();
+	rolls_.store(rolls_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	rollNsTotal_.store(rollNsTotal_.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+	if (ns > rollNsMax_.load(std::memory_order_relaxed))
+		rollNsMax_.store(ns, std::memory_order_relaxed);
+}
+
+// With a preparer the old fd is trimmed and closed on the helper thread and the
+// next one is already open; without one (or if it lags) this opens inline.
+template <typename Derived>
+bool FileUtil<Derived>::switchSegment()
+{
+	if (preparer_)
+	{
+		if (fd_ >= 0)
+			preparer_->retire(fd_);
+		if (idxFd_ >= 0)
+			::close(idxFd_);
+		PreparedSegment next = preparer_->take();
+		fd_ = next.fd;
+		idxFd_ = next.idxFd;
+		if (fd_ >= 0)
+			return true;
+	}
+	else
+	{
+		closeFile();
+	}
+	return openFile(generateFileName());
+}
+
+template <typename Derived>
+void FileUtil<Derived>::appendCallsites(std::string_view entries)
+{
+	if (callsiteFd_ < 0)
+		callsiteFd_ = ::open(makeFullPath(prefix_ + ".callsites").c_str(), O_CREAT | O_TRUNC | O_APPEND | O_WRONLY | O_CLOEXEC, 0644);
+	if (callsiteFd_ < 0)
+		return;
+	while (!entries.empty())
+	{
+		ssize_t n = ::write(callsiteFd_, entries.data(), entries.size());
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return;
+		entries.remove_prefix(static_cast<size_t>(n));
+	}
 }
 
 template <typename Derived>
 bool FileUtil<Derived>::shouldRoll(size_t bufSize)
 {
-	return writtenBytes + bufSize > FILE_MAX_SIZE;
+	return writtenBytes + bufSize > maxFileSize_;
 }
 
 template <typename Derived>
@@ -125,7 +308,9 @@ bool FileUtil<Derived>::openFile(const std::string &file_name)
 	}
 
 	const std::string full = makeFullPath(file_name);
-	fd_ = ::open(full.c_str(), O_CREAT | O_APPEND | O_WRONLY | O_CLOEXEC, 0644);
+	fd_ = ::open(full.c_str(), openFlags_, 0644);
+	if (fd_ >= 0 && timeIndex_)
+		idxFd_ = ::open((full + kTimeIndexSuffix).c_str(), O_CREAT | O_APPEND | O_WRONLY | O_CLOEXEC, 0644);
 	return fd_ >= 0;
 }
 
@@ -137,6 +322,11 @@ void FileUtil<Derived>::closeFile()
 		close(fd_);
 		fd_ = -1;
 	}
+	if (idxFd_ >= 0)
+	{
+		close(idxFd_);
+		idxFd_ = -1;
+	}
 }
 
 template <typename Derived>
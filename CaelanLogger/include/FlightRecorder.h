@@ -0,0 +1,47 @@
+#pragma once
+#include <memory>
+#include <string>
+#include "BackendConfig.h"
+#include "FileUtil.h"
+
+// Writer that keeps drained buffers in memory instead of writing them
+// (BackendConfig::flightRecorder): a byte ring of cfg.flightRecorder bytes
+// where new data overwrites the oldest. Nothing reaches the disk until
+// dump(), which writes the ring, oldest line first, plus any partial buffers
+// added since the last dump to a new "<prefix>_flight_<date>_LOG_<n>" file
+// and empties the ring. The backend dumps on an ERROR/FATAL line, on
+// dumpFlightRecorder() and on cfg.flightRecorderSignal.
+class FlightRecorder : public FileUtil<FlightRecorder>
+{
+public:
+  FlightRecorder(std::string dir, const BackendConfig &cfg);
+  void append(const char *data, size_t len, const TimeSpan *span = nullptr);
+  void writeDropMessage(const char *msg, int len);
+  // Records the "dropped: N" line in the ring; there is no segment to cut.
+  void roll();
+  // No segments, so no sidecars or preallocated files.
+  void enableTimeIndex() {}
+  void enablePreallocation() {}
+
+  // The committed part of a buffer a thread still holds; written after the
+  // ring by the next dump().
+  void addPartial(const char *data, size_t len);
+  // Returns the file written, or an empty string if it could not be.
+  std::string dump(const char *reason);
+  uint64_t getFlightDumps() const { return dumps_.load(std::memory_order_relaxed); }
+
+private:
+  std::unique_ptr<char[]> ring_;
+  size_t capacity_;
+  // Next byte to write; the ring has wrapped once used_ == capacity_.
+  size_t head_{0};
+  size_t used_{0};
+  std::string partials_;
+  std::atomic<uint64_t> dumps_{0};
+};
+
+// Counts deliveries of any signal installed here. The handler only bumps it;
+// writers compare it against what they last served.
+uint64_t flightRecorderSignals();
+// Installs the handler for sig (once per signal). False if sigaction fails.
+bool installFlightRecorderSignal(int sig);
@@ -0,0 +1,182 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+// Customization point for logging user types without building a std::string
+// first. Specialize CaelanLogger::formatter<T> with
+//
+//     template <typename Out>
+//     static void format(Out &out, const T &value);
+//
+// and LogStream's operator<< hands it an Out that writes into the line's
+// buffer: out.write(data, len), out.write(string_view), out.put(char), and
+// formatValue(out, member) to reuse another formatter. A formatter that
+// declares
+//
+//     static constexpr size_t max_size = ...;   // bytes format() may write
+//
+// is called once with that much room reserved, and its writes are plain
+// stores; without one, each write checks for room like the built-in
+// operators do.
+//
+// Scoped enums (enum class) format as their enumerator names out of a table
+// built at compile time; see enum_range.
+namespace CaelanLogger
+{
+    template <typename T, typename Enable = void>
+    struct formatter;
+
+    // Writes to memory the caller has already reserved.
+    struct FixedOut
+    {
+        char *pos;
+
+        void write(const char *data, size_t len)
+        {
+            std::memcpy(pos, data, len);
+            pos += len;
+        }
+        void write(std::string_view s) { write(s.data(), s.size()); }
+        void put(char c) { *pos++ = c; }
+    };
+
+    template <typename T>
+    concept Formattable = requires(const T &value, FixedOut &out) {
+        formatter<T>::format(out, value);
+    };
+
+    template <typename T>
+    concept BoundedFormattable = Formattable<T> && requires {
+        std::integral_constant<size_t, formatter<T>::max_size>{};
+    };
+
+    template <typename Out, typename T>
+    void formatValue(Out &out, const T &value)
+    {
+        formatter<T>::format(out, value);
+    }
+
+    template <typename T>
+    struct formatter<T, std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, bool> && !std::is_same_v<T, char>>>
+    {
+        static constexpr size_t max_size = std::numeric_limits<T>::digits10 + 2;
+
+        template <typename Out>
+        static void format(Out &out, T value)
+        {
+            char digits[max_size];
+            char *end = digits + max_size;
+            char *p = end;
+            // Negate digit by digit so the minimum value does not overflow.
+            const bool negative = value < 0;
+            do
+            {
+                const int d = static_cast<int>(value % 10);
+                *--p = static_cast<char>('0' + (negative ? -d : d));
+                value /= 10;
+            } while (value != 0);
+            if (negative)
+                *--p = '-';
+            out.write(p, static_cast<size_t>(end - p));
+        }
+    };
+
+    template <>
+    struct formatter<std::string_view>
+    {
+        template <typename Out>
+        static void format(Out &out, std::string_view s) { out.write(s); }
+    };
+
+    // The enumerator values whose names go into the table: [min, max].
+    // Specialize for enums outside the default range.
+    template <typename E>
+    struct enum_range
+    {
+        static constexpr int min = 0;
+        static constexpr int max = 63;
+    };
+
+    namespace detail
+    {
+        // std::is_scoped_enum is C++23.
+        template <typename E>
+        constexpr bool isScopedEnum()
+        {
+            if constexpr (std::is_enum_v<E>)
+                return !std::is_convertible_v<E, std::underlying_type_t<E>>;
+            else
+                return false;
+        }
+
+        // The compiler spells V out in the function signature: "V = ns::Side::Buy"
+        // for an enumerator, "V = (ns::Side)5" for any other value.
+        template <auto V>
+        constexpr std::string_view enumValueName()
+        {
+            constexpr std::string_view sig = __PRETTY_FUNCTION__;
+            constexpr size_t begin = sig.find("V = ") + 4;
+            constexpr std::string_view full = sig.substr(begin, sig.find_first_of(";]", begin) - begin);
+            if constexpr (full.empty() || full[0] == '(')
+                return {};
+            else
+                return full.substr(full.rfind("::") == std::string_view::npos ? 0 : full.rfind("::") + 2);
+        }
+
+        template <typename E, int Min, int... I>
+        constexpr auto enumNameTable(std::integer_sequence<int, I...>)
+        {
+            return std::array<std::string_view, sizeof...(I)>{enumValueName<static_cast<E>(Min + I)>()...};
+        }
+
+        template <typename E>
+        struct EnumNames
+        {
+            static constexpr int min = enum_range<E>::min;
+            static constexpr auto table =
+                enumNameTable<E, min>(std::make_integer_sequence<int, enum_range<E>::max - min + 1>{});
+            static constexpr size_t longest = []
+            {
+                size_t n = 0;
+                for (std::string_view name : table)
+                    n = name.size() > n ? name.size() : n;
+                return n;
+            }();
+        };
+    }
+
+    // Name of e, or an empty view when e has no named enumerator in range.
+    template <typename E>
+    constexpr std::string_view enumName(E e)
+    {
+        using Names = detail::EnumNames<E>;
+        const auto v = static_cast<long long>(e);
+        if (v < Names::min || v >= Names::min + static_cast<long long>(Names::table.size()))
+            return {};
+        return Names::table[static_cast<size_t>(v - Names::min)];
+    }
+
+    // Unnamed values print as their number.
+    template <typename E>
+    struct formatter<E, std::enable_if_t<detail::isScopedEnum<E>()>>
+    {
+        using Underlying = std::underlying_type_t<E>;
+        static constexpr size_t max_size = std::max(detail::EnumNames<E>::longest, formatter<Underlying>::max_size);
+
+        template <typename Out>
+        static void format(Out &out, E e)
+        {
+            const std::string_view name = enumName(e);
+            if (!name.empty())
+                out.write(name);
+            else
+                formatter<Underlying>::format(out, static_cast<Underlying>(e));
+        }
+    };
+}
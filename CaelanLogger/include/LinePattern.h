@@ -0,0 +1,104 @@
+#pragma once
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Callsite.h"
+#include "Level.h"
+
+// Line prefix pattern (BackendConfig::linePattern), compiled once per backend
+// into a flat list of ops:
+//   %L level        %D date (YYYY-MM-DD)   %T time (HH:MM:SS)
+//   %f milliseconds (3 digits)             %u microseconds (6 digits)
+//   %t thread id    %N thread name         %P process id
+//   %n logger name  %s source (file:line)  %F function
+//   %i callsite id (see Callsite.h)        %% a literal '%'
+// Any other character is copied as is. Throws std::invalid_argument on an
+// unknown or unterminated '%'.
+class LinePattern
+{
+public:
+	// What the fixed prefix has always looked like.
+	static constexpr const char *kDefault = "%L %D %T.%f ";
+
+	enum class Field : uint8_t
+	{
+		Literal,
+		Level,
+		Date,
+		Time,
+		Millis,
+		Micros,
+		ThreadId,
+		ThreadName,
+		Pid,
+		LoggerName,
+		Source,
+		Function,
+		CallsiteId,
+	};
+	struct Op
+	{
+		Field field;
+		std::string text; // Literal only
+	};
+
+	explicit LinePattern(std::string_view pattern = kDefault);
+	const std::vector<Op> &ops() const { return ops_; }
+	// Whether lines name their callsite by id only (%i), so the writer keeps
+	// the id dictionary next to the log.
+	bool usesCallsiteIds() const;
+
+private:
+	std::vector<Op> ops_;
+};
+
+// One thread's rendering of a LinePattern. Literals and the per-thread
+// constants (thread id and name, pid, logger name) are rendered into a
+// template at construction, date and time once per second. A line costs one
+// memcpy per segment between per-line fields (%L %s %F %i), those fields'
+// pre-rendered text, and the sub-second digits.
+class PrefixRenderer
+{
+public:
+	PrefixRenderer(const LinePattern &pattern, std::string_view loggerName);
+	// Upper bound of render()'s output for a line from site (nullptr when the
+	// line has no callsite; its fields render as "-").
+	size_t maxSize(const Callsite *site = nullptr) const;
+	// Writes the prefix of a line stamped epochNs at level to out, which has
+	// room for maxSize(site) bytes. Returns the bytes written.
+	size_t render(char *out, CaelanLogger::Level level, int64_t epochNs, const Callsite *site = nullptr);
+	// Whether %t or %N were rendered for a thread other than the caller,
+	// i.e. the owner moved (see LogContext::attach()).
+	bool renderedForOtherThread() const;
+
+private:
+	struct Patch
+	{
+		LinePattern::Field field;
+		uint32_t pos; // in text_
+	};
+	// text_ [begin, end) is copied, then the per-line field next (Literal
+	// for none).
+	struct Segment
+	{
+		uint32_t begin;
+		uint32_t end;
+		LinePattern::Field next;
+	};
+	std::string text_;
+	std::vector<Segment> segments_;
+	std::vector<Patch> clockPatches_;	 // Date/Time, rewritten in text_ per second
+	std::vector<Patch> subsecPatches_; // Millis/Micros, written per line
+	std::time_t cachedSec_{-1};
+	// text_ plus the longest level names.
+	size_t fixedMax_{0};
+	uint32_t sources_{0};
+	uint32_t functions_{0};
+	uint32_t ids_{0};
+	// The thread %t/%N were rendered for; 0 when the pattern has neither.
+	long tid_{0};
+
+	void renderClock(std::time_t sec);
+};
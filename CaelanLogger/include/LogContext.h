@@ -0,0 +1,97 @@
+#pragma once
+#include <memory>
+#include "AsyncLogger.h"
+
+// A ThreadLogger that belongs to a task instead of a thread. Coroutines that
+// migrate between executor workers keep one in their frame (or a worker keeps
+// one per task) and attach it to whichever thread resumes them: while it is
+// attached, LOG_TO(logger, ...) on that thread writes into the context's
+// buffer, so one request's lines stay together instead of spreading over
+// every worker's thread_local buffer.
+//
+// A context is used by one thread at a time; the executor's own handoff of
+// the task orders its accesses, so there is no locking. Like a thread's
+// ThreadLogger, it must be destroyed before the AsyncLogger's shutdownAll().
+//
+//     co_await something;         // suspend: ctx.detach()
+//     ctx.attach();               // resumed, possibly on another thread
+//     LOG_TO(logger, INFO) << ...;
+template <typename BackendT>
+class LogContext
+{
+public:
+    // Takes no pool buffer until the first line is logged.
+    explicit LogContext(AsyncLogger<BackendT> &logger)
+        : backend_(logger.backend_.get())
+    {
+        if (backend_)
+            logger_ = std::make_unique<ThreadLogger<BackendT>>(logger.bufSize_, backend_, false);
+    }
+
+    ~LogContext()
+    {
+        if (attached_)
+            detach();
+    }
+
+    LogContext(const LogContext &) = delete;
+    LogContext &operator=(const LogContext &) = delete;
+
+    // Routes the calling thread's LOG_TO for this logger into the context
+    // until detach(), which must run on the same thread. %t and %N in the
+    // line pattern name the attaching thread from here on.
+    void attach()
+    {
+        if (logger_)
+            logger_->rebindThread();
+        auto &slot = AsyncLogger<BackendT>::attached();
+        saved_ = slot;
+        slot = {backend_, logger_.get()};
+        attached_ = true;
+    }
+
+    // Restores whatever was attached before. With release, the partial
+    // buffer is handed off too, returning its pool slot while the task is
+    // suspended; without it the next attach() keeps appending to it.
+    void detach(bool release = false)
+    {
+        AsyncLogger<BackendT>::attached() = saved_;
+        attached_ = false;
+        if (release && logger_)
+            logger_->release();
+    }
+
+    // Hands off the buffer now, e.g. at the end of a request.
+    void flush()
+    {
+        if (logger_)
+            logger_->handoff();
+    }
+
+    // For LOG_CTX, which logs through the context without attaching it. Its
+    // %t and %N name the thread that last attached (or built) the context.
+    ThreadLogger<BackendT> *logger() const { return logger_.get(); }
+
+    // attach() for the current scope.
+    class Scope
+    {
+    public:
+        explicit Scope(LogContext &ctx, bool releaseOnExit = false)
+            : ctx_(ctx), release_(releaseOnExit) { ctx_.attach(); }
+        ~Scope() { ctx_.detach(release_); }
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+
+    private:
+        LogContext &ctx_;
+        bool release_;
+    };
+
+private:
+    BackendT *backend_;
+    std::unique_ptr<ThreadLogger<BackendT>> logger_;
+    typename AsyncLogger<BackendT>::AttachedContext saved_;
+    bool attached_{false};
+};
+
+#define LOG_CTX(ctx, LEVEL) LogStream((ctx).logger(), CaelanLogger::LEVEL, CAELAN_CALLSITE())
@@ -1,16 +1,22 @@
 #pragma once
+#include <algorithm>
 #include <string>
 #include "Buffer.h"
 #include "ThreadLogger.h"
 #include "Level.h"
 #include "TimeUtil.h"
+#include "OrderedMerge.h"
+#include "Callsite.h"
+#include "Formatter.h"
 
 template <typename BackendT>
 class LogStream
 {
 public:
     LogStream() = default;
-    LogStream(ThreadLogger<BackendT> *, CaelanLogger::Level);
+    // site: the statement's Callsite (LOG_TO passes CAELAN_CALLSITE()), for
+    // the %s/%F/%i pattern fields.
+    LogStream(ThreadLogger<BackendT> *, CaelanLogger::Level, const Callsite *site = nullptr);
     ~LogStream();
     // convert different types of data to chars and load in current buffer
     LogStream &operator<<(bool express);
@@ -26,26 +32,57 @@ public:
     LogStream &operator<<(const char *);
     LogStream &operator<<(const unsigned char *);
     LogStream &operator<<(const std::string &);
+    // Any type with a CaelanLogger::formatter (see Formatter.h).
+    template <typename T>
+        requires CaelanLogger::Formattable<T>
+    LogStream &operator<<(const T &value);
 
-    size_t getMaxLineLength() const { return kMaxLineLength; }
+    // Upper bound of the per-line reservation; longer lines spill rather
+    // than being cut.
+    size_t getMaxLineLength() const { return ThreadLogger<BackendT>::kMaxLineReserve; }
 
 private:
-    static const size_t kMaxLineLength = 1028;
     ThreadLogger<BackendT> *target_;
     Buffer *curBuffer_;
-
-    void addLevel(CaelanLogger::Level);
-    void addTime();
+    CaelanLogger::Level level_;
+    const Callsite *site_{nullptr};
+    // Where this line starts in curBuffer_ (moves when the line spills).
+    size_t lineStart_{0};
+    int64_t lineNs_{0};
+    // No buffer could take the rest of the line; further output is clipped.
+    bool truncated_{false};
+    // Offset of this line's stamp header in ordered mode, else npos.
+    size_t stampPos_{static_cast<size_t>(-1)};
+    uint64_t stamp_{0};
+
+    // Renders the thread's compiled line prefix (see LinePattern).
+    void addPrefix();
+    // Makes room for n more bytes plus the final '\n', spilling the line to
+    // another buffer if needed. False once the line has to be cut.
+    bool ensure(size_t n);
+    // Appends, clipping at the buffer end if ensure() fails.
+    void put(const char *data, size_t len);
 
     template <typename T>
     void convertInt(T number);
+
+    // The Out of formatters without a max_size: every write goes through
+    // put().
+    struct CheckedOut
+    {
+        LogStream &stream;
+
+        void write(const char *data, size_t len) { stream.put(data, len); }
+        void write(std::string_view s) { stream.put(s.data(), s.size()); }
+        void put(char c) { stream.put(&c, 1); }
+    };
 };
 
 template <typename BackendT>
 template <typename T>
 void LogStream<BackendT>::convertInt(T number)
 {
-    if (curBuffer_->remaining() < 32)
+    if (!ensure(32))
     {
         return;
     }
@@ -77,7 +114,8 @@ void LogStream<BackendT>::convertInt(T number)
 }
 
 template <typename BackendT>
-LogStream<BackendT>::LogStream(ThreadLogger<BackendT> *target, CaelanLogger::Level level) : target_(target)
+LogStream<BackendT>::LogStream(ThreadLogger<BackendT> *target, CaelanLogger::Level level, const Callsite *site)
+    : target_(target), curBuffer_(nullptr), level_(level), site_(site)
 {
     if (!target_)
         return;
@@ -92,20 +130,28 @@ LogStream<BackendT>::LogStream(ThreadLogger<BackendT> *target, CaelanLogger::Lev
     if (!curBuffer_)
         return;
 
-    if (curBuffer_->remaining() < kMaxLineLength)
+    const size_t reserve = target_->lineReserve();
+    if (curBuffer_->remaining() < reserve)
     {
         target_->handoff();
         curBuffer_ = target_->getCurBuffer();
-        if (!curBuffer_ || curBuffer_->remaining() < kMaxLineLength) // to
+        if (!curBuffer_ || curBuffer_->remaining() < reserve) // to
         {
-            target_->recordDrop();
+            target_->recordDrop(level_);
             curBuffer_ = nullptr;
             target_ = nullptr; // prevent destructor from double-counting
             return;
         }
     }
-    addLevel(level);
-    addTime();
+    lineStart_ = curBuffer_->size();
+    lineNs_ = BackendT::Clock::nowNanos();
+    if (target_->ordered())
+    {
+        stamp_ = lineStampNow();
+        stampPos_ = curBuffer_->size();
+        curBuffer_->increaseSize(kLineStampSize);
+    }
+    addPrefix();
 }
 
 template <typename BackendT>
@@ -115,9 +161,16 @@ LogStream<BackendT>::~LogStream()
     {
         curBuffer_->add('\n');
         curBuffer_->incrementLineCount();
+        if (stampPos_ != static_cast<size_t>(-1))
+        {
+            size_t len = curBuffer_->size() - stampPos_ - kLineStampSize;
+            storeLineStamp(curBuffer_->getBuffer() + stampPos_, stamp_, static_cast<uint32_t>(len));
+        }
+        // May submit curBuffer_ (a large record); not touched after this.
+        target_->endLine(curBuffer_->size() - lineStart_, truncated_, level_);
     }
     else if (target_)
-        target_->recordDrop();
+        target_->recordDrop(level_);
 }
 
 template <typename BackendT>
@@ -129,7 +182,7 @@ LogStream<BackendT> &LogStream<BackendT>::operator<<(bool express)
     const char *s = express ? "true" : "false";
     const size_t len = express ? 4 : 5;
 
-    curBuffer_->add(s, len);
+    put(s, len);
     return *this;
 }
 
@@ -211,7 +264,7 @@ LogStream<BackendT> &LogStream<BackendT>::operator<<(double number)
     if (len <= 0)
         return *this;
 
-    curBuffer_->add(temp, len);
+    put(temp, static_cast<size_t>(len));
     return *this;
 }
 
@@ -221,7 +274,7 @@ LogStream<BackendT> &LogStream<BackendT>::operator<<(const char str)
     if (!curBuffer_)
         return *this;
 
-    curBuffer_->add(str);
+    put(&str, 1);
     return *this;
 }
 
@@ -232,7 +285,7 @@ LogStream<BackendT> &LogStream<BackendT>::operator<<(const char *str)
         return *this;
 
     size_t len = std::strlen(str);
-    curBuffer_->add(str, len);
+    put(str, len);
     return *this;
 }
 
@@ -244,7 +297,7 @@ LogStream<BackendT> &LogStream<BackendT>::operator<<(const unsigned char *str)
         return *this;
 
     size_t len = std::strlen(s);
-    curBuffer_->add(s, len);
+    put(s, len);
     return *this;
 }
 
@@ -255,45 +308,81 @@ LogStream<BackendT> &LogStream<BackendT>::operator<<(const std::string &str)
         return *this;
 
     size_t len = str.length();
-    curBuffer_->add(str.c_str(), len);
+    put(str.c_str(), len);
     return *this;
 }
 
 template <typename BackendT>
-void LogStream<BackendT>::addLevel(CaelanLogger::Level level)
+template <typename T>
+    requires CaelanLogger::Formattable<T>
+LogStream<BackendT> &LogStream<BackendT>::operator<<(const T &value)
 {
     if (!curBuffer_)
-        return;
+        return *this;
 
-    switch (level)
+    using F = CaelanLogger::formatter<T>;
+    if constexpr (CaelanLogger::BoundedFormattable<T>)
     {
-    case CaelanLogger::Level::INFO:
-        curBuffer_->add("INFO ", 5);
-        break;
-    case CaelanLogger::Level::DEBUG:
-        curBuffer_->add("DEBUG ", 6);
-        break;
-    case CaelanLogger::Level::WARNING:
-        curBuffer_->add("WARNING ", 8);
-        break;
-    case CaelanLogger::Level::ERROR:
-        curBuffer_->add("ERROR ", 7);
-        break;
-    case CaelanLogger::Level::FATAL:
-        curBuffer_->add("FATAL ", 6);
-        break;
-    default:
-        curBuffer_->add("INFO ", 5);
-        break;
+        // One reservation for the whole value; falls through to the checked
+        // writes only when the line is being cut.
+        if (ensure(F::max_size))
+        {
+            char *start = curBuffer_->getBuffer() + curBuffer_->size();
+            CaelanLogger::FixedOut out{start};
+            F::format(out, value);
+            curBuffer_->increaseSize(static_cast<size_t>(out.pos - start));
+            return *this;
+        }
     }
+    CheckedOut out{*this};
+    F::format(out, value);
+    return *this;
 }
 
 template <typename BackendT>
-void LogStream<BackendT>::addTime()
+void LogStream<BackendT>::addPrefix()
 {
-    if (!curBuffer_)
+    curBuffer_->noteTime(lineNs_);
+    PrefixRenderer &prefix = target_->prefix();
+    if (!ensure(prefix.maxSize(site_)))
         return;
-    std::string logTime = LogTime::nowString();
-    curBuffer_->add(logTime.c_str(), logTime.length());
-    curBuffer_->add(" ", 1);
+    size_t len = prefix.render(curBuffer_->getBuffer() + curBuffer_->size(), level_, lineNs_, site_);
+    curBuffer_->increaseSize(len);
+}
+
+template <typename BackendT>
+bool LogStream<BackendT>::ensure(size_t n)
+{
+    if (curBuffer_->remaining() > n)
+        return true;
+    if (truncated_)
+        return false;
+
+    const size_t partial = curBuffer_->size() - lineStart_;
+    Buffer *next = target_->spill(lineStart_, n + 1);
+    if (!next)
+    {
+        truncated_ = true;
+        return false;
+    }
+    curBuffer_ = next;
+    lineStart_ = curBuffer_->size() - partial;
+    if (stampPos_ != static_cast<size_t>(-1))
+        stampPos_ = lineStart_;
+    curBuffer_->noteTime(lineNs_);
+    // A large-record buffer stops growing at cfg.maxRecordSize.
+    if (curBuffer_->remaining() <= n)
+    {
+        truncated_ = true;
+        return false;
+    }
+    return true;
+}
+
+template <typename BackendT>
+void LogStream<BackendT>::put(const char *data, size_t len)
+{
+    if (!ensure(len))
+        len = std::min(len, curBuffer_->remaining() ? curBuffer_->remaining() - 1 : 0);
+    curBuffer_->add(data, len);
 }
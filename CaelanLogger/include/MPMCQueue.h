@@ -0,0 +1,92 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include "RingBuffer.h"
+
+// Bounded lock-free queue for any number of producers and consumers
+// (Vyukov's array queue). Each slot carries a sequence number saying whether
+// it is ready to be filled or drained for the current lap, so push and pop
+// are one CAS on head_ or tail_ and nobody ever waits on a lock holder that
+// got preempted. size() and isEmpty() count claimed slots, which may not be
+// published yet: pop() can still return nullopt right after isEmpty() said no.
+template <typename T>
+class MPMCQueue : public ConcurrentRingBuffer<MPMCQueue<T>, T>
+{
+public:
+  using Base = ConcurrentRingBuffer<MPMCQueue<T>, T>;
+
+  explicit MPMCQueue(size_t bufferSize)
+      : Base(bufferSize), seq_(std::make_unique<std::atomic<size_t>[]>(this->capacity_))
+  {
+    for (size_t i = 0; i < this->capacity_; i++)
+      seq_[i].store(i, std::memory_order_relaxed);
+  }
+
+  bool pushImpl(T &&elem) { return emplace(std::move(elem)); }
+  bool pushImpl(const T &elem) { return emplace(elem); }
+  std::optional<T> popImpl();
+
+private:
+  // seq_[i] == pos: free for the push claiming pos; pos + 1: holds its element.
+  std::unique_ptr<std::atomic<size_t>[]> seq_;
+
+  template <typename U>
+  bool emplace(U &&elem);
+};
+
+template <typename T>
+template <typename U>
+bool MPMCQueue<T>::emplace(U &&elem)
+{
+  size_t h = this->head_.load(std::memory_order_relaxed);
+  while (true)
+  {
+    size_t seq = seq_[h & this->mask_].load(std::memory_order_acquire);
+    intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(h);
+    if (diff == 0)
+    {
+      if (this->head_.compare_exchange_weak(h, h + 1, std::memory_order_relaxed))
+        break;
+    }
+    else if (diff < 0)
+    {
+      return false; // the slot still holds last lap's element
+    }
+    else
+    {
+      h = this->head_.load(std::memory_order_relaxed);
+    }
+  }
+  this->ringBuffer_[h & this->mask_] = std::forward<U>(elem);
+  seq_[h & this->mask_].store(h + 1, std::memory_order_release);
+  return true;
+}
+
+template <typename T>
+std::optional<T> MPMCQueue<T>::popImpl()
+{
+  size_t t = this->tail_.load(std::memory_order_relaxed);
+  while (true)
+  {
+    size_t seq = seq_[t & this->mask_].load(std::memory_order_acquire);
+    intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(t + 1);
+    if (diff == 0)
+    {
+      if (this->tail_.compare_exchange_weak(t, t + 1, std::memory_order_relaxed))
+        break;
+    }
+    else if (diff < 0)
+    {
+      return std::nullopt;
+    }
+    else
+    {
+      t = this->tail_.load(std::memory_order_relaxed);
+    }
+  }
+  T res = std::move(this->ringBuffer_[t & this->mask_]);
+  seq_[t & this->mask_].store(t + this->capacity_, std::memory_order_release);
+  return res;
+}
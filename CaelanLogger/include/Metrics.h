@@ -0,0 +1,197 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "Level.h"
+#include "RingBuffer.h"
+
+constexpr size_t kLevelCount = 5;
+
+// Counters below are written by exactly one thread, so they are bumped with a
+// relaxed load + store instead of fetch_add: no locked RMW on the hot path.
+// Readers on other threads may see a slightly stale value, never a torn one.
+inline void bump(std::atomic<uint64_t> &counter, uint64_t n = 1)
+{
+	counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+inline void bumpMax(std::atomic<uint64_t> &counter, uint64_t v)
+{
+	if (v > counter.load(std::memory_order_relaxed))
+		counter.store(v, std::memory_order_relaxed);
+}
+
+// One block per ThreadLogger, owned by the backend's MetricsRegistry. Only the
+// owning producer thread writes it; the cache-line alignment keeps two
+// producers' blocks from false-sharing.
+struct alignas(kCacheLine) ProducerCounters
+{
+	std::atomic<uint64_t> lines{0};
+	std::atomic<uint64_t> bytes{0};
+	std::atomic<uint64_t> handoffs{0};
+	std::atomic<uint64_t> dropsByLevel[kLevelCount]{};
+	// Time spent in ThreadLogger::handoff() (submit + acquire).
+	std::atomic<uint64_t> handoffNsTotal{0};
+	std::atomic<uint64_t> handoffNsMax{0};
+	// Lines moved to a fresh buffer mid-line, lines that went to a
+	// large-record buffer, and lines cut short (no buffer, or maxRecordSize).
+	std::atomic<uint64_t> spills{0};
+	std::atomic<uint64_t> largeRecords{0};
+	std::atomic<uint64_t> truncated{0};
+	// Buffers handed off early because they ended in an ERROR/FATAL line.
+	std::atomic<uint64_t> urgentHandoffs{0};
+	// acquire() calls skipped because the pool had not been refilled since
+	// this thread last found it empty.
+	std::atomic<uint64_t> acquireSkips{0};
+	// Flight recorder only: the current pool buffer's data and its length up
+	// to the last finished line. A reader that sees partialData change
+	// between its two loads of it discards the length.
+	std::atomic<const char *> partialData{nullptr};
+	std::atomic<size_t> partialLen{0};
+};
+
+// Buffer ages in log2 microsecond buckets: bucket 0 counts ages under 1 us,
+// bucket i ages in [2^(i-1), 2^i) us; the last bucket takes everything older.
+constexpr size_t kAgeBuckets = 32;
+
+struct AgeHistogram
+{
+	std::atomic<uint64_t> buckets[kAgeBuckets]{};
+	// Single writer thread, like every WriterCounters field.
+	void record(int64_t ageNs);
+};
+
+// Read-side copy of one or more AgeHistograms.
+struct AgeStats
+{
+	uint64_t buckets[kAgeBuckets]{};
+	uint64_t count() const;
+	// Upper edge of the bucket holding the p-th percentile (0 < p <= 100),
+	// 0 when empty.
+	uint64_t percentileUs(double p) const;
+};
+
+// One block per backend writer thread, written only by that thread.
+struct alignas(kCacheLine) WriterCounters
+{
+	std::atomic<uint64_t> cycles{0};
+	std::atomic<uint64_t> cycleNsTotal{0};
+	std::atomic<uint64_t> cycleNsMax{0};
+	std::atomic<uint64_t> buffers{0};
+	std::atomic<uint64_t> batchMax{0};
+	std::atomic<uint64_t> bytes{0};
+	// Times this writer blocked on the condition variable.
+	std::atomic<uint64_t> parks{0};
+	// fdatasync() calls after cycles that wrote an urgent buffer.
+	std::atomic<uint64_t> syncs{0};
+	// Age of each non-empty buffer, from its first line, when its producer
+	// handed it off, when this writer popped it, and once its bytes were
+	// written.
+	AgeHistogram handoffAge;
+	AgeHistogram pickupAge;
+	AgeHistogram writeAge;
+};
+
+// Point-in-time aggregate returned by SharedBackend::metrics(). Producer
+// totals include threads that have already exited; lines/bytes of a live
+// thread are counted when its buffer is handed off, not per call.
+struct MetricsSnapshot
+{
+	uint64_t producers{0};
+	uint64_t lines{0};
+	uint64_t bytes{0};
+	uint64_t handoffs{0};
+	uint64_t dropsByLevel[kLevelCount]{};
+	uint64_t handoffNsTotal{0};
+	uint64_t handoffNsMax{0};
+	uint64_t spills{0};
+	uint64_t largeRecords{0};
+	uint64_t truncated{0};
+	uint64_t urgentHandoffs{0};
+	uint64_t acquireSkips{0};
+	// notify_one() calls issued to wake a parked writer.
+	uint64_t wakeups{0};
+
+	size_t poolCapacity{0};
+	size_t freeDepth{0};
+	size_t submittedDepth{0};
+	// Pool buffers with storage in memory (lazyBuffers, idleRelease), and
+	// how many times an idle one gave its pages back.
+	size_t residentBuffers{0};
+	uint64_t idleReleases{0};
+	// Per-producer rings still owned or not yet drained (perProducerRings).
+	size_t rings{0};
+
+	uint64_t writerCycles{0};
+	uint64_t cycleNsTotal{0};
+	uint64_t cycleNsMax{0};
+	uint64_t buffersWritten{0};
+	uint64_t batchMax{0};
+	uint64_t bytesWritten{0};
+	uint64_t parks{0};
+	uint64_t syncs{0};
+	uint64_t writeCalls{0};
+	uint64_t rolls{0};
+	uint64_t rollNsTotal{0};
+	uint64_t rollNsMax{0};
+	// SocketWriter: bytes it could not deliver, and reconnects after the
+	// first connect.
+	uint64_t sinkDroppedBytes{0};
+	uint64_t sinkReconnects{0};
+	// FlightRecorder files written.
+	uint64_t flightDumps{0};
+	AgeStats handoffAge;
+	AgeStats pickupAge;
+	AgeStats writeAge;
+	// Writer/helper threads whose ThreadPlacement could not be fully applied.
+	uint64_t placementFailures{0};
+
+	uint64_t drops() const;
+	double avgBatch() const { return writerCycles ? double(buffersWritten) / writerCycles : 0.0; }
+	double avgCycleUs() const { return writerCycles ? double(cycleNsTotal) / writerCycles / 1000.0 : 0.0; }
+	double bytesPerWrite() const { return writeCalls ? double(bytesWritten) / writeCalls : 0.0; }
+	double avgRollUs() const { return rolls ? double(rollNsTotal) / rolls / 1000.0 : 0.0; }
+	double avgHandoffNs() const { return handoffs ? double(handoffNsTotal) / handoffs : 0.0; }
+	double wakeupsPerHandoff() const { return handoffs ? double(wakeups) / handoffs : 0.0; }
+};
+
+// Producer-side half of the metrics: hands out one ProducerCounters block per
+// ThreadLogger and sums them on read. The mutex is only taken on thread
+// registration/exit and by readers, never on the logging path.
+class MetricsRegistry
+{
+public:
+	ProducerCounters *registerProducer();
+	void unregisterProducer(ProducerCounters *);
+	void collect(MetricsSnapshot &) const;
+	// Lines dropped by every producer so far, exited ones included.
+	uint64_t drops() const;
+	// Calls f(const ProducerCounters &) for each registered producer, under
+	// the registration mutex.
+	template <typename F>
+	void forEachLive(F &&f) const
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		for (const auto &p : live_)
+			f(*p);
+	}
+
+private:
+	mutable std::mutex mutex_;
+	std::vector<std::unique_ptr<ProducerCounters>> live_;
+	MetricsSnapshot retired_;
+};
+
+// Folds one writer's counters into the snapshot (sums, maxima).
+void collectWriter(const WriterCounters &, MetricsSnapshot &);
+
+// Worst case of formatMetrics(): ~410 bytes of keys plus 42 fields of at most
+// 24 characters each (20-digit counters, averages of them).
+constexpr size_t kMetricsLineMax = 1536;
+
+// Renders the snapshot as a single "metrics: k=v ..." line (with trailing
+// '\n'). Returns the length written. A cap below kMetricsLineMax may cut the
+// line; it still ends in '\n'.
+size_t formatMetrics(const MetricsSnapshot &, char *out, size_t cap);
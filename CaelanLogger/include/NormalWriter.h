@@ -8,6 +8,7 @@ private:
 public:
   using FileUtil<NormalWriter>::FileUtil;
   ~NormalWriter() = default;
-  void append(const char *data, size_t len);
-  void writeDropMessage(char *msg, int len);
+  // span, when given, is recorded in the time index at the batch's offset.
+  void append(const char *data, size_t len, const TimeSpan *span = nullptr);
+  void writeDropMessage(const char *msg, int len);
 };
@@ -0,0 +1,129 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+// Ordered-output framing. In ordered mode every line in a Buffer is preceded
+// by a fixed header: the steady-clock ns at which LogStream started the line,
+// then the length of the line body (including its '\n'). The writer strips
+// the headers while merging, so they never reach the file.
+constexpr size_t kLineStampSize = sizeof(uint64_t) + sizeof(uint32_t);
+
+inline uint64_t lineStampNow()
+{
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+																	 std::chrono::steady_clock::now().time_since_epoch())
+																	 .count());
+}
+
+inline void storeLineStamp(char *at, uint64_t stamp, uint32_t len)
+{
+	std::memcpy(at, &stamp, sizeof(stamp));
+	std::memcpy(at + sizeof(stamp), &len, sizeof(len));
+}
+
+// Calls f(body, len) for each whole stamped line in [data, data + size),
+// headers stripped. A line still being written at the end is skipped.
+template <typename F>
+void forEachStampedLine(const char *data, size_t size, F &&f)
+{
+	const char *pos = data;
+	const char *end = data + size;
+	while (static_cast<size_t>(end - pos) >= kLineStampSize)
+	{
+		uint32_t len;
+		std::memcpy(&len, pos + sizeof(uint64_t), sizeof(len));
+		const char *body = pos + kLineStampSize;
+		if (static_cast<size_t>(end - body) < len)
+			return;
+		f(body, static_cast<size_t>(len));
+		pos = body + len;
+	}
+}
+
+// k-way merge over the stamped buffers drained in one writer cycle. Lines come
+// out in stamp order (ties keep submission order) through a staging area of
+// stagingSize bytes, handed to the sink in as few chunks as possible.
+class OrderedMerger
+{
+public:
+	explicit OrderedMerger(size_t stagingSize)
+			: stagingSize_(stagingSize), staging_(std::make_unique<char[]>(stagingSize)) {}
+
+	void add(const char *data, size_t size)
+	{
+		Cursor c{data, data + size, 0, 0, cursors_.size()};
+		if (load(c))
+			cursors_.push_back(c);
+	}
+
+	// Emits every line added since the last merge, then forgets the inputs.
+	template <typename Sink>
+	void merge(Sink &&sink)
+	{
+		std::make_heap(cursors_.begin(), cursors_.end(), later);
+		size_t used = 0;
+		while (!cursors_.empty())
+		{
+			std::pop_heap(cursors_.begin(), cursors_.end(), later);
+			Cursor &c = cursors_.back();
+			const char *body = c.pos + kLineStampSize;
+
+			if (used + c.len > stagingSize_)
+			{
+				sink(staging_.get(), used);
+				used = 0;
+			}
+			if (c.len > stagingSize_)
+				sink(body, c.len);
+			else
+			{
+				std::memcpy(staging_.get() + used, body, c.len);
+				used += c.len;
+			}
+
+			c.pos = body + c.len;
+			if (load(c))
+				std::push_heap(cursors_.begin(), cursors_.end(), later);
+			else
+				cursors_.pop_back();
+		}
+		if (used > 0)
+			sink(staging_.get(), used);
+	}
+
+private:
+	struct Cursor
+	{
+		const char *pos;
+		const char *end;
+		uint64_t stamp;
+		uint32_t len;
+		size_t order;
+	};
+
+	// Reads the header at c.pos; false once the buffer is exhausted (or holds
+	// a torn trailing header, which is skipped rather than written).
+	static bool load(Cursor &c)
+	{
+		if (static_cast<size_t>(c.end - c.pos) < kLineStampSize)
+			return false;
+		std::memcpy(&c.stamp, c.pos, sizeof(c.stamp));
+		std::memcpy(&c.len, c.pos + sizeof(c.stamp), sizeof(c.len));
+		return static_cast<size_t>(c.end - c.pos) - kLineStampSize >= c.len;
+	}
+
+	// Heap comparator: std heaps are max-heaps, so "later" puts the earliest
+	// line on top.
+	static bool later(const Cursor &a, const Cursor &b)
+	{
+		return a.stamp != b.stamp ? a.stamp > b.stamp : a.order > b.order;
+	}
+
+	size_t stagingSize_;
+	std::unique_ptr<char[]> staging_;
+	std::vector<Cursor> cursors_;
+};
@@ -0,0 +1,29 @@
+#pragma once
+#include <shared_mutex>
+#include "FileUtil.h"
+
+// FileUtil writer that several writer threads may call append() on at once.
+// Each call reserves its byte range with an atomic fetch_add on offset_ and
+// issues pwrite(), so writes into the same segment proceed in parallel. A roll
+// takes rollMutex_ exclusively, which waits out every in-flight pwrite and
+// makes all writer threads cut over to the new segment together.
+class PwriteWriter : public FileUtil<PwriteWriter>
+{
+public:
+  static constexpr bool kConcurrentAppend = true;
+
+  explicit PwriteWriter(std::string dir = "./log", std::string prefix = "caelogger");
+  ~PwriteWriter() = default;
+  void append(const char *data, size_t len, const TimeSpan *span = nullptr);
+  void writeDropMessage(const char *msg, int len);
+  void roll();
+  // Under the shared lock, so records never cross a roll into the next sidecar.
+  void flushIndex();
+
+private:
+  std::shared_mutex rollMutex_;
+  std::atomic<uint64_t> offset_{0};
+
+  void writeAt(const char *data, size_t len, uint64_t off);
+  void rollLocked();
+};
@@ -89,6 +89,8 @@ public:
   const T &Front() const { return this->ringBuffer_[tail_.load(std::memory_order_relaxed) & this->mask_]; }
   bool isFull() const { return head_.load(std::memory_order_relaxed) - tail_.load(std::memory_order_relaxed) == this->capacity_; }
   bool isEmpty() const { return head_.load(std::memory_order_relaxed) == tail_.load(std::memory_order_relaxed); }
+  // Approximate when read concurrently with push/pop; meant for metrics only.
+  size_t size() const { return head_.load(std::memory_order_relaxed) - tail_.load(std::memory_order_relaxed); }
   void reset()
   {
     head_.store(0, std::memory_order_relaxed);
@@ -0,0 +1,81 @@
+#pragma once
+#include <atomic>
+#include <optional>
+#include "RingBuffer.h"
+
+// Wait-free single-producer/single-consumer ring. head_ is only written by
+// the producer and tail_ only by the consumer, so neither side needs a lock
+// or an RMW. Each side keeps a private copy of the other's index and only
+// re-reads the shared one when the copy says full/empty, so in steady state a
+// push touches no cache line the consumer is writing, and vice versa.
+template <typename T>
+class SPSCQueue : public ConcurrentRingBuffer<SPSCQueue<T>, T>
+{
+public:
+  using Base = ConcurrentRingBuffer<SPSCQueue<T>, T>;
+
+  explicit SPSCQueue(size_t bufferSize) : Base(bufferSize) {}
+
+  bool pushImpl(T &&elem);
+  bool pushImpl(const T &elem);
+  std::optional<T> popImpl();
+
+private:
+  // Producer-side copy of tail_, consumer-side copy of head_.
+  alignas(kCacheLine) size_t cachedTail_{0};
+  alignas(kCacheLine) size_t cachedHead_{0};
+
+  bool reserve(size_t h);
+};
+
+template <typename T>
+bool SPSCQueue<T>::reserve(size_t h)
+{
+  if (h - cachedTail_ < this->capacity_)
+    return true;
+  cachedTail_ = this->tail_.load(std::memory_order_acquire);
+  return h - cachedTail_ < this->capacity_;
+}
+
+template <typename T>
+bool SPSCQueue<T>::pushImpl(T &&elem)
+{
+  size_t h = this->head_.load(std::memory_order_relaxed);
+  if (!reserve(h))
+  {
+    return false;
+  }
+  this->ringBuffer_[h & this->mask_] = std::move(elem);
+  this->head_.store(h + 1, std::memory_order_release);
+  return true;
+}
+
+template <typename T>
+bool SPSCQueue<T>::pushImpl(const T &elem)
+{
+  size_t h = this->head_.load(std::memory_order_relaxed);
+  if (!reserve(h))
+  {
+    return false;
+  }
+  this->ringBuffer_[h & this->mask_] = elem;
+  this->head_.store(h + 1, std::memory_order_release);
+  return true;
+}
+
+template <typename T>
+std::optional<T> SPSCQueue<T>::popImpl()
+{
+  size_t t = this->tail_.load(std::memory_order_relaxed);
+  if (cachedHead_ == t)
+  {
+    cachedHead_ = this->head_.load(std::memory_order_acquire);
+    if (cachedHead_ == t)
+    {
+      return std::nullopt;
+    }
+  }
+  T res = std::move(this->ringBuffer_[t & this->mask_]);
+  this->tail_.store(t + 1, std::memory_order_release);
+  return res;
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ThreadPlacement.h"
+
+struct PreparedSegment
+{
+	int fd{-1};
+	// Its time-index sidecar when the preparer was built withIndex, else -1.
+	int idxFd{-1};
+};
+
+// Background helper for FileUtil rolling. It keeps the next segment opened
+// and fallocate()d ahead of time, and trims/closes retired segments, so the
+// roll on the writer thread is an fd swap plus a rename() instead of
+// close + mkdir + open.
+class SegmentPreparer
+{
+public:
+	// Segments are prepared under a hidden placeholder name in dir. nextPath
+	// is called by take(), on the caller's thread, to name each one when it
+	// is rolled into, so the name carries the roll time.
+	SegmentPreparer(std::string dir, std::function<std::string()> nextPath, int openFlags,
+									size_t preallocBytes, bool withIndex = false, ThreadPlacement placement = {});
+	~SegmentPreparer();
+
+	SegmentPreparer(const SegmentPreparer &) = delete;
+	SegmentPreparer &operator=(const SegmentPreparer &) = delete;
+
+	// Renames the prepared segment to nextPath(), hands out its fds and starts
+	// preparing the next one. fd is -1 if the helper has not caught up yet or
+	// the rename failed; the caller then opens inline.
+	PreparedSegment take();
+	// Queues a finished segment to be truncated to its size and closed.
+	void retire(int fd);
+	// New open(2) flags for the segments prepared from now on. A segment
+	// already waiting in take() gets the file status flags (e.g. O_DIRECT)
+	// changed to match, so a writer that changed its flags never rolls into
+	// a segment opened with the old ones.
+	void setOpenFlags(int flags);
+	// applyThreadPlacement()'s result on the helper thread (0: all applied).
+	int placementError() const { return placementError_.load(std::memory_order_relaxed); }
+
+private:
+	std::string dir_;
+	std::function<std::string()> nextPath_;
+	int openFlags_;
+	size_t preallocBytes_;
+	bool withIndex_;
+	ThreadPlacement placement_;
+	std::atomic<int> placementError_{0};
+
+	std::mutex mutex_;
+	std::condition_variable cv_;
+	PreparedSegment ready_;
+	std::string readyPath_;
+	std::vector<int> retired_;
+	bool stop_{false};
+	std::thread thread_;
+
+	void run();
+	std::string placeholderPath();
+	static void trimAndClose(int fd);
+	static void matchStatusFlags(int fd, int flags);
+};
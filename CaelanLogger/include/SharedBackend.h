@@ -4,37 +4,1037 @@
 #include <mutex>
 #include <ThreadLogger.h>
 #include <memory>
+#include <string>
 #include <thread>
-#include "NormalWriter.h"
+#include <utility>
+#include <vector>
+#include <algorithm>
 #include "Buffer.h"
-#include "MPSCSpinLockQueue.h"
-#include "SPMCSpinLockQueue.h"
+#include "SPSCQueue.h"
+#include "BackendConfig.h"
+#include "BackendPolicies.h"
+#include "Metrics.h"
+#include "OrderedMerge.h"
+#include "LinePattern.h"
+#include "WriterExecutor.h"
 
-class SharedBackend
+// One producer's submission ring (cfg.perProducerRings). Only the owning
+// ThreadLogger pushes and only the writer pops. Rings are never freed while
+// the backend runs: a ring whose owner exited is drained by the writer and
+// then handed to the next thread that registers.
+struct alignas(kCacheLine) SubmitRing
+{
+	enum State : uint8_t
+	{
+		kFree,
+		kOwned,
+		kClosed, // owner is gone, writer still has to drain it
+	};
+	explicit SubmitRing(size_t capacity) : queue(capacity) {}
+	SPSCQueue<size_t> queue;
+	std::atomic<uint8_t> state{kFree};
+};
+
+// The buffer pool, submission queues and writer thread(s) behind AsyncLogger.
+// The queue, writer, clock and full-pool behaviour are template policies (see
+// BackendPolicies.h); BackendConfig holds what stays a runtime choice.
+template <typename QueuePolicy = SpinLockQueues, typename WriterPolicy = ConfiguredWriter,
+					typename ClockPolicy = RealtimeClock, typename OverflowPolicy = DropWhenFull>
+class BasicSharedBackend
 {
 public:
+	static constexpr size_t kMaxRings = 256;
+	// Large-record buffers for lines bigger than a pool buffer. They sit in
+	// bufferPool_ after the regular slots and share the submitted queue, so
+	// a large line stays in order with the rest of its thread's output.
+	static constexpr size_t kOverflowSlots = 4;
+	// Longest a parked writer goes without checking for a flight-recorder
+	// signal (cfg.flightRecorderSignal).
+	static constexpr std::chrono::milliseconds kSignalPoll{100};
+	using Ring = SubmitRing;
+	// LogStream stamps lines with Clock::nowNanos().
+	using Clock = ClockPolicy;
+	static constexpr bool kWaitForBuffers = OverflowPolicy::kWait;
+
 	std::atomic<bool> running_{false};
-	SharedBackend(size_t bufSize, size_t queueSize, std::string dir = "./log");
-	~SharedBackend();
+	BasicSharedBackend(size_t bufSize, size_t queueSize, std::string dir = "./log", BackendConfig cfg = {});
+	~BasicSharedBackend();
 
+	// A free pool buffer, or nullptr when the pool is empty. With WaitWhenFull
+	// it yields until one comes back (or the backend stops).
 	std::unique_ptr<Buffer> acquire();
-	void submit(std::unique_ptr<Buffer>);
-	void record_drop();
+	// Never waits, whatever the policy.
+	std::unique_ptr<Buffer> tryAcquire();
+	// An overflow buffer with room for bytes, capped at cfg.maxRecordSize, or
+	// nullptr if none is free.
+	std::unique_ptr<Buffer> acquireOverflow(size_t bytes);
+	// Grows an overflow buffer in place, capped at cfg.maxRecordSize. False
+	// once it is already that large.
+	bool growOverflow(Buffer &, size_t bytes);
+	// ring: the caller's own ring from registerRing(), or nullptr for the
+	// shared queue.
+	void submit(std::unique_ptr<Buffer>, SubmitRing *ring = nullptr);
+	// Lines at this level or above end with submitUrgent() (cfg.urgentHandoff,
+	// or a flight recorder, which dumps on them).
+	int urgentLevel() const { return cfg_.urgentHandoff || cfg_.flightRecorder > 0 ? CaelanLogger::ERROR : CaelanLogger::FATAL + 1; }
+	// submit() for a buffer that ends in an urgent line. Returns a ticket for
+	// awaitWritten().
+	uint64_t submitUrgent(std::unique_ptr<Buffer>, SubmitRing *ring = nullptr);
+	// Waits up to cfg.fatalWait for the urgent buffer in slot idx to be
+	// written (and synced). False on timeout.
+	bool awaitWritten(size_t idx, uint64_t ticket) const;
+	// Bumped after every writer cycle that returned pool buffers; see
+	// ThreadLogger::acquire().
+	uint64_t freeGeneration() const { return freeGen_.load(std::memory_order_acquire); }
 
+	// nullptr when rings are off or all kMaxRings are owned.
+	SubmitRing *registerRing();
+	// Called after the owner's last submit().
+	void unregisterRing(SubmitRing *);
+
+	ProducerCounters *registerProducer() { return producers_.registerProducer(); }
+	void unregisterProducer(ProducerCounters *c) { producers_.unregisterProducer(c); }
+	MetricsSnapshot metrics() const;
+	bool orderedOutput() const { return cfg_.orderedOutput; }
+	const LinePattern &linePattern() const { return pattern_; }
+	const std::string &loggerName() const { return cfg_.loggerName; }
+	// Producers publish their unfinished buffers for flight-recorder dumps.
+	bool capturesPartials() const { return cfg_.flightRecorder > 0; }
+	// Asks the writer for a flight-recorder dump after its current cycle. A
+	// no-op without cfg.flightRecorder.
+	void dumpFlightRecorder();
 
 private:
 	friend class BackendLoggerTestAccess;
+	using SubmittedQueue = typename QueuePolicy::template Submitted<size_t>;
+	using FreeQueue = typename QueuePolicy::template Free<size_t>;
+
 	std::thread writer_;
+	std::vector<std::thread> ioPool_;
 	std::mutex cvMutex_;
 	std::condition_variable cv_;
 	std::unique_ptr<std::unique_ptr<Buffer>[]> bufferPool_;
 	size_t poolCapacity_{0};
-	std::unique_ptr<MPSCSpinLockQueue<size_t>> submittedIdxes_;
-	std::unique_ptr<SPMCSpinLockQueue<size_t>> freeIdxes_;
-	std::unique_ptr<NormalWriter> futil_;
+	std::unique_ptr<SubmittedQueue> submittedIdxes_;
+	std::unique_ptr<FreeQueue> freeIdxes_;
+	std::unique_ptr<FreeQueue> overflowFree_;
+	// Free pool buffers without resident storage (lazyBuffers, idleRelease).
+	// Producers only take one when freeIdxes_ is empty.
+	std::unique_ptr<FreeQueue> coldIdxes_;
+	// steady_clock ns at which each pool buffer last went back to freeIdxes_;
+	// allocated only with cfg.idleRelease.
+	std::unique_ptr<int64_t[]> freedNs_;
+	int64_t nextSweepNs_{0};
+	std::atomic<size_t> residentBuffers_{0};
+	std::atomic<uint64_t> idleReleases_{0};
+	// Read by every producer that finds the pool empty, written once per
+	// cycle; kept off the lines the writer updates per buffer.
+	alignas(kCacheLine) std::atomic<uint64_t> freeGen_{0};
+	// Producer drops already handed to the writer's "dropped: N" count.
+	// Slot 0 (or stop()) syncs them; producers never touch a shared counter.
+	alignas(kCacheLine) uint64_t dropsReported_{0};
+	// Urgent buffers submitted but not yet written; while non-zero a writer
+	// cycle ignores batchLimit_. Tickets come from urgentSeq_, and
+	// writtenSeq_[idx] holds the highest ticket written from slot idx.
+	std::atomic<size_t> urgentPending_{0};
+	std::atomic<uint64_t> urgentSeq_{0};
+	std::unique_ptr<std::atomic<uint64_t>[]> writtenSeq_;
+	// Serializes pops from submittedIdxes_ between pool writers; the queue
+	// itself is single-consumer.
+	std::atomic_flag popLock_ = ATOMIC_FLAG_INIT;
+	// Writers currently blocked (or about to block) on cv_. Producers skip the
+	// notify while it is 0; see wakeWriter().
+	std::atomic<size_t> parked_{0};
+	std::atomic<uint64_t> wakeups_{0};
+	std::atomic<uint64_t> placementFailures_{0};
+	// Slots [0, ringSlots_) hold rings; a slot is set once and kept until
+	// destruction, so the writer scans them without a lock.
+	std::unique_ptr<std::atomic<SubmitRing *>[]> rings_;
+	std::atomic<size_t> ringSlots_{0};
+	std::atomic<size_t> liveRings_{0};
+	std::mutex ringMutex_;
+	// Writer-side round-robin position; pool writers hold popLock_.
+	size_t ringCursor_{0};
+	size_t writerCount_{1};
+	size_t batchLimit_{0};
+	BackendConfig cfg_;
+	LinePattern pattern_;
+	WriterHolder<WriterPolicy> out_;
+	MetricsRegistry producers_;
+	std::unique_ptr<WriterCounters[]> writerStats_;
+	std::chrono::steady_clock::time_point lastReport_;
+	std::unique_ptr<OrderedMerger> merger_;
+	// %i dictionary: registry ids up to callsitesWritten_ are in the writer's
+	// .callsites file. The mutex orders pool writers' appends.
+	const bool callsiteIds_;
+	std::mutex callsiteMutex_;
+	std::atomic<size_t> callsitesWritten_{0};
+	// Flight-recorder triggers. dumpFlightRecorder() bumps dumpRequests_;
+	// only the (single) writer stores the served counts and urgentDump_, but
+	// executor threads read them through dumpPending().
+	std::atomic<uint64_t> dumpRequests_{0};
+	std::atomic<uint64_t> dumpsServed_{0};
+	std::atomic<uint64_t> signalsServed_{0};
+	std::atomic<bool> urgentDump_{false};
+
+	// This backend as cfg.executor's task; set while registered.
+	struct ExecutorTask final : WriterTask
+	{
+		explicit ExecutorTask(BasicSharedBackend *b) : backend(b) {}
+		bool pending() const override { return backend->hasWork() || backend->dumpPending(); }
+		void serve() override
+		{
+			backend->write(0);
+			backend->housekeeping();
+		}
+		std::chrono::milliseconds idleTimeout() const override { return backend->idleTimeout(); }
+		BasicSharedBackend *backend;
+	};
+	std::unique_ptr<ExecutorTask> task_;
 
-	void write();
+	// Calls f with the writer; a branch only under ConfiguredWriter.
+	template <typename F>
+	decltype(auto) withWriter(F &&f) { return out_.visit(std::forward<F>(f)); }
+	template <typename F>
+	decltype(auto) withWriter(F &&f) const { return out_.visit(std::forward<F>(f)); }
+
+	std::optional<size_t> popSubmitted();
+	std::optional<size_t> popAny();
+	bool hasWork() const;
+	size_t pendingCount() const;
+	void appendOut(const char *data, size_t len, const TimeSpan *span = nullptr);
+	void write(size_t slot);
+	void writeCallsites();
+	void reportMetrics();
+	void releaseIdle();
+	void syncDrops();
+	bool dumpPending() const;
+	void serveDumps();
 	void start();
-	void run();
+	void run(size_t slot);
+	// Slot 0's periodic duties after a cycle.
+	void housekeeping();
+	// How long slot 0 may park before housekeeping() is due; 0 for no limit.
+	std::chrono::milliseconds idleTimeout() const;
+	// Writes what is still queued once running_ is false.
+	void drain(size_t slot);
+	bool spinForWork(size_t slot);
+	void park(size_t slot);
+	void wakeWriter();
 	void stop();
 };
+
+template <typename QueuePolicy, typename WriterPolicy, typename ClockPolicy, typename OverflowPolicy>
+BasicSharedBackend<QueuePolicy, WriterPolicy, ClockPolicy, OverflowPolicy>::BasicSharedBackend(size_t bufSize, size_t poolCapacity, std::string dir, BackendConfig cfg)
+		: bufferPool_(std::make_unique<std::unique_ptr<Buffer>[]>(poolCapacity + kOverflowSlots)),
+			poolCapacity_(poolCapacity),
+			submittedIdxes_(std::make_unique<SubmittedQueue>(poolCapacity + kOverflowSlots)),
+			freeIdxes_(std::make_unique<FreeQueue>(poolCapacity)),
+			overflowFree_(std::make_unique<FreeQueue>(kOverflowSlots)),
+			writtenSeq_(std::make_unique<std::atomic<uint64_t>[]>(poolCapacity + kOverflowSlots)),
+			writerCount_(WriterHolder<WriterPolicy>::writerCount(cfg)),
+			cfg_(cfg),
+			pattern_(cfg.linePattern.empty() ? LinePattern::kDefault : cfg.linePattern),
+			out_(dir, writerCount_, cfg),
+			writerStats_(std::make_unique<WriterCounters[]>(writerCount_)),
+			callsiteIds_(pattern_.usesCallsiteIds())
+{
+	// A line that fits a pool buffer is never cut, and spill() relies on an
+	// overflow buffer holding at least what a pool buffer can.
+	cfg_.maxRecordSize = std::max(cfg_.maxRecordSize, bufSize);
+	// With a pool, split a backlog across the writers instead of letting the
+	// first one to wake up take all of it.
+	batchLimit_ = writerCount_ > 1 ? std::max<size_t>(1, poolCapacity / writerCount_) : poolCapacity;
+	withWriter([this](auto &w)
+						 {
+		w.setMaxFileSize(cfg_.maxFileSize);
+		if (cfg_.timeIndex)
+			w.enableTimeIndex();
+		if (cfg_.preallocateSegments)
+		{
+			w.setHelperPlacement(cfg_.helperPlacement);
+			w.enablePreallocation();
+		} });
+
+	if (cfg_.orderedOutput)
+		merger_ = std::make_unique<OrderedMerger>(bufSize);
+	if (cfg_.perProducerRings)
+		rings_ = std::make_unique<std::atomic<SubmitRing *>[]>(kMaxRings);
+
+	if (cfg_.lazyBuffers || cfg_.idleRelease.count() > 0)
+		coldIdxes_ = std::make_unique<FreeQueue>(poolCapacity);
+	if (cfg_.idleRelease.count() > 0)
+		freedNs_ = std::make_unique<int64_t[]>(poolCapacity);
+	const int64_t now = LogTime::steadyNanos();
+	for (size_t i = 0; i < poolCapacity_; i++)
+	{
+		bufferPool_[i] = std::make_unique<Buffer>(bufSize, !cfg_.lazyBuffers);
+		bufferPool_[i]->setIdx(i);
+		if (freedNs_)
+			freedNs_[i] = now;
+		if (cfg_.lazyBuffers)
+			coldIdxes_->push(i);
+		else
+			freeIdxes_->push(i);
+	}
+	residentBuffers_.store(cfg_.lazyBuffers ? 0 : poolCapacity_, std::memory_order_relaxed);
+	// Allocated small; sized on first use by acquireOverflow().
+	for (size_t i = poolCapacity_; i < poolCapacity_ + kOverflowSlots; i++)
+	{
+		bufferPool_[i] = std::make_unique<Buffer>(kBufferAlign);
+		bufferPool_[i]->setIdx(i);
+		overflowFree_->push(i);
+	}
+
+	start();
+}
+
+template <typename QueuePolicy, typename WriterPolicy, typename ClockPolicy, typename OverflowPolicy>
+BasicSharedBackend<QueuePolicy, WriterPolicy, ClockPolicy, OverflowPolicy>::~BasicSharedBackend()
+{
+	stop();
+	if (rings_)
+		for (size_t i = 0; i < ringSlots_.load(std::memory_order_relaxed); i++)
+			delete rings_[i].load(std::memory_order_relaxed);
+}
+
+template <typename QueuePolicy, typename WriterPolicy, typename ClockPolicy, typename OverflowPolicy>
+void BasicSharedBackend<QueuePolicy, WriterPolicy, ClockPolicy, OverflowPolicy>::stop()
+{
+	// add lock to prevent notify loss
+	/*
+	Writer: pred() → false（running_=true）← still holding lock
+																				stop(): running_=false（write, since no lock）
+																				stop(): notify_all()  ← Writer is not in wait，loss the notify！
+	Writer: unlock + enter wait              ← block forever
+	*/
+	{
+		std::lock_guard<std::mutex> lock(cvMutex_);
+		bool expected = true;
+		if (!running_.compare_exchange_strong(expected, false, std::memory_order_acq_rel))
+		{
+			return; // already stopped
+		}
+	}
+
+	cv_.notify_all();
+	if (task_)
+	{
+		cfg_.executor->unregisterTask(task_.get());
+		drain(0);
+	}
+	if (writer_.joinable())
+		writer_.join();
+	for (auto &t : ioPool_)
+		t.join();
+	ioPool_.clear();
+
+	syncDrops();
+	withWriter([](auto &w)
+						 { w.roll(); });
+}
+
+template <typename QueuePolicy, typename WriterPolicy, typename ClockPolicy, typename OverflowPolicy>
+void BasicSharedBackend<QueuePolicy, WriterPolicy, ClockPolicy, OverflowPolicy>::start()
+{
+	bool expected = false;
+	if (!running_.compare_exchange_strong(expected, true, std::memory_order_acq_rel))
+	{
+		return; // already running_
+	}
+	lastReport_ = std::chrono::steady_clock::now();
+	if (cfg_.flightRecorder > 0 && cfg_.flightRecorderSignal > 0)
+	{
+		signalsServed_.store(flightRecorderSignals(), std::memory_order_release);
+		installFlightRecorderSignal(cfg_.flightRecorderSignal);
+	}
+	if (cfg_.executor)
+	{
+		task_ = std::make_unique<ExecutorTask>(this);
+		cfg_.executor->registerTask(task_.get());
+		return;
+	}
+	writer_ = std::thread(&BasicSharedBackend::run, this, 0);
+	for (size_t slot = 1; slot < writerCount_; slot++)
+		ioPool_.emplace_back(&BasicSharedBackend::run, this, slot);
+}
+
+template <typename QueuePolicy, typename WriterPolicy, typename ClockPolicy, typename OverflowPolicy>
+void BasicSharedBackend<QueuePolicy, WriterPolicy, ClockPolicy, OverflowPolicy>::run(size_t slot)
+{
+	ThreadPlacement placement = cfg_.writerPlacement;
+	if (placement.name.empty())
+		placement.name = "cae-writer";
+	if (slot > 0)
+		placement.name += "-" + std::to_string(slot);
+	if (applyThreadPlacement(placement, placement.name) != 0)
+		placementFailures_.fetch_add(1, std::memory_order_relaxed);
+
+	while (true)
+	{
+		if (!spinForWork(slot))
+			park(slot);
+		if (!running_.load(std::memory_order_acquire) && !hasWork())
+			break;
+		write(slot);
+		if (slot == 0)
+			housekeeping();
+	}
+	drain(slot);
+}
+
+template <typename QueuePolicy, typename WriterPolicy, typename ClockPolicy, typename OverflowPolicy>
+void BasicSharedBackend<QueuePolicy, WriterPolicy, ClockPolicy, OverflowPolicy>::housekeeping()
+{
+	syncDrops();
+	if (cfg_.metricsInterval.count() > 0 &&
+			std::chrono::steady_clock::now() - lastReport_ >= cfg_.metricsInterval)
+		reportMetrics();
+	if (freedNs_)
+		releaseIdle();
+	if (cfg_.flightRecorder > 0)
+		serveDumps();
+}
+
+template <typename QueuePolicy, typename WriterPolicy, typename ClockPolicy, typename OverflowPolicy>
+void BasicSharedBackend<QueuePolicy, WriterPolicy, ClockPolicy, OverflowPolicy>::drain(size_t slot)
+{
+	while (hasWork())
+		write(slot);
+	if (slot == 0 && cfg_.flightRecorder > 0)
+		serveDumps();
+}
+
+template <typename QueuePolicy, typename WriterPolicy, typename ClockPolicy, typename OverflowPolicy>
+std::chrono::milliseconds BasicSharedBackend<QueuePolicy, WriterPolicy, ClockPolicy, OverflowPolicy>::idleTimeout() const
+{
+	// Wake up for the idle-buffer sweep only while there are warm free
+	// buffers left to release.
+	auto timeout = cfg_.metricsInterval;
+	if (freedNs_ && freeIdxes_->size() > 0 &&
+			(timeout.count() == 0 || cfg_.idleRelease < timeout))
+		timeout = cfg_.idleRelease;
+	// A signal handler cannot notify; poll for its trigger instead.
+	if (cfg_.flightRecorder > 0 && cfg_.flightRecorderSignal > 0 &&
+			(timeout.count() == 0 || timeout > kSignalPoll))
+		timeout = kSignalPoll;
+	return timeout;
+}
+
+// Spins for up to cfg.writerSpin (indefinitely with writerBusyPoll) waiting for
+// a submit. Returns false when the writer should park instead.
+template <typename QueuePolicy, typename WriterPolicy, typename ClockPolicy, typename OverflowPolicy>
+bool BasicSharedBackend<QueuePolicy, WriterPolicy, ClockPolicy, OverflowPolicy>::spinForWork(size_t slot)
+{
+	if (!cfg_.writerBusyPoll && cfg_.writerSpin.count() == 0)
+		return false;
+
+	auto deadline = std::chrono::steady_clock::now() + cfg_.writerSpin;
+	for (unsigned n = 1;; n++)
+	{
+		if (hasWork() || !running_.load(std::memory_order_acquire) || dumpPending())
+			return true;
+		// Reading the clock every pass would dominate the loop.
+		if (n % 64 == 0)
+		{
+			auto now = std::chrono::steady_clock::now();
+			if (!cfg_.writerBusyPoll && now >= deadline)
+				return false;
+			// Give run() a chance at the periodic metrics line (slot 0's job).
+			if (slot == 0 && cfg_.metricsInterval.count() > 0 && now - lastReport_ >= cfg_.metricsInterval)
+				return true;
+			// Likewise for the idle-buffer sweep.
+			if (slot == 0 && freedNs_ && LogTime::steadyNanos() >= nextSweepNs_)
+				return true;
+		}
+		cpuRelax();
+	}
+}
+
+// parked_ is raised before the queue is re-checked, and producers check it
+// after their push, each with a seq_cst fence in between: either the writer
+// sees the buffer or the producer sees the writer parked and notifies.
+template <typename QueuePolicy, typename WriterPolicy, typename ClockPolicy, typename OverflowPolicy>
+void BasicSharedBackend<QueuePolicy, WriterPolicy, ClockPolicy, OverflowPolicy>::park(size_t slot)
+{
+	std::unique_lock<std::mutex> lock(cvMutex_);
+	parked_.fetch_add(1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	auto predicate = [this]
+	{
+		return hasWork() || !running_.load(std::memory_order_acquire) || dumpPending();
+	};
+	if (!predicate())
+	{
+		bump(writerStats_[slot].parks);
+		auto timeout = slot == 0 ? idleTimeout() : cfg_.metricsInterval;
+		if (timeout.count() > 0)
+			cv_.wait_for(lock, timeout, predicate);
+		else
+			cv_.wait(lock, predicate);
+	}
+	parked_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+// Taking cvMutex_ before notifying closes the window between a writer's last
+// predicate check and its wait; it is only paid when a writer is parked.
+template <typename QueuePolicy, typename WriterPolicy, typename ClockPolicy, typename OverflowPolicy>
+void BasicSharedBackend<QueuePolicy, WriterPolicy, ClockPolicy, OverflowPolicy>::wakeWriter()
+{
+	if (task_)
+	{
+		if (cfg_.executor->notify())
+			wakeups_.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (parked_.load(std::memory_order_relaxed) == 0)
+		return;
+	{
+		std::lock_guard<std::mutex> lock(cvMutex_);
+	}
+	wakeups_.fetch_add(1, std::memory_order_relaxed);
+	cv_.notify_one();
+}
+
+template <typename QueuePolicy, typename WriterPolicy, typename ClockPolicy, typename OverflowPolicy>
+void BasicSharedBackend<QueuePolicy, WriterPolicy, ClockPolicy, OverflowPolicy>::submit(std::unique_ptr<Buffer> lastBuffer, SubmitRing *ring)
+{
+	if (!lastBuffer)
+	{
+		return;
+	}
+
+	if (lastBuffer->firstNs())
+		lastBuffer->setHandoffNs(ClockPolicy::nowNanos());
+	size_t idxIn = lastBuffer->idx();
+	bufferPool_[idxIn] = std::move(lastBuffer);
+	// Both hold every slot, overflow included, so neither push can fail.
+	if (ring)
+		ring->queue.push(idxIn);
+	else
+		submittedIdxes_->push(idxIn);
+	wakeWriter();
+}
+
+template <typename QueuePolicy, typename WriterPolicy, typename ClockPolicy, typename OverflowPolicy>
+uint64_t BasicSharedBackend<QueuePolicy, WriterPolicy, ClockPolicy, OverflowPolicy>::submitUrgent(std::unique_ptr<Buffer> buf, SubmitRing *ring)
+{
+	if (!buf)
+		return 0;
+	uint64_t ticket = urgentSeq_.fetch_add(1, std::memory_order_relaxed) + 1;
+	buf->setUrgentSeq(ticket);
+	urgentPending_.fetch_add(1, std::memory_order_relaxed);
+	submit(std::move(buf), ring);
+	return ticket;
+}
+
+template <typename QueuePolicy, typename WriterPolicy, typename ClockPolicy, typename OverflowPolicy>
+bool BasicSharedBackend<QueuePolicy, WriterPolicy, ClockPolicy, OverflowPolicy>::awaitWritten(size_t idx, uint64_t ticket) const
+{
+	if (cfg_.fatalWait.count() == 0 || ticket == 0)
+		return false;
+	auto deadline = std::chrono::steady_clock::now() + cfg_.fatalWait;
+	while (writtenSeq_[idx].load(std::memory_order_acquire) < ticket)
+	{
+		if (std::chrono::steady_clock::now() >= deadline)
+			return false;
+		std::this_thread::sleep_for(std::chrono::microseconds(50));
+	}
+	return true;
+}
+
+template <typename QueuePolicy, typename WriterPolicy, typename ClockPolicy, typename OverflowPolicy>
+SubmitRing *BasicSharedBackend<QueuePolicy, WriterPolicy, ClockPolicy, OverflowPolicy>::registerRing()
+{
+	if (!rings_)
+		return nullptr;
+
+	std::lock_guard<std::mutex> lock(ringMutex_);
+	size_t slots = ringSlots_.load(std::memory_order_relaxed);
+	for (size_t i = 0; i < slots; i++)
+	{
+		SubmitRing *ring = rings_[i].load(std::memory_order_relaxed);
+		// Acquire pairs with the writer's release once the ring is drained.
+		if (ring->state.load(std::memory_order_acquire) == SubmitRing::kFree)
+		{
+			ring->state.store(SubmitRing::kOwned, std::memory_order_relaxed);
+			liveRings_.fetch_add(1, std::memory_order_relaxed);
+			return ring;
+		}
+	}
+	if (slots == kMaxRings)
+		return nullptr;
+
+	auto *ring = new SubmitRing(poolCapacity_ + kOverflowSlots);
+	ring->state.store(SubmitRing::kOwned, std::memory_order_relaxed);
+	rings_[slots].store(ring, std::memory_order_release);
+	ringSlots_.store(slots + 1, std::memory_order_release);
+	liveRings_.fetch_add(1, std::memory_order_relaxed);
+	return ring;
+}
+
+template <typename QueuePolicy, typename WriterPolicy, typename ClockPolicy, typename OverflowPolicy>
+void BasicSharedBackend<QueuePolicy, WriterPolicy, ClockPolicy, OverflowPolicy>::unregisterRing(SubmitRing *ring)
+{
+	if (ring)
+		ring->state.store(SubmitRing::kClosed, std::memory_order_release);
+}
+
+template <typename QueuePolicy, typename WriterPolicy, typename ClockPolicy, typename OverflowPolicy>
+std::unique_ptr<Buffer> BasicSharedBackend<QueuePolicy, WriterPolicy, ClockPolicy, OverflowPolicy>::acquire()
+{
+	if constexpr (OverflowPolicy::kWait)
+	{
+		while (running_.load(std::memory_order_acquire))
+		{
+			if (auto buf = tryAcquire())
+				return buf;
+			std::this_thread::yield();
+		}
+	}
+	return tryAcquire();
+}
+
+template <typename QueuePolicy, typename WriterPolicy, typename ClockPolicy, typename OverflowPolicy>
+std::unique_ptr<Buffer> BasicSharedBackend<QueuePolicy, WriterPolicy, ClockPolicy, OverflowPolicy>::tryAcquire()
+{
+	auto maybeIdx = freeIdxes_->pop();
+	if (!maybeIdx.has_value() && coldIdxes_)
+		maybeIdx = coldIdxes_->pop();
+	if (!maybeIdx.has_value())
+	{
+		return nullptr;
+	}
+	size_t idxOut = *maybeIdx;
+
+	std::unique_ptr<Buffer> buf = std::move(bufferPool_[idxOut]);
+	if (!buf->resident())
+	{
+		buf->materialize();
+		residentBuffers_.fetch_add(1, std::memory_order_relaxed);
+	}
+	return buf;
+}
+
+template <typename QueuePolicy, typename WriterPolicy, typename ClockPolicy, typename OverflowPolicy>
+std::unique_ptr<Buffer> BasicSharedBackend<QueuePolicy, WriterPolicy, ClockPolicy, OverflowPolicy>::acquireOverflow(size_t bytes)
+{
+	auto maybeIdx = overflowFree_->pop();
+	if (!maybeIdx.has_value())
+		return nullptr;
+	std::unique_ptr<Buffer> buf = std::move(bufferPool_[*maybeIdx]);
+	// The caller fills what fits; the line is cut at maxRecordSize.
+	buf->reserve(std::min(bytes, cfg_.maxRecordSize));
+	return buf;
+}
+
+template <typename QueuePolicy, typename WriterPolicy, typename ClockPolicy, typename OverflowPolicy>
+bool BasicSharedBackend<QueuePolicy, WriterPolicy, ClockPolicy, OverflowPolicy>::growOverflow(Buffer &buf, size_t bytes)
+{
+	if (buf.capacity() >= cfg_.maxRecordSize)
+		return false;
+	// Doubling keeps a line that grows piece by piece from copying itself
+	// on every append.
+	buf.reserve(std::min(cfg_.maxRecordSize, std::max(bytes, 2 * buf.capacity())));
+	return true;
+}
+
+template <typename QueuePolicy, typename WriterPolicy, typename ClockPolicy, typename OverflowPolicy>
+std::optional<size_t> BasicSharedBackend<QueuePolicy, WriterPolicy, ClockPolicy, OverflowPolicy>::popSubmitted()
+{
+	if (writerCount_ == 1)
+		return popAny();
+
+	SpinGuard guard(popLock_);
+	return popAny();
+}
+
+// One index from the next non-empty ring after the last one served, else from
+// the shared queue. Closed rings found empty are returned to the free list.
+template <typename QueuePolicy, typename WriterPolicy, typename ClockPolicy, typename OverflowPolicy>
+std::optional<size_t> BasicSharedBackend<QueuePolicy, WriterPolicy, ClockPolicy, OverflowPolicy>::popAny()
+{
+	size_t slots = rings_ ? ringSlots_.load(std::memory_order_acquire) : 0;
+	for (size_t n = 0; n < slots; n++)
+	{
+		size_t i = (ringCursor_ + n) % slots;
+		SubmitRing *ring = rings_[i].load(std::memory_order_acquire);
+		uint8_t state = ring->state.load(std::memory_order_acquire);
+		if (state == SubmitRing::kFree)
+			continue;
+		if (auto idx = ring->queue.pop())
+		{
+			ringCursor_ = i + 1;
+			return idx;
+		}
+		// kClosed was stored after the owner's last push, so empty now means
+		// drained for good.
+		if (state == SubmitRing::kClosed)
+		{
+			liveRings_.fetch_sub(1, std::memory_order_relaxed);
+			ring->state.store(SubmitRing::kFree, std::memory_order_release);
+		}
+	}
+	return submittedIdxes_->pop();
+}
+
+template <typename QueuePolicy, typename WriterPolicy, typename ClockPolicy, typename OverflowPolicy>
+bool BasicSharedBackend<QueuePolicy, WriterPolicy, ClockPolicy, OverflowPolicy>::hasWork() const
+{
+	if (!submittedIdxes_->isEmpty())
+		return true;
+	size_t slots = rings_ ? ringSlots_.load(std::memory_order_acquire) : 0;
+	for (size_t i = 0; i < slots; i++)
+		if (!rings_[i].load(std::memory_order_acquire)->queue.isEmpty())
+			return true;
+	return false;
+}
+
+template <typename QueuePolicy, typename WriterPolicy, typename ClockPolicy, typename OverflowPolicy>
+size_t BasicSharedBackend<QueuePolicy, WriterPolicy, ClockPolicy, OverflowPolicy>::pendingCount() const
+{
+	size_t n = submittedIdxes_->size();
+	size_t slots = rings_ ? ringSlots_.load(std::memory_order_acquire) : 0;
+	for (size_t i = 0; i < slots; i++)
+		n += rings_[i].load(std::memory_order_acquire)->queue.size();
+	return n;
+}
+
+template <typename QueuePolicy, typename WriterPolicy, typename ClockPolicy, typename OverflowPolicy>
+void BasicSharedBackend<QueuePolicy, WriterPolicy, ClockPolicy, OverflowPolicy>::appendOut(const char *data, size_t len, const TimeSpan *span)
+{
+	withWriter([=](auto &w)
+						 { w.append(data, len, span); });
+}
+
+template <typename QueuePolicy, typename WriterPolicy, typename ClockPolicy, typename OverflowPolicy>
+void BasicSharedBackend<QueuePolicy, WriterPolicy, ClockPolicy, OverflowPolicy>::writeCallsites()
+{
+	const size_t known = CallsiteRegistry::size();
+	if (callsitesWritten_.load(std::memory_order_relaxed) == known)
+		return;
+	std::lock_guard<std::mutex> lock(callsiteMutex_);
+	std::string entries;
+	size_t id = callsitesWritten_.load(std::memory_order_relaxed);
+	for (; id < known; id++)
+	{
+		const Callsite &site = CallsiteRegistry::at(static_cast<uint32_t>(id + 1));
+		entries += site.idText;
+		entries += '\t';
+		entries += site.file;
+		entries += ':';
+		entries += std::to_string(site.line);
+		entries += '\t';
+		entries += site.function;
+		entries += '\n';
+	}
+	if (entries.empty())
+		return;
+	withWriter([&entries](auto &w)
+						 { w.appendCallsites(entries); });
+	callsitesWritten_.store(id, std::memory_order_relaxed);
+}
+
+template <typename QueuePolicy, typename WriterPolicy, typename ClockPolicy, typename OverflowPolicy>
+void BasicSharedBackend<QueuePolicy, WriterPolicy, ClockPolicy, OverflowPolicy>::write(size_t slot)
+{
+	auto cycleStart = std::chrono::steady_clock::now();
+	size_t numBuf{0};
+	uint64_t bytes{0};
+	size_t bufIdxes[poolCapacity_ + kOverflowSlots];
+
+	// An urgent buffer is queued: take everything up to it in this cycle.
+	const size_t limit = urgentPending_.load(std::memory_order_relaxed) ? poolCapacity_ + kOverflowSlots : batchLimit_;
+	while (numBuf < limit)
+	{
+		auto maybeIdx = popSubmitted();
+		if (!maybeIdx.has_value())
+		{
+			break;
+		}
+		size_t idx = *maybeIdx;
+
+		bufIdxes[numBuf++] = idx;
+	}
+
+	// More work than this writer's share: wake another pool writer for it.
+	if (writerCount_ > 1 && numBuf >= batchLimit_ && hasWork())
+		wakeWriter();
+
+	// Lines reference only ids interned before they were written, so the
+	// dictionary is current before any of them reach the file.
+	if (callsiteIds_ && numBuf > 0)
+		writeCallsites();
+
+	WriterCounters &stats = writerStats_[slot];
+	if (numBuf > 0)
+	{
+		const int64_t pickupNs = ClockPolicy::nowNanos();
+		for (size_t i = 0; i < numBuf; i++)
+		{
+			const Buffer &buf = *bufferPool_[bufIdxes[i]];
+			if (!buf.firstNs())
+				continue;
+			stats.handoffAge.record(buf.handoffNs() - buf.firstNs());
+			stats.pickupAge.record(pickupNs - buf.firstNs());
+		}
+	}
+
+	if (merger_)
+	{
+		// Buffers only go back to the free queue once the whole merge is out.
+		// Merged chunks mix every buffer of the cycle, so each is indexed with
+		// the cycle's whole time range.
+		TimeSpan span;
+		for (size_t i = 0; i < numBuf; i++)
+		{
+			const Buffer &buf = *bufferPool_[bufIdxes[i]];
+			merger_->add(buf.getBuffer(), buf.size());
+			if (buf.firstNs() && (!span.firstNs || buf.firstNs() < span.firstNs))
+				span.firstNs = buf.firstNs();
+			span.lastNs = std::max(span.lastNs, buf.lastNs());
+		}
+		merger_->merge([this, &bytes, &span](const char *data, size_t size)
+									 {
+			span.lines = static_cast<uint32_t>(std::count(data, data + size, '\n'));
+			appendOut(data, size, &span);
+			bytes += size; });
+		const int64_t writtenNs = ClockPolicy::nowNanos();
+		for (size_t i = 0; i < numBuf; i++)
+		{
+			const Buffer &buf = *bufferPool_[bufIdxes[i]];
+			if (buf.firstNs())
+				stats.writeAge.record(writtenNs - buf.firstNs());
+		}
+	}
+
+	// Urgent tickets (0 for the rest), published once the cycle's data is
+	// out (and synced).
+	uint64_t urgentSeqs[poolCapacity_ + kOverflowSlots];
+	size_t numUrgent = 0;
+	bool refilled = false;
+	for (size_t i = 0; i < numBuf; i++)
+	{
+		size_t bufIdx = bufIdxes[i];
+		urgentSeqs[i] = bufferPool_[bufIdx]->urgentSeq();
+		numUrgent += urgentSeqs[i] != 0;
+		if (!merger_)
+		{
+			const Buffer &buf = *bufferPool_[bufIdx];
+			TimeSpan span{buf.firstNs(), buf.lastNs(), static_cast<uint32_t>(buf.lineCount())};
+			const char *data = buf.getBuffer();
+			size_t size = buf.size();
+			appendOut(data, size, &span);
+			bytes += size;
+			if (buf.firstNs())
+				stats.writeAge.record(ClockPolicy::nowNanos() - buf.firstNs());
+		}
+		bufferPool_[bufIdx]->reset();
+		if (bufIdx < poolCapacity_)
+		{
+			if (freedNs_)
+				freedNs_[bufIdx] = LogTime::steadyNanos();
+			freeIdxes_->push(bufIdx);
+			refilled = true;
+		}
+		else
+			overflowFree_->push(bufIdx);
+	}
+
+	if (numBuf == 0)
+		return;
+	if (refilled)
+		freeGen_.fetch_add(1, std::memory_order_release);
+
+	withWriter([](auto &w)
+						 { w.flushIndex(); });
+
+	if (numUrgent > 0)
+	{
+		if (cfg_.syncUrgent)
+		{
+			withWriter([](auto &w)
+								 { w.sync(); });
+			bump(stats.syncs);
+		}
+		for (size_t i = 0; i < numBuf; i++)
+			if (urgentSeqs[i])
+				bumpMax(writtenSeq_[bufIdxes[i]], urgentSeqs[i]);
+		urgentPending_.fetch_sub(numUrgent, std::memory_order_relaxed);
+		if (cfg_.flightRecorder > 0)
+			urgentDump_.store(true, std::memory_order_release);
+	}
+
+	uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+										std::chrono::steady_clock::now() - cycleStart)
+										.count();
+	bump(stats.cycles);
+	bump(stats.cycleNsTotal, ns);
+	bumpMax(stats.cycleNsMax, ns);
+	bump(stats.buffers, numBuf);
+	bumpMax(stats.batchMax, numBuf);
+	bump(stats.bytes, bytes);
+}
+
+template <typename QueuePolicy, typename WriterPolicy, typename ClockPolicy, typename OverflowPolicy>
+MetricsSnapshot BasicSharedBackend<QueuePolicy, WriterPolicy, ClockPolicy, OverflowPolicy>::metrics() const
+{
+	MetricsSnapshot s;
+	producers_.collect(s);
+	for (size_t i = 0; i < writerCount_; i++)
+		collectWriter(writerStats_[i], s);
+	s.wakeups = wakeups_.load(std::memory_order_relaxed);
+	s.poolCapacity = poolCapacity_;
+	s.freeDepth = freeIdxes_->size() + (coldIdxes_ ? coldIdxes_->size() : 0);
+	s.residentBuffers = residentBuffers_.load(std::memory_order_relaxed);
+	s.idleReleases = idleReleases_.load(std::memory_order_relaxed);
+	s.submittedDepth = pendingCount();
+	s.rings = liveRings_.load(std::memory_order_relaxed);
+	withWriter([&s](const auto &w)
+						 {
+		s.writeCalls = w.getWriteCalls();
+		s.rolls = w.getRollCount();
+		s.rollNsTotal = w.getRollNsTotal();
+		s.rollNsMax = w.getRollNsMax();
+		s.placementFailures += w.helperPlacementError() != 0;
+		if constexpr (requires { w.getSinkDroppedBytes(); })
+		{
+			s.sinkDroppedBytes = w.getSinkDroppedBytes();
+			s.sinkReconnects = w.getSinkReconnects();
+		}
+		if constexpr (requires { w.getFlightDumps(); })
+			s.flightDumps = w.getFlightDumps(); });
+	s.placementFailures += placementFailures_.load(std::memory_order_relaxed);
+	if (cfg_.executor)
+		s.placementFailures += cfg_.executor->placementFailures();
+	return s;
+}
+
+template <typename QueuePolicy, typename WriterPolicy, typename ClockPolicy, typename OverflowPolicy>
+void BasicSharedBackend<QueuePolicy, WriterPolicy, ClockPolicy, OverflowPolicy>::syncDrops()
+{
+	const uint64_t total = producers_.drops();
+	if (total == dropsReported_)
+		return;
+	withWriter([n = total - dropsReported_](auto &w)
+						 { w.add_dropped(n); });
+	dropsReported_ = total;
+}
+
+// Moves pool buffers that have sat in freeIdxes_ for cfg.idleRelease to
+// coldIdxes_, giving their pages back. The queue has no peek, so a warm buffer
+// is popped and pushed back at the tail; after that the queue is no longer in
+// freedNs_ order, so the sweep goes through every buffer that was free when it
+// started instead of stopping at the first warm one. A producer that tried
+// while the sweep held the buffers saw an empty pool; freeGen_ moves so it
+// tries again.
+template <typename QueuePolicy, typename WriterPolicy, typename ClockPolicy, typename OverflowPolicy>
+void BasicSharedBackend<QueuePolicy, WriterPolicy, ClockPolicy, OverflowPolicy>::releaseIdle()
+{
+	const int64_t now = LogTime::steadyNanos();
+	if (now < nextSweepNs_)
+		return;
+	const int64_t idleNs = std::chrono::duration_cast<std::chrono::nanoseconds>(cfg_.idleRelease).count();
+	nextSweepNs_ = now + idleNs / 4;
+
+	bool pushed = false;
+	for (size_t n = freeIdxes_->size(); n > 0; n--)
+	{
+		auto idx = freeIdxes_->pop();
+		if (!idx.has_value())
+			break;
+		pushed = true;
+		if (now - freedNs_[*idx] < idleNs)
+		{
+			freeIdxes_->push(*idx);
+			continue;
+		}
+		bufferPool_[*idx]->releasePages();
+		residentBuffers_.fetch_sub(1, std::memory_order_relaxed);
+		idleReleases_.fetch_add(1, std::memory_order_relaxed);
+		coldIdxes_->push(*idx);
+	}
+	if (pushed)
+		freeGen_.fetch_add(1, std::memory_order_release);
+}
+
+// Runs on writer slot 0. Each append lands as one contiguous range, so the
+// line cannot interleave with a buffer write even with a writer pool.
+template <typename QueuePolicy, typename WriterPolicy, typename ClockPolicy, typename OverflowPolicy>
+void BasicSharedBackend<QueuePolicy, WriterPolicy, ClockPolicy, OverflowPolicy>::reportMetrics()
+{
+	lastReport_ = std::chrono::steady_clock::now();
+	char line[kMetricsLineMax];
+	size_t len = formatMetrics(metrics(), line, sizeof(line));
+	if (len > 0)
+		appendOut(line, len);
+}
+
+template <typename QueuePolicy, typename WriterPolicy, typename ClockPolicy, typename OverflowPolicy>
+void BasicSharedBackend<QueuePolicy, WriterPolicy, ClockPolicy, OverflowPolicy>::dumpFlightRecorder()
+{
+	if (cfg_.flightRecorder == 0)
+		return;
+	dumpRequests_.fetch_add(1, std::memory_order_relaxed);
+	wakeWriter();
+}
+
+template <typename QueuePolicy, typename WriterPolicy, typename ClockPolicy, typename OverflowPolicy>
+bool BasicSharedBackend<QueuePolicy, WriterPolicy, ClockPolicy, OverflowPolicy>::dumpPending() const
+{
+	if (cfg_.flightRecorder == 0)
+		return false;
+	return urgentDump_.load(std::memory_order_acquire) ||
+				 dumpRequests_.load(std::memory_order_relaxed) != dumpsServed_.load(std::memory_order_acquire) ||
+				 (cfg_.flightRecorderSignal > 0 && flightRecorderSignals() != signalsServed_.load(std::memory_order_acquire));
+}
+
+// Runs on the only writer, after a cycle: the ring already holds everything
+// drained so far. Producers' published buffers are read in place; they stay
+// intact meanwhile because only this thread recycles buffers.
+template <typename QueuePolicy, typename WriterPolicy, typename ClockPolicy, typename OverflowPolicy>
+void BasicSharedBackend<QueuePolicy, WriterPolicy, ClockPolicy, OverflowPolicy>::serveDumps()
+{
+	std::string reason;
+	const uint64_t served = dumpsServed_.load(std::memory_order_relaxed);
+	const uint64_t signalsServed = signalsServed_.load(std::memory_order_relaxed);
+	if (urgentDump_.load(std::memory_order_relaxed))
+		reason = "error line";
+	const uint64_t requests = dumpRequests_.load(std::memory_order_relaxed);
+	if (requests != served)
+		reason += reason.empty() ? "request" : ", request";
+	const uint64_t signals = cfg_.flightRecorderSignal > 0 ? flightRecorderSignals() : signalsServed;
+	if (signals != signalsServed)
+		reason += reason.empty() ? "signal" : ", signal";
+	if (reason.empty())
+		return;
+	urgentDump_.store(false, std::memory_order_release);
+	dumpsServed_.store(requests, std::memory_order_release);
+	signalsServed_.store(signals, std::memory_order_release);
+
+	withWriter([this, &reason](auto &w)
+						 {
+		if constexpr (requires { w.dump(""); })
+		{
+			// Ordered-mode buffers still hold their line stamps.
+			const bool stamped = cfg_.orderedOutput;
+			producers_.forEachLive([&w, stamped](const ProducerCounters &c)
+														 {
+				const char *data = c.partialData.load(std::memory_order_acquire);
+				const size_t len = c.partialLen.load(std::memory_order_acquire);
+				if (!data || !len || c.partialData.load(std::memory_order_acquire) != data)
+					return;
+				if (stamped)
+					forEachStampedLine(data, len, [&w](const char *body, size_t n)
+														 { w.addPartial(body, n); });
+				else
+					w.addPartial(data, len); });
+			w.dump(reason.c_str());
+		} });
+}
+
+// The combination AsyncLogger<SharedBackend> has always used. Instantiated
+// once in SharedBackend.cpp.
+using SharedBackend = BasicSharedBackend<>;
+extern template class BasicSharedBackend<>;
@@ -0,0 +1,92 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "BackendConfig.h"
+#include "BackendPolicies.h"
+#include "Buffer.h"
+#include "LinePattern.h"
+#include "Metrics.h"
+#include "NormalWriter.h"
+#include "ShmPool.h"
+
+// Producer-side backend over a ShmPool: AsyncLogger<ShmBackend> hands its
+// buffers to the collector process instead of to a writer thread of its
+// own. The pool is cfg.shmName; if no collector created it yet, this
+// process creates it with queueSize slots of bufSize bytes. A line longer
+// than a slot is cut, since there are no large-record buffers to spill to.
+class ShmBackend
+{
+public:
+	// No per-producer rings across processes.
+	struct Ring;
+	using Clock = RealtimeClock;
+	static constexpr bool kWaitForBuffers = false;
+
+	ShmBackend(size_t bufSize, size_t queueSize, std::string dir = "", BackendConfig cfg = {});
+
+	std::unique_ptr<Buffer> acquire() { return tryAcquire(); }
+	std::unique_ptr<Buffer> tryAcquire();
+	std::unique_ptr<Buffer> acquireOverflow(size_t) { return nullptr; }
+	bool growOverflow(Buffer &, size_t) { return false; }
+	void submit(std::unique_ptr<Buffer> buf, Ring * = nullptr);
+	// Urgent lines are handed off at once (cfg.urgentHandoff); nothing waits
+	// for the collector.
+	int urgentLevel() const { return cfg_.urgentHandoff ? CaelanLogger::ERROR : CaelanLogger::FATAL + 1; }
+	uint64_t submitUrgent(std::unique_ptr<Buffer> buf, Ring *ring = nullptr)
+	{
+		submit(std::move(buf), ring);
+		return 0;
+	}
+	bool awaitWritten(size_t, uint64_t) const { return false; }
+	void record_drop() { pool_->addDrops(1); }
+	Ring *registerRing() { return nullptr; }
+	void unregisterRing(Ring *) {}
+	ProducerCounters *registerProducer() { return producers_.registerProducer(); }
+	void unregisterProducer(ProducerCounters *c) { producers_.unregisterProducer(c); }
+	// This process's producers; freeDepth and poolCapacity are the shared pool's.
+	MetricsSnapshot metrics() const;
+	bool orderedOutput() const { return false; }
+	const LinePattern &linePattern() const { return pattern_; }
+	const std::string &loggerName() const { return cfg_.loggerName; }
+	ShmPool &pool() const { return *pool_; }
+
+private:
+	BackendConfig cfg_;
+	LinePattern pattern_;
+	std::unique_ptr<ShmPool> pool_;
+	MetricsRegistry producers_;
+};
+
+// The writer for every ShmBackend process on the host: one thread drains
+// the pool's submitted slots in submit order into NormalWriter segments
+// under dir, and every cfg.shmReclaimInterval frees the slots of producer
+// processes that died holding them. Opens (or creates) the pool like
+// ShmBackend. See tools/Collector.cpp for the standalone daemon.
+class ShmCollector
+{
+public:
+	ShmCollector(std::string dir, BackendConfig cfg, uint32_t slots, size_t slotSize);
+	~ShmCollector();
+	void start();
+	// Writes what is already submitted, reports drops and joins the thread.
+	void stop();
+	// One cycle; returns the slots written. For start()-less use and tests.
+	size_t drainOnce();
+	// Slots freed because their owner died.
+	uint64_t reclaimed() const { return reclaimed_.load(std::memory_order_relaxed); }
+	ShmPool &pool() const { return *pool_; }
+
+private:
+	BackendConfig cfg_;
+	std::unique_ptr<ShmPool> pool_;
+	NormalWriter out_;
+	std::thread thread_;
+	std::atomic<bool> running_{false};
+	std::atomic<uint64_t> reclaimed_{0};
+	std::vector<uint32_t> batch_;
+
+	void run();
+	void reclaim();
+};
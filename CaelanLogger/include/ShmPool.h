@@ -0,0 +1,100 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+// Buffer pool in POSIX shared memory, shared by producer processes
+// (ShmBackend) and one collector process (ShmCollector) that writes for all
+// of them.
+//
+// Each slot is a buffer plus a state word: (owner pid << 32) | state, changed
+// with a single CAS, so a slot never has a state without an owner. Producers
+// claim Free slots and publish them as Submitted with a sequence number;
+// the collector writes Submitted slots in sequence order and frees them.
+// There are no index rings whose half-finished push a dying process could
+// wedge. A slot held by a process that no longer exists is found by
+// reclaimDead() and freed; the lines it held are lost.
+class ShmPool
+{
+public:
+	static constexpr uint64_t kMagic = 0x314c4f4f50454143; // "CAEPOOL1"
+
+	enum State : uint32_t
+	{
+		Free = 0,
+		Held = 1,
+		Submitted = 2,
+	};
+
+	struct alignas(64) Slot
+	{
+		std::atomic<uint64_t> word;
+		// Written by the owner before it publishes Submitted.
+		uint64_t seq;
+		uint64_t size;
+		uint64_t lines;
+		int64_t firstNs;
+		int64_t lastNs;
+	};
+
+	struct alignas(64) Header
+	{
+		std::atomic<uint64_t> magic;
+		uint32_t slots;
+		uint64_t slotSize;
+		uint64_t dataOffset;
+		// Where the next claim starts scanning.
+		std::atomic<uint32_t> cursor;
+		// Exhaustion hint: producers skip the scan at 0.
+		std::atomic<uint32_t> freeSlots;
+		std::atomic<uint64_t> nextSeq;
+		// Futex word, bumped by every submit; the collector sleeps on it.
+		std::atomic<uint32_t> submits;
+		std::atomic<uint32_t> collectorWaiting;
+		// Lines producers dropped for want of a slot, not yet reported.
+		std::atomic<uint64_t> drops;
+	};
+
+	// Maps the pool called name ("/caelogger"), creating it with slots
+	// buffers of slotSize bytes if it does not exist yet. An existing pool
+	// keeps the geometry it was created with. Throws std::system_error.
+	static std::unique_ptr<ShmPool> open(const std::string &name, uint32_t slots, size_t slotSize);
+	static void unlink(const std::string &name);
+	~ShmPool();
+
+	uint32_t slots() const { return header_->slots; }
+	size_t slotSize() const { return header_->slotSize; }
+	Header &header() const { return *header_; }
+	Slot &slot(uint32_t i) const { return slots_[i]; }
+	char *data(uint32_t i) const { return base_ + header_->dataOffset + static_cast<size_t>(i) * header_->slotSize; }
+
+	// Producer side. Claims a free slot for this process, or returns -1.
+	int64_t claim();
+	void submit(uint32_t i, size_t size, size_t lines, int64_t firstNs, int64_t lastNs);
+	void addDrops(uint64_t n) { header_->drops.fetch_add(n, std::memory_order_relaxed); }
+
+	// Collector side. Sleeps until a submit after the last call, or timeout.
+	void waitForSubmits(std::chrono::milliseconds timeout);
+	// Ends a waitForSubmits() early, as a submit would.
+	void wake();
+	// The Submitted slots, oldest submit first. Slots submitted while it
+	// scans are left for the next call.
+	void collectSubmitted(std::vector<uint32_t> &out) const;
+	void release(uint32_t i);
+	// Frees slots held by processes that have exited. Returns how many.
+	size_t reclaimDead();
+
+private:
+	ShmPool(char *base, size_t bytes);
+
+	char *base_;
+	size_t bytes_;
+	Header *header_;
+	Slot *slots_;
+	uint32_t lastSubmits_{0};
+};
@@ -0,0 +1,58 @@
+#pragma once
+#include <sys/socket.h>
+#include "BackendConfig.h"
+#include "FileUtil.h"
+
+// Writer that ships drained buffers to a local collector over a socket
+// instead of writing segments (BackendConfig::socketSink):
+//   "unix:/path"            AF_UNIX datagrams
+//   "udp:127.0.0.1:5140"    UDP datagrams (IPv4)
+//   "unix-stream:/path"     AF_UNIX stream, newline-delimited
+// A buffer is cut into datagrams of at most kMaxDatagram bytes at line
+// boundaries and sent kBatch at a time with sendmmsg(); on a stream it goes
+// out with sendmsg(). The socket is non-blocking. A full receiver gets
+// sendTimeout to drain, then the rest of the buffer is dropped. A failed
+// socket is closed and reconnected after a backoff that doubles up to
+// socketMaxBackoff; buffers drained meanwhile are dropped. The writer thread
+// only ever blocks in that bounded wait for a stalled send.
+class SocketWriter : public FileUtil<SocketWriter>
+{
+public:
+  static constexpr size_t kMaxDatagram = 60 * 1024;
+  static constexpr size_t kBatch = 64;
+
+  // Throws std::invalid_argument on a malformed cfg.socketSink.
+  SocketWriter(std::string dir, const BackendConfig &cfg);
+  ~SocketWriter();
+  void append(const char *data, size_t len, const TimeSpan *span = nullptr);
+  void writeDropMessage(const char *msg, int len);
+  // Sends the "dropped: N" line; there is no segment to cut over.
+  void roll();
+  // No segments, so no sidecars or preallocated files.
+  void enableTimeIndex() {}
+  void enablePreallocation() {}
+
+  uint64_t getSinkDroppedBytes() const { return droppedBytes_.load(std::memory_order_relaxed); }
+  uint64_t getSinkReconnects() const { return reconnects_.load(std::memory_order_relaxed); }
+
+private:
+  int type_{SOCK_DGRAM};
+  sockaddr_storage addr_{};
+  socklen_t addrLen_{0};
+  int sock_{-1};
+  bool connectedOnce_{false};
+  std::chrono::milliseconds sendTimeout_;
+  std::chrono::milliseconds maxBackoff_;
+  std::chrono::milliseconds backoff_{0};
+  int64_t retryAtNs_{0};
+  std::atomic<uint64_t> droppedBytes_{0};
+  std::atomic<uint64_t> reconnects_{0};
+
+  // False while backing off or when the attempt fails.
+  bool connect();
+  void disconnect();
+  bool waitWritable();
+  void sendDatagrams(const char *data, size_t len);
+  void sendStream(const char *data, size_t len);
+  void dropBytes(size_t n) { droppedBytes_.fetch_add(n, std::memory_order_relaxed); }
+};
@@ -2,6 +2,18 @@
 #include <atomic>
 #include <thread>
 
+// Spin-wait hint: keeps a polling core from hogging its sibling hyperthread.
+inline void cpuRelax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__)
+	asm volatile("yield");
+#else
+	std::this_thread::yield();
+#endif
+}
+
 struct SpinGuard
 {
 	std::atomic_flag &spinlockPen_;
@@ -3,16 +3,61 @@
 #include <memory>
 #include <Buffer.h>
 #include <algorithm>
+#include <chrono>
+#include "Level.h"
+#include "LinePattern.h"
+#include "Metrics.h"
 
 template <typename BackendT>
 class ThreadLogger
 {
 public:
-	ThreadLogger(size_t, BackendT *);
+	// acquireNow=false defers taking a pool buffer until the first line, for
+	// owners that may sit idle (see LogContext).
+	ThreadLogger(size_t, BackendT *, bool acquireNow = true);
 	~ThreadLogger();
 	void handoff();
+	// Hands off the current buffer without taking a new one; the next line
+	// acquires. Frees the pool slot while the owner is idle.
+	void release();
 	Buffer *getCurBuffer() const { return curBuffer_.get(); }
-	void recordDrop() const{backendLogger_->record_drop();}
+	// Counted only in this thread's block; a backend with a registry sums
+	// them when it reports drops. Others still get record_drop().
+	void recordDrop(CaelanLogger::Level level)
+	{
+		bump(counters_->dropsByLevel[level]);
+		if constexpr (requires { backendLogger_->record_drop(); })
+			backendLogger_->record_drop();
+	}
+	// Lines carry a stamp header for the backend's ordered merge.
+	bool ordered() const { return ordered_; }
+	// The backend's line pattern, with this thread's constant fields rendered.
+	PrefixRenderer &prefix() { return prefix_; }
+	// Re-renders %t and %N for the calling thread if they name another one:
+	// a LogContext's logger runs on whichever thread attached it.
+	void rebindThread()
+	{
+		if (prefix_.renderedForOtherThread())
+			prefix_ = PrefixRenderer(backendLogger_->linePattern(), backendLogger_->loggerName());
+	}
+
+	// Free space LogStream wants before starting a line: about twice the
+	// recent average line, so a buffer is handed off close to full. A line
+	// that outgrows it goes through spill() instead of being cut.
+	size_t lineReserve() const { return std::clamp<size_t>(2 * avgLine_, kMinLineReserve, kMaxLineReserve); }
+	// The unfinished line at [lineStart, size) of the current buffer needs
+	// need more bytes. Hands off everything before the line and moves the line
+	// into a fresh pool buffer, or into a large-record buffer if it no longer
+	// fits a pool buffer. Returns the buffer to continue in, or nullptr
+	// (the caller cuts the line).
+	Buffer *spill(size_t lineStart, size_t need);
+	// LogStream's end of line: updates the estimate, submits a large record,
+	// and hands the buffer off at once if level is urgent (see
+	// BackendConfig::urgentHandoff).
+	void endLine(size_t len, bool truncated, CaelanLogger::Level level);
+
+	static constexpr size_t kMinLineReserve = 128;
+	static constexpr size_t kMaxLineReserve = 1028;
 	unsigned long long getLostLogs() const { return lostLogs; }
 	void setLostLogs(unsigned long long n) { lostLogs = n; }
 
@@ -20,19 +65,73 @@ private:
 	unsigned long long lostLogs{0};
 	std::unique_ptr<Buffer> curBuffer_;
 	BackendT *backendLogger_;
+	ProducerCounters *counters_;
+	// Own submission ring, or nullptr for the backend's shared queue.
+	typename BackendT::Ring *ring_;
+	bool ordered_;
+	// Set while the current line lives in an overflow buffer.
+	std::unique_ptr<Buffer> large_;
+	size_t avgLine_{kMinLineReserve / 2};
+	int urgentLevel_;
+	PrefixRenderer prefix_;
+	// The backend snapshots unfinished buffers (BackendConfig::flightRecorder):
+	// curBuffer_ is published in counters_ whenever it changes, and its
+	// length at every line end.
+	bool publishPartial_{false};
+	// The backend's freeGeneration() when this thread last found the pool
+	// empty; until it moves, acquire() is not worth a try.
+	uint64_t exhaustedGen_{~uint64_t{0}};
+
+	void publishBuffer()
+	{
+		if (!publishPartial_)
+			return;
+		counters_->partialLen.store(0, std::memory_order_release);
+		counters_->partialData.store(curBuffer_ ? curBuffer_->getBuffer() : nullptr, std::memory_order_release);
+	}
+	// Before curBuffer_ is submitted, so a snapshot never repeats what the
+	// writer drains.
+	void unpublishBuffer()
+	{
+		if (!publishPartial_)
+			return;
+		counters_->partialLen.store(0, std::memory_order_release);
+		counters_->partialData.store(nullptr, std::memory_order_release);
+	}
+	std::unique_ptr<Buffer> acquire();
+	void countHandoff();
+	void submitCurrent();
+	void submitUrgent(std::unique_ptr<Buffer>, CaelanLogger::Level);
 };
 
 template <typename BackendT>
-ThreadLogger<BackendT>::ThreadLogger(size_t sizeBuf, BackendT *bl)
-		: backendLogger_(bl), curBuffer_(std::move(bl->acquire()))
+ThreadLogger<BackendT>::ThreadLogger(size_t sizeBuf, BackendT *bl, bool acquireNow)
+		: curBuffer_(acquireNow ? bl->acquire() : nullptr), backendLogger_(bl), counters_(bl->registerProducer()), ring_(bl->registerRing()),
+			ordered_(bl->orderedOutput()), urgentLevel_(bl->urgentLevel()),
+			prefix_(bl->linePattern(), bl->loggerName())
 {
+	if constexpr (requires { bl->capturesPartials(); })
+		publishPartial_ = bl->capturesPartials();
+	publishBuffer();
 }
 
 template <typename BackendT>
 ThreadLogger<BackendT>::~ThreadLogger()
 {
-	if (curBuffer_ && backendLogger_)
-		backendLogger_->submit(std::move(curBuffer_));
+	if (!backendLogger_)
+		return;
+	if (curBuffer_)
+		submitCurrent();
+	backendLogger_->unregisterRing(ring_);
+	backendLogger_->unregisterProducer(counters_);
+}
+
+template <typename BackendT>
+void ThreadLogger<BackendT>::countHandoff()
+{
+	bump(counters_->lines, curBuffer_->lineCount());
+	bump(counters_->bytes, curBuffer_->size());
+	bump(counters_->handoffs);
 }
 
 template <typename BackendT>
@@ -40,10 +139,141 @@ void ThreadLogger<BackendT>::handoff()
 {
 	if (!curBuffer_)
 	{
-		curBuffer_ = backendLogger_->acquire();
+		curBuffer_ = acquire();
+		publishBuffer();
 		return;
 	}
 
-	backendLogger_->submit(std::move(curBuffer_));
-	curBuffer_ = backendLogger_->acquire();
-}
\ No newline at end of file
+	auto start = std::chrono::steady_clock::now();
+	submitCurrent();
+	curBuffer_ = acquire();
+	publishBuffer();
+	uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+										std::chrono::steady_clock::now() - start)
+										.count();
+	bump(counters_->handoffNsTotal, ns);
+	bumpMax(counters_->handoffNsMax, ns);
+}
+
+// Under overload every line would otherwise take the free queue's lock just
+// to find it empty. The generation is read before the attempt, so a refill
+// that races with the failed pop still moves it.
+template <typename BackendT>
+std::unique_ptr<Buffer> ThreadLogger<BackendT>::acquire()
+{
+	if constexpr (!BackendT::kWaitForBuffers && requires { backendLogger_->freeGeneration(); })
+	{
+		const uint64_t gen = backendLogger_->freeGeneration();
+		if (gen == exhaustedGen_)
+		{
+			bump(counters_->acquireSkips);
+			return nullptr;
+		}
+		std::unique_ptr<Buffer> buf = backendLogger_->acquire();
+		if (!buf)
+			exhaustedGen_ = gen;
+		return buf;
+	}
+	return backendLogger_->acquire();
+}
+
+template <typename BackendT>
+void ThreadLogger<BackendT>::release()
+{
+	if (!curBuffer_)
+		return;
+	// An empty buffer still goes through submit(): only the writer may push
+	// to the free queue. It writes nothing.
+	if (curBuffer_->size() > 0)
+		countHandoff();
+	unpublishBuffer();
+	backendLogger_->submit(std::move(curBuffer_), ring_);
+}
+
+template <typename BackendT>
+void ThreadLogger<BackendT>::submitCurrent()
+{
+	countHandoff();
+	unpublishBuffer();
+	backendLogger_->submit(std::move(curBuffer_), ring_);
+}
+
+template <typename BackendT>
+Buffer *ThreadLogger<BackendT>::spill(size_t lineStart, size_t need)
+{
+	if (large_)
+		return backendLogger_->growOverflow(*large_, large_->size() + need) ? large_.get() : nullptr;
+	if (!curBuffer_)
+		return nullptr;
+
+	const size_t partial = curBuffer_->size() - lineStart;
+	const size_t want = partial + need;
+	const bool fitsPoolBuffer = want <= curBuffer_->capacity();
+	// Never waits for the pool: this thread still holds curBuffer_.
+	std::unique_ptr<Buffer> next = fitsPoolBuffer ? backendLogger_->tryAcquire()
+																								: backendLogger_->acquireOverflow(want);
+	if (!next)
+		return nullptr;
+	if (!next->add(curBuffer_->getBuffer() + lineStart, partial))
+	{
+		// The caller truncates the line in place. next goes back through the
+		// writer, empty.
+		backendLogger_->submit(std::move(next), ring_);
+		return nullptr;
+	}
+	curBuffer_->truncate(lineStart);
+	// Submitted even if that leaves it empty: only the writer may return a
+	// buffer to the pool.
+	submitCurrent();
+	if (fitsPoolBuffer)
+	{
+		bump(counters_->spills);
+		curBuffer_ = std::move(next);
+		publishBuffer();
+		return curBuffer_.get();
+	}
+	// The next line acquires a pool buffer again (see LogStream's constructor).
+	bump(counters_->largeRecords);
+	large_ = std::move(next);
+	return large_.get();
+}
+
+// The next line acquires a fresh buffer, as after release(). A FATAL line
+// waits (up to cfg.fatalWait) until its buffer is written.
+template <typename BackendT>
+void ThreadLogger<BackendT>::submitUrgent(std::unique_ptr<Buffer> buf, CaelanLogger::Level level)
+{
+	bump(counters_->urgentHandoffs);
+	size_t idx = buf->idx();
+	uint64_t ticket = backendLogger_->submitUrgent(std::move(buf), ring_);
+	if (level == CaelanLogger::FATAL)
+		backendLogger_->awaitWritten(idx, ticket);
+}
+
+template <typename BackendT>
+void ThreadLogger<BackendT>::endLine(size_t len, bool truncated, CaelanLogger::Level level)
+{
+	if (truncated)
+		bump(counters_->truncated);
+	// 1/8 moving average; the clamp in lineReserve() bounds what one huge
+	// line does to it.
+	avgLine_ = avgLine_ - avgLine_ / 8 + len / 8;
+	if (large_)
+	{
+		bump(counters_->lines);
+		bump(counters_->bytes, large_->size());
+		bump(counters_->handoffs);
+		if (level >= urgentLevel_)
+			submitUrgent(std::move(large_), level);
+		else
+			backendLogger_->submit(std::move(large_), ring_);
+	}
+	else if (level >= urgentLevel_ && curBuffer_)
+	{
+		countHandoff();
+		unpublishBuffer();
+		submitUrgent(std::move(curBuffer_), level);
+	}
+	else if (publishPartial_ && curBuffer_)
+		counters_->partialLen.store(curBuffer_->size(), std::memory_order_release);
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <optional>
+#include <string>
+#include <vector>
+
+// Where and how a logger-internal thread runs (the writer thread(s), the
+// segment preparer). Applied by the thread itself as it starts. Every field
+// defaults to inheriting from the creating thread.
+struct ThreadPlacement
+{
+	// CPUs the thread may run on; empty keeps the inherited mask.
+	std::vector<int> cpus;
+	// SCHED_OTHER, SCHED_BATCH, SCHED_IDLE, SCHED_FIFO or SCHED_RR; -1 keeps
+	// the inherited policy. priority only matters for FIFO and RR.
+	int policy{-1};
+	int priority{0};
+	// Per-thread nice value (setpriority on the thread id).
+	std::optional<int> nice;
+	// I/O priority class (1 realtime, 2 best-effort, 3 idle; 0 keeps it) and
+	// level 0-7 within it.
+	int ioprioClass{0};
+	int ioprioLevel{4};
+	// Thread name shown by top/perf/gdb, at most 15 characters; empty uses the
+	// logger's default ("cae-writer", "cae-segprep").
+	std::string name;
+};
+
+// Applies p to the calling thread. Every setting is attempted; returns 0, or
+// the errno of the first one that failed (EPERM without CAP_SYS_NICE, EINVAL
+// for a CPU outside the cgroup's set). The thread keeps running either way.
+int applyThreadPlacement(const ThreadPlacement &p, const std::string &defaultName);
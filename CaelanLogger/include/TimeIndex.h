@@ -0,0 +1,51 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// Sidecar time index. With BackendConfig::timeIndex every segment "<name>" gets
+// a "<name>.idx" next to it: an array of fixed-size records, one per write
+// batch, in file order. Lines from different threads interleave, so the
+// ranges of neighbouring records may overlap; a lookup scans the (small)
+// index instead of the segment.
+struct TimeIndexRecord
+{
+	int64_t firstNs; // wall-clock ns since the epoch of the batch's first line
+	int64_t lastNs;	 // ... and of its last line
+	uint64_t offset; // byte offset of the batch in the segment
+	uint32_t length; // bytes in the batch
+	uint32_t lines;
+};
+static_assert(sizeof(TimeIndexRecord) == 32, "on-disk record layout");
+
+// What the writer knows about a batch before it lands in the file.
+struct TimeSpan
+{
+	int64_t firstNs{0};
+	int64_t lastNs{0};
+	uint32_t lines{0};
+};
+
+constexpr const char *kTimeIndexSuffix = ".idx";
+
+// A byte range of one segment whose lines may fall in the queried window.
+// Adjacent matching batches are coalesced into one range.
+struct TimeRangeHit
+{
+	std::filesystem::path segment;
+	uint64_t offset{0};
+	uint64_t length{0};
+	uint32_t lines{0};
+};
+
+// Ranges of the given segments that overlap [fromNs, toNs]. Segments without
+// a sidecar are skipped.
+std::vector<TimeRangeHit> findTimeRange(const std::vector<std::filesystem::path> &segments,
+																				int64_t fromNs, int64_t toNs);
+// Same, over every indexed segment in dir, oldest file name first.
+std::vector<TimeRangeHit> findTimeRange(const std::filesystem::path &dir, int64_t fromNs, int64_t toNs);
+
+// Reads the bytes of one hit. The range holds whole lines; lines near either
+// end may still be just outside the window and are left to the caller.
+std::string readTimeRange(const TimeRangeHit &);
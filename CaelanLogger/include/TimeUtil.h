@@ -4,9 +4,19 @@
 #include <iomanip>
 #include <chrono>
 #include <ctime>
+#include <cstdint>
 
 namespace LogTime {
 	std::string nowString();
 	std::string nowTimeOnlyString();
 	std::string nowDateString();
+	// CLOCK_REALTIME in ns since the epoch, and the nowDateString() rendering of
+	// such a value, so a caller can keep the number it formatted.
+	int64_t nowNanos();
+	// CLOCK_REALTIME_COARSE: the time of the last tick (1-4 ms resolution),
+	// read without touching the clocksource.
+	int64_t coarseNowNanos();
+	// CLOCK_MONOTONIC in ns, for intervals inside the process.
+	int64_t steadyNanos();
+	std::string dateString(int64_t epochNs);
 }
\ No newline at end of file
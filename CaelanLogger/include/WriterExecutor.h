@@ -0,0 +1,75 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "ThreadPlacement.h"
+
+// One backend as the executor sees it. The executor never serves a task from
+// two threads at once, so serve() may touch writer-only state.
+class WriterTask
+{
+public:
+	virtual ~WriterTask() = default;
+	// Something is queued for serve() (or a dump was asked for).
+	virtual bool pending() const = 0;
+	// One bounded writer cycle plus the periodic duties that are due.
+	virtual void serve() = 0;
+	// Longest an idle executor may wait before periodic duties (metrics line,
+	// idle sweep, signal poll) need a serve(); 0 for none.
+	virtual std::chrono::milliseconds idleTimeout() const = 0;
+
+private:
+	friend class WriterExecutor;
+	std::atomic_flag busy_ = ATOMIC_FLAG_INIT;
+};
+
+// A fixed set of writer threads shared by many backends
+// (BackendConfig::executor), so the number of loggers no longer sets the
+// number of writer threads. Each thread walks the registered tasks from a
+// shared round-robin cursor and serves every one it can claim, one bounded
+// cycle each; a backlog on one logger cannot starve the others. When a full
+// pass finds nothing pending, the thread parks until a backend notifies or
+// the shortest idleTimeout() passes.
+class WriterExecutor
+{
+public:
+	// Threads are named placement.name (default "cae-exec") plus "-<n>".
+	explicit WriterExecutor(size_t threads = 1, ThreadPlacement placement = {});
+	// Backends hold the executor, so this runs after every task is gone.
+	~WriterExecutor();
+	WriterExecutor(const WriterExecutor &) = delete;
+	WriterExecutor &operator=(const WriterExecutor &) = delete;
+
+	void registerTask(WriterTask *);
+	// Returns once no thread is serving the task; it is never claimed again.
+	void unregisterTask(WriterTask *);
+	// A backend's wakeWriter(). Returns whether a parked thread was notified.
+	bool notify();
+
+	size_t threadCount() const { return threads_.size(); }
+	size_t taskCount() const;
+	uint64_t passes() const { return passes_.load(std::memory_order_relaxed); }
+	// Threads whose ThreadPlacement could not be fully applied.
+	uint64_t placementFailures() const { return placementFailures_.load(std::memory_order_relaxed); }
+
+private:
+	mutable std::mutex mutex_;
+	std::condition_variable cv_;
+	std::vector<WriterTask *> tasks_;
+	size_t cursor_{0};
+	bool running_{true};
+	std::atomic<size_t> parked_{0};
+	std::atomic<uint64_t> passes_{0};
+	std::atomic<uint64_t> placementFailures_{0};
+	ThreadPlacement placement_;
+	std::vector<std::thread> threads_;
+
+	// The next unclaimed task of this pass, claimed; nullptr once visited
+	// covers every task.
+	WriterTask *claim(size_t &visited);
+	void park();
+	void run(size_t slot);
+};
@@ -1,13 +1,38 @@
 #include "Buffer.h"
+#include <cstdlib>
 #include <cstring>
-Buffer::Buffer() : capacity_(2000), size_(0), remaining_(capacity_)
+#include <new>
+#include <sys/mman.h>
+
+void AlignedDelete::operator()(char *p) const
+{
+	if (owned)
+		std::free(p);
+}
+
+AlignedStorage allocateAligned(size_t bytes)
+{
+	size_t rounded = (bytes + kBufferAlign - 1) / kBufferAlign * kBufferAlign;
+	void *p = std::aligned_alloc(kBufferAlign, rounded ? rounded : kBufferAlign);
+	if (!p)
+		throw std::bad_alloc();
+	return AlignedStorage(static_cast<char *>(p));
+}
+
+Buffer::Buffer() : size_(0), capacity_(2000), remaining_(capacity_)
 {
-	buffer = std::make_unique<char[]>(capacity_);
+	buffer = allocateAligned(capacity_);
 }
-Buffer::Buffer(size_t capacity) : capacity_(capacity), size_(0), remaining_(capacity)
+Buffer::Buffer(size_t capacity, bool allocate) : size_(0), capacity_(capacity), remaining_(capacity)
 {
-	buffer = std::make_unique<char[]>(capacity);
+	if (allocate)
+		buffer = allocateAligned(capacity);
 }
+Buffer::Buffer(char *storage, size_t capacity)
+		: buffer(storage, AlignedDelete{false}), size_(0), capacity_(capacity), remaining_(capacity)
+{
+}
+
 bool Buffer::add(const char *src, size_t len)
 {
 	if (len + size_ > capacity_)
@@ -33,9 +58,41 @@ bool Buffer::add(const char src)
 	return true;
 }
 
+void Buffer::reserve(size_t capacity)
+{
+	if (capacity <= capacity_)
+		return;
+	AlignedStorage bigger = allocateAligned(capacity);
+	std::memcpy(bigger.get(), buffer.get(), size_);
+	buffer = std::move(bigger);
+	remaining_ += capacity - capacity_;
+	capacity_ = capacity;
+}
+
+void Buffer::materialize()
+{
+	if (!buffer)
+		buffer = allocateAligned(capacity_);
+	released_ = false;
+}
+
+void Buffer::releasePages()
+{
+	if (!buffer || released_)
+		return;
+	// allocateAligned() handed out whole kBufferAlign blocks.
+	size_t rounded = (capacity_ + kBufferAlign - 1) / kBufferAlign * kBufferAlign;
+	::madvise(buffer.get(), rounded, MADV_DONTNEED);
+	released_ = true;
+}
+
 void Buffer::reset()
 {
 	size_ = 0;
 	remaining_ = capacity_;
 	lineCount_ = 0;
+	firstNs_ = 0;
+	lastNs_ = 0;
+	handoffNs_ = 0;
+	urgentSeq_ = 0;
 }
\ No newline at end of file
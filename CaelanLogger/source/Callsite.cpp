@@ -0,0 +1,41 @@
+#include "Callsite.h"
+#include <atomic>
+#include <cstring>
+#include <deque>
+#include <mutex>
+
+namespace
+{
+	std::mutex mutex;
+	// A deque keeps every record at a stable address as it grows.
+	std::deque<Callsite> sites;
+	std::atomic<size_t> count{0};
+}
+
+namespace CallsiteRegistry
+{
+	const Callsite &intern(const std::source_location &loc)
+	{
+		const char *file = loc.file_name();
+		const char *slash = std::strrchr(file, '/');
+		std::string location = std::string(slash ? slash + 1 : file) + ":" + std::to_string(loc.line());
+
+		std::lock_guard<std::mutex> lock(mutex);
+		const auto id = static_cast<uint32_t>(sites.size() + 1);
+		sites.push_back({id, static_cast<uint32_t>(loc.line()), file, loc.function_name(), std::move(location),
+										 std::to_string(id), std::strlen(loc.function_name())});
+		count.store(sites.size(), std::memory_order_release);
+		return sites.back();
+	}
+
+	size_t size()
+	{
+		return count.load(std::memory_order_acquire);
+	}
+
+	const Callsite &at(uint32_t id)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return sites.at(id - 1);
+	}
+}
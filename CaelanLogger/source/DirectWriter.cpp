@@ -0,0 +1,164 @@
+#include "DirectWriter.h"
+#include <cstring>
+
+namespace
+{
+  bool aligned(const char *p)
+  {
+    return reinterpret_cast<uintptr_t>(p) % kBufferAlign == 0;
+  }
+
+  // Probes dir once instead of failing every open: tmpfs and some network
+  // filesystems reject O_DIRECT at open() with EINVAL.
+  bool directSupported(const std::filesystem::path &dir, const std::string &prefix)
+  {
+    static std::atomic<unsigned> seq{0};
+    std::string probe = (dir / ("." + prefix + ".direct." + std::to_string(::getpid()) + "." +
+                                std::to_string(seq.fetch_add(1, std::memory_order_relaxed))))
+                            .string();
+    int fd = ::open(probe.c_str(), O_CREAT | O_WRONLY | O_CLOEXEC | O_DIRECT, 0644);
+    if (fd < 0)
+      return false;
+    ::close(fd);
+    ::unlink(probe.c_str());
+    return true;
+  }
+}
+
+DirectWriter::DirectWriter(std::string dir, std::string prefix)
+    : FileUtil<DirectWriter>(std::move(dir), std::move(prefix)), staging_(allocateAligned(kStagingSize))
+{
+  // The offset is ours to keep aligned; O_APPEND adds nothing.
+  openFlags_ &= ~O_APPEND;
+  direct_ = directSupported(dir_, prefix_);
+  if (direct_)
+    openFlags_ |= O_DIRECT;
+}
+
+DirectWriter::~DirectWriter()
+{
+  flushTail();
+}
+
+void DirectWriter::append(const char *data, size_t len, const TimeSpan *span)
+{
+  if (fd_ < 0)
+  {
+    if (!openFile(generateFileName()))
+    {
+      throw std::runtime_error(std::string("write() failed: ") + std::strerror(errno));
+    }
+  }
+  if (shouldRoll(len))
+  {
+    roll();
+  }
+  recordIndex(span, writtenBytes, len);
+  writtenBytes += len;
+
+  if (tailLen_ == 0 && aligned(data))
+  {
+    size_t blocks = len / kBufferAlign * kBufferAlign;
+    writeBlocks(data, blocks);
+    data += blocks;
+    len -= blocks;
+  }
+  stage(data, len);
+
+  size_t blocks = tailLen_ / kBufferAlign * kBufferAlign;
+  if (blocks > 0)
+  {
+    writeBlocks(staging_.get(), blocks);
+    tailLen_ -= blocks;
+    std::memmove(staging_.get(), staging_.get() + blocks, tailLen_);
+  }
+}
+
+// Copies into staging_, writing it out whenever it fills up.
+void DirectWriter::stage(const char *data, size_t len)
+{
+  while (len > 0)
+  {
+    size_t n = std::min(len, kStagingSize - tailLen_);
+    std::memcpy(staging_.get() + tailLen_, data, n);
+    tailLen_ += n;
+    data += n;
+    len -= n;
+    if (tailLen_ == kStagingSize)
+    {
+      writeBlocks(staging_.get(), kStagingSize);
+      tailLen_ = 0;
+    }
+  }
+}
+
+void DirectWriter::writeBlocks(const char *data, size_t len)
+{
+  size_t writtenDown = 0;
+  while (writtenDown < len)
+  {
+    ssize_t n = ::write(fd_, data + writtenDown, len - writtenDown);
+    writeCalls_.store(writeCalls_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    if (n > 0)
+    {
+      writtenDown += static_cast<size_t>(n);
+      continue;
+    }
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0 && errno == EINVAL)
+    {
+      // The device wants a larger alignment than kBufferAlign: go buffered.
+      int flags = ::fcntl(fd_, F_GETFL);
+      if (flags >= 0 && (flags & O_DIRECT) && ::fcntl(fd_, F_SETFL, flags & ~O_DIRECT) == 0)
+      {
+        direct_ = false;
+        clearOpenFlag(O_DIRECT);
+        continue;
+      }
+    }
+    throw std::runtime_error(std::string("write() failed: ") + std::strerror(errno));
+  }
+}
+
+// The segment is done after this, so the partial last block may be written
+// unaligned through the page cache.
+void DirectWriter::flushTail()
+{
+  if (fd_ < 0 || tailLen_ == 0)
+    return;
+  int flags = ::fcntl(fd_, F_GETFL);
+  if (flags >= 0 && (flags & O_DIRECT))
+    ::fcntl(fd_, F_SETFL, flags & ~O_DIRECT);
+  ssize_t n = ::write(fd_, staging_.get(), tailLen_);
+  (void)n;
+  tailLen_ = 0;
+}
+
+// The tail goes out through the page cache at its final offset without
+// moving the file offset; the next whole block overwrites it with O_DIRECT.
+void DirectWriter::sync()
+{
+  if (fd_ < 0)
+    return;
+  if (tailLen_ > 0)
+  {
+    off_t at = ::lseek(fd_, 0, SEEK_CUR);
+    int flags = ::fcntl(fd_, F_GETFL);
+    bool direct = flags >= 0 && (flags & O_DIRECT);
+    if (direct)
+      ::fcntl(fd_, F_SETFL, flags & ~O_DIRECT);
+    ssize_t n = ::pwrite(fd_, staging_.get(), tailLen_, at);
+    (void)n;
+    if (direct)
+      ::fcntl(fd_, F_SETFL, flags);
+  }
+  ::fdatasync(fd_);
+}
+
+// Runs from roll() right before the segment switch.
+void DirectWriter::writeDropMessage(const char *msg, int len)
+{
+  stage(msg, static_cast<size_t>(len));
+  flushTail();
+}
@@ -0,0 +1,144 @@
+#include "FlightRecorder.h"
+#include <algorithm>
+#include <csignal>
+#include <cstring>
+#include <mutex>
+#include <sys/uio.h>
+
+namespace
+{
+  std::atomic<uint64_t> gSignals{0};
+  static_assert(std::atomic<uint64_t>::is_always_lock_free, "the signal handler needs a lock-free counter");
+
+  void onSignal(int)
+  {
+    gSignals.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  bool writeAll(int fd, iovec *iov, int count)
+  {
+    while (count > 0)
+    {
+      ssize_t n = ::writev(fd, iov, count);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n < 0)
+        return false;
+      for (; count > 0 && static_cast<size_t>(n) >= iov->iov_len; iov++, count--)
+        n -= static_cast<ssize_t>(iov->iov_len);
+      if (count > 0)
+      {
+        iov->iov_base = static_cast<char *>(iov->iov_base) + n;
+        iov->iov_len -= static_cast<size_t>(n);
+      }
+    }
+    return true;
+  }
+}
+
+uint64_t flightRecorderSignals()
+{
+  return gSignals.load(std::memory_order_relaxed);
+}
+
+bool installFlightRecorderSignal(int sig)
+{
+  static std::mutex mutex;
+  static uint64_t installed = 0;
+  std::lock_guard<std::mutex> lock(mutex);
+  if (sig <= 0 || sig >= 64)
+    return false;
+  if (installed & (1ull << sig))
+    return true;
+  struct sigaction sa{};
+  sa.sa_handler = onSignal;
+  sigemptyset(&sa.sa_mask);
+  sa.sa_flags = SA_RESTART;
+  if (::sigaction(sig, &sa, nullptr) != 0)
+    return false;
+  installed |= 1ull << sig;
+  return true;
+}
+
+FlightRecorder::FlightRecorder(std::string dir, const BackendConfig &cfg)
+    : FileUtil<FlightRecorder>(std::move(dir)), ring_(std::make_unique<char[]>(cfg.flightRecorder)),
+      capacity_(cfg.flightRecorder)
+{
+}
+
+void FlightRecorder::append(const char *data, size_t len, const TimeSpan *)
+{
+  writeCalls_.fetch_add(1, std::memory_order_relaxed);
+  if (len >= capacity_)
+  {
+    std::memcpy(ring_.get(), data + len - capacity_, capacity_);
+    head_ = 0;
+    used_ = capacity_;
+    return;
+  }
+  const size_t first = std::min(len, capacity_ - head_);
+  std::memcpy(ring_.get() + head_, data, first);
+  std::memcpy(ring_.get(), data + first, len - first);
+  head_ = (head_ + len) % capacity_;
+  used_ = std::min(capacity_, used_ + len);
+}
+
+void FlightRecorder::writeDropMessage(const char *msg, int len)
+{
+  append(msg, static_cast<size_t>(len));
+}
+
+void FlightRecorder::roll()
+{
+  size_t n = dropped_.exchange(0, std::memory_order_relaxed);
+  char msg[64];
+  int len = std::snprintf(msg, sizeof(msg), "dropped: %zu\n", n);
+  if (len > 0)
+    writeDropMessage(msg, len);
+}
+
+void FlightRecorder::addPartial(const char *data, size_t len)
+{
+  partials_.append(data, len);
+}
+
+std::string FlightRecorder::dump(const char *reason)
+{
+  const std::string path = makeFullPath(prefix_ + "_flight_" + generateFileName());
+  int fd = ::open(path.c_str(), O_CREAT | O_TRUNC | O_WRONLY | O_CLOEXEC, 0644);
+  if (fd < 0)
+    return {};
+
+  char header[160];
+  int headerLen = std::snprintf(header, sizeof(header), "flight recorder dump: %s at %s\n", reason,
+                                LogTime::nowString().c_str());
+  iovec iov[4];
+  int count = 0;
+  iov[count++] = {header, static_cast<size_t>(std::max(headerLen, 0))};
+  if (used_ < capacity_)
+    iov[count++] = {ring_.get(), used_};
+  else
+  {
+    // The oldest line was partly overwritten; start after its end.
+    char *oldest = ring_.get() + head_;
+    size_t tail = capacity_ - head_;
+    char *cut = static_cast<char *>(std::memchr(oldest, '\n', tail));
+    if (cut)
+    {
+      iov[count++] = {cut + 1, tail - static_cast<size_t>(cut + 1 - oldest)};
+      iov[count++] = {ring_.get(), head_};
+    }
+    else if (char *wrapped = static_cast<char *>(std::memchr(ring_.get(), '\n', head_)))
+      iov[count++] = {wrapped + 1, head_ - static_cast<size_t>(wrapped + 1 - ring_.get())};
+  }
+  if (!partials_.empty())
+    iov[count++] = {partials_.data(), partials_.size()};
+  const bool ok = writeAll(fd, iov, count);
+  ::close(fd);
+
+  head_ = 0;
+  used_ = 0;
+  partials_.clear();
+  dumps_.fetch_add(1, std::memory_order_relaxed);
+  return ok ? path : std::string();
+}
@@ -0,0 +1,254 @@
+#include "LinePattern.h"
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace
+{
+	struct LevelName
+	{
+		const char *text;
+		size_t len;
+	};
+	constexpr LevelName kLevelNames[] = {
+			{"INFO", 4},
+			{"DEBUG", 5},
+			{"WARNING", 7},
+			{"ERROR", 5},
+			{"FATAL", 5},
+	};
+	constexpr size_t kMaxLevelName = 7;
+
+	void writeDigits(char *out, uint32_t value, int width)
+	{
+		for (int i = width - 1; i >= 0; i--)
+		{
+			out[i] = static_cast<char>('0' + value % 10);
+			value /= 10;
+		}
+	}
+}
+
+LinePattern::LinePattern(std::string_view pattern)
+{
+	auto literal = [this](std::string_view text)
+	{
+		if (!ops_.empty() && ops_.back().field == Field::Literal)
+			ops_.back().text.append(text);
+		else
+			ops_.push_back({Field::Literal, std::string(text)});
+	};
+
+	for (size_t i = 0; i < pattern.size(); i++)
+	{
+		if (pattern[i] != '%')
+		{
+			literal(pattern.substr(i, 1));
+			continue;
+		}
+		if (++i == pattern.size())
+			throw std::invalid_argument("line pattern ends in '%'");
+		Field f;
+		switch (pattern[i])
+		{
+		case 'L':
+			f = Field::Level;
+			break;
+		case 'D':
+			f = Field::Date;
+			break;
+		case 'T':
+			f = Field::Time;
+			break;
+		case 'f':
+			f = Field::Millis;
+			break;
+		case 'u':
+			f = Field::Micros;
+			break;
+		case 't':
+			f = Field::ThreadId;
+			break;
+		case 'N':
+			f = Field::ThreadName;
+			break;
+		case 'P':
+			f = Field::Pid;
+			break;
+		case 'n':
+			f = Field::LoggerName;
+			break;
+		case 's':
+			f = Field::Source;
+			break;
+		case 'F':
+			f = Field::Function;
+			break;
+		case 'i':
+			f = Field::CallsiteId;
+			break;
+		case '%':
+			literal("%");
+			continue;
+		default:
+			throw std::invalid_argument(std::string("unknown line pattern field %") + pattern[i]);
+		}
+		ops_.push_back({f, {}});
+	}
+}
+
+bool LinePattern::usesCallsiteIds() const
+{
+	for (const auto &op : ops_)
+		if (op.field == Field::CallsiteId)
+			return true;
+	return false;
+}
+
+PrefixRenderer::PrefixRenderer(const LinePattern &pattern, std::string_view loggerName)
+{
+	using Field = LinePattern::Field;
+	uint32_t segBegin = 0;
+	size_t levels = 0;
+	for (const auto &op : pattern.ops())
+	{
+		const auto pos = static_cast<uint32_t>(text_.size());
+		switch (op.field)
+		{
+		case Field::Literal:
+			text_ += op.text;
+			break;
+		case Field::Level:
+		case Field::Source:
+		case Field::Function:
+		case Field::CallsiteId:
+			segments_.push_back({segBegin, pos, op.field});
+			segBegin = pos;
+			levels += op.field == Field::Level;
+			sources_ += op.field == Field::Source;
+			functions_ += op.field == Field::Function;
+			ids_ += op.field == Field::CallsiteId;
+			break;
+		case Field::Date:
+			clockPatches_.push_back({op.field, pos});
+			text_.append(10, '0');
+			break;
+		case Field::Time:
+			clockPatches_.push_back({op.field, pos});
+			text_.append(8, '0');
+			break;
+		case Field::Millis:
+			subsecPatches_.push_back({op.field, pos});
+			text_.append(3, '0');
+			break;
+		case Field::Micros:
+			subsecPatches_.push_back({op.field, pos});
+			text_.append(6, '0');
+			break;
+		case Field::ThreadId:
+			tid_ = ::syscall(SYS_gettid);
+			text_ += std::to_string(tid_);
+			break;
+		case Field::ThreadName:
+		{
+			tid_ = ::syscall(SYS_gettid);
+			char name[16] = {};
+			::pthread_getname_np(::pthread_self(), name, sizeof(name));
+			text_ += name;
+			break;
+		}
+		case Field::Pid:
+			text_ += std::to_string(::getpid());
+			break;
+		case Field::LoggerName:
+			text_ += loggerName;
+			break;
+		}
+	}
+	segments_.push_back({segBegin, static_cast<uint32_t>(text_.size()), Field::Literal});
+	fixedMax_ = text_.size() + levels * kMaxLevelName;
+}
+
+bool PrefixRenderer::renderedForOtherThread() const
+{
+	return tid_ != 0 && tid_ != ::syscall(SYS_gettid);
+}
+
+size_t PrefixRenderer::maxSize(const Callsite *site) const
+{
+	if (!site)
+		return fixedMax_ + sources_ + functions_ + ids_;
+	return fixedMax_ + sources_ * site->location.size() + functions_ * site->functionLen +
+				 ids_ * site->idText.size();
+}
+
+void PrefixRenderer::renderClock(std::time_t sec)
+{
+	cachedSec_ = sec;
+	std::tm tm{};
+	::localtime_r(&sec, &tm);
+	for (const auto &p : clockPatches_)
+	{
+		char *out = text_.data() + p.pos;
+		if (p.field == LinePattern::Field::Date)
+		{
+			writeDigits(out, static_cast<uint32_t>(tm.tm_year + 1900), 4);
+			out[4] = '-';
+			writeDigits(out + 5, static_cast<uint32_t>(tm.tm_mon + 1), 2);
+			out[7] = '-';
+			writeDigits(out + 8, static_cast<uint32_t>(tm.tm_mday), 2);
+		}
+		else
+		{
+			writeDigits(out, static_cast<uint32_t>(tm.tm_hour), 2);
+			out[2] = ':';
+			writeDigits(out + 3, static_cast<uint32_t>(tm.tm_min), 2);
+			out[5] = ':';
+			writeDigits(out + 6, static_cast<uint32_t>(tm.tm_sec), 2);
+		}
+	}
+}
+
+size_t PrefixRenderer::render(char *out, CaelanLogger::Level level, int64_t epochNs, const Callsite *site)
+{
+	using Field = LinePattern::Field;
+	const auto sec = static_cast<std::time_t>(epochNs / 1000000000);
+	const auto ns = static_cast<uint32_t>(epochNs % 1000000000);
+	if (!clockPatches_.empty() && sec != cachedSec_)
+		renderClock(sec);
+
+	const LevelName &name = kLevelNames[level <= CaelanLogger::FATAL ? level : CaelanLogger::INFO];
+	size_t n = 0;
+	for (const Segment &s : segments_)
+	{
+		std::memcpy(out + n, text_.data() + s.begin, s.end - s.begin);
+		for (const auto &p : subsecPatches_)
+			if (p.pos >= s.begin && p.pos < s.end)
+			{
+				char *at = out + n + (p.pos - s.begin);
+				if (p.field == Field::Millis)
+					writeDigits(at, ns / 1000000, 3);
+				else
+					writeDigits(at, ns / 1000, 6);
+			}
+		n += s.end - s.begin;
+
+		if (s.next == Field::Literal)
+			continue;
+		std::string_view text = "-";
+		if (s.next == Field::Level)
+			text = {name.text, name.len};
+		else if (site && s.next == Field::Source)
+			text = site->location;
+		else if (site && s.next == Field::Function)
+			text = {site->function, site->functionLen};
+		else if (site && s.next == Field::CallsiteId)
+			text = site->idText;
+		std::memcpy(out + n, text.data(), text.size());
+		n += text.size();
+	}
+	return n;
+}
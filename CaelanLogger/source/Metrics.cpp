@@ -0,0 +1,181 @@
+#include "Metrics.h"
+#include <algorithm>
+#include <bit>
+#include <cstdio>
+
+namespace
+{
+	void addProducer(const ProducerCounters &c, MetricsSnapshot &s)
+	{
+		s.lines += c.lines.load(std::memory_order_relaxed);
+		s.bytes += c.bytes.load(std::memory_order_relaxed);
+		s.handoffs += c.handoffs.load(std::memory_order_relaxed);
+		s.handoffNsTotal += c.handoffNsTotal.load(std::memory_order_relaxed);
+		s.handoffNsMax = std::max<uint64_t>(s.handoffNsMax, c.handoffNsMax.load(std::memory_order_relaxed));
+		s.spills += c.spills.load(std::memory_order_relaxed);
+		s.largeRecords += c.largeRecords.load(std::memory_order_relaxed);
+		s.truncated += c.truncated.load(std::memory_order_relaxed);
+		s.urgentHandoffs += c.urgentHandoffs.load(std::memory_order_relaxed);
+		s.acquireSkips += c.acquireSkips.load(std::memory_order_relaxed);
+		for (size_t i = 0; i < kLevelCount; i++)
+			s.dropsByLevel[i] += c.dropsByLevel[i].load(std::memory_order_relaxed);
+	}
+}
+
+void AgeHistogram::record(int64_t ageNs)
+{
+	uint64_t us = ageNs > 0 ? static_cast<uint64_t>(ageNs) / 1000 : 0;
+	size_t i = std::min<size_t>(std::bit_width(us), kAgeBuckets - 1);
+	bump(buckets[i]);
+}
+
+uint64_t AgeStats::count() const
+{
+	uint64_t n = 0;
+	for (uint64_t b : buckets)
+		n += b;
+	return n;
+}
+
+uint64_t AgeStats::percentileUs(double p) const
+{
+	uint64_t total = count();
+	if (total == 0)
+		return 0;
+	uint64_t rank = static_cast<uint64_t>(p / 100.0 * static_cast<double>(total));
+	uint64_t seen = 0;
+	for (size_t i = 0; i < kAgeBuckets; i++)
+	{
+		seen += buckets[i];
+		if (seen > rank || seen == total)
+			return uint64_t{1} << i;
+	}
+	return uint64_t{1} << (kAgeBuckets - 1);
+}
+
+uint64_t MetricsSnapshot::drops() const
+{
+	uint64_t n = 0;
+	for (uint64_t d : dropsByLevel)
+		n += d;
+	return n;
+}
+
+ProducerCounters *MetricsRegistry::registerProducer()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	live_.push_back(std::make_unique<ProducerCounters>());
+	return live_.back().get();
+}
+
+void MetricsRegistry::unregisterProducer(ProducerCounters *counters)
+{
+	if (!counters)
+		return;
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	auto it = std::find_if(live_.begin(), live_.end(),
+												 [counters](const auto &p)
+												 { return p.get() == counters; });
+	if (it == live_.end())
+		return;
+
+	addProducer(**it, retired_);
+	*it = std::move(live_.back());
+	live_.pop_back();
+}
+
+void MetricsRegistry::collect(MetricsSnapshot &s) const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	s.producers = live_.size();
+	s.lines += retired_.lines;
+	s.bytes += retired_.bytes;
+	s.handoffs += retired_.handoffs;
+	s.handoffNsTotal += retired_.handoffNsTotal;
+	s.handoffNsMax = std::max(s.handoffNsMax, retired_.handoffNsMax);
+	s.spills += retired_.spills;
+	s.largeRecords += retired_.largeRecords;
+	s.truncated += retired_.truncated;
+	s.urgentHandoffs += retired_.urgentHandoffs;
+	s.acquireSkips += retired_.acquireSkips;
+	for (size_t i = 0; i < kLevelCount; i++)
+		s.dropsByLevel[i] += retired_.dropsByLevel[i];
+
+	for (const auto &p : live_)
+		addProducer(*p, s);
+}
+
+uint64_t MetricsRegistry::drops() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	uint64_t n = retired_.drops();
+	for (const auto &p : live_)
+		for (const auto &d : p->dropsByLevel)
+			n += d.load(std::memory_order_relaxed);
+	return n;
+}
+
+void collectWriter(const WriterCounters &w, MetricsSnapshot &s)
+{
+	s.writerCycles += w.cycles.load(std::memory_order_relaxed);
+	s.cycleNsTotal += w.cycleNsTotal.load(std::memory_order_relaxed);
+	s.cycleNsMax = std::max<uint64_t>(s.cycleNsMax, w.cycleNsMax.load(std::memory_order_relaxed));
+	s.buffersWritten += w.buffers.load(std::memory_order_relaxed);
+	s.batchMax = std::max<uint64_t>(s.batchMax, w.batchMax.load(std::memory_order_relaxed));
+	s.bytesWritten += w.bytes.load(std::memory_order_relaxed);
+	s.parks += w.parks.load(std::memory_order_relaxed);
+	s.syncs += w.syncs.load(std::memory_order_relaxed);
+	for (size_t i = 0; i < kAgeBuckets; i++)
+	{
+		s.handoffAge.buckets[i] += w.handoffAge.buckets[i].load(std::memory_order_relaxed);
+		s.pickupAge.buckets[i] += w.pickupAge.buckets[i].load(std::memory_order_relaxed);
+		s.writeAge.buckets[i] += w.writeAge.buckets[i].load(std::memory_order_relaxed);
+	}
+}
+
+size_t formatMetrics(const MetricsSnapshot &s, char *out, size_t cap)
+{
+	int len = std::snprintf(out, cap,
+													"metrics: producers=%llu lines=%llu bytes=%llu handoffs=%llu "
+													"drops=%llu (info=%llu debug=%llu warn=%llu error=%llu fatal=%llu) "
+													"free=%zu/%zu submitted=%zu cycles=%llu cycle_avg_us=%.1f cycle_max_us=%.1f "
+													"batch_avg=%.2f batch_max=%llu bytes_written=%llu bytes_per_write=%.0f "
+													"rolls=%llu roll_avg_us=%.1f roll_max_us=%.1f "
+													"handoff_avg_ns=%.0f handoff_max_ns=%llu wakeups=%llu parks=%llu "
+													"spills=%llu large=%llu truncated=%llu urgent=%llu syncs=%llu acquire_skips=%llu "
+													"sink_dropped_bytes=%llu sink_reconnects=%llu flight_dumps=%llu "
+													"age_p50_us=%llu/%llu/%llu age_p99_us=%llu/%llu/%llu\n",
+													(unsigned long long)s.producers, (unsigned long long)s.lines,
+													(unsigned long long)s.bytes, (unsigned long long)s.handoffs,
+													(unsigned long long)s.drops(),
+													(unsigned long long)s.dropsByLevel[CaelanLogger::INFO],
+													(unsigned long long)s.dropsByLevel[CaelanLogger::DEBUG],
+													(unsigned long long)s.dropsByLevel[CaelanLogger::WARNING],
+													(unsigned long long)s.dropsByLevel[CaelanLogger::ERROR],
+													(unsigned long long)s.dropsByLevel[CaelanLogger::FATAL],
+													s.freeDepth, s.poolCapacity, s.submittedDepth,
+													(unsigned long long)s.writerCycles, s.avgCycleUs(), s.cycleNsMax / 1000.0,
+													s.avgBatch(), (unsigned long long)s.batchMax,
+													(unsigned long long)s.bytesWritten, s.bytesPerWrite(),
+													(unsigned long long)s.rolls, s.avgRollUs(), s.rollNsMax / 1000.0,
+													s.avgHandoffNs(), (unsigned long long)s.handoffNsMax,
+													(unsigned long long)s.wakeups, (unsigned long long)s.parks,
+													(unsigned long long)s.spills, (unsigned long long)s.largeRecords,
+													(unsigned long long)s.truncated, (unsigned long long)s.urgentHandoffs,
+													(unsigned long long)s.syncs, (unsigned long long)s.acquireSkips,
+													(unsigned long long)s.sinkDroppedBytes, (unsigned long long)s.sinkReconnects,
+													(unsigned long long)s.flightDumps,
+													(unsigned long long)s.handoffAge.percentileUs(50),
+													(unsigned long long)s.pickupAge.percentileUs(50),
+													(unsigned long long)s.writeAge.percentileUs(50),
+													(unsigned long long)s.handoffAge.percentileUs(99),
+													(unsigned long long)s.pickupAge.percentileUs(99),
+													(unsigned long long)s.writeAge.percentileUs(99));
+	if (len < 0 || cap < 2)
+		return 0;
+	if (static_cast<size_t>(len) < cap)
+		return static_cast<size_t>(len);
+	out[cap - 2] = '\n';
+	return cap - 1;
+}
@@ -1,7 +1,7 @@
 #include "NormalWriter.h"
 #include <cstring>
 
-void NormalWriter::append(const char *data, size_t len)
+void NormalWriter::append(const char *data, size_t len, const TimeSpan *span)
 {
   if (fd_ < 0)
   {
@@ -14,11 +14,13 @@ void NormalWriter::append(const char *data, size_t len)
   {
     roll();
   }
+  recordIndex(span, writtenBytes, len);
   size_t writtenDown = 0;
   // to prevent if write() doesn't finish.
   while (writtenDown < len)
   {
     ssize_t n = ::write(fd_, data + writtenDown, len - writtenDown);
+    writeCalls_.store(writeCalls_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
     if (n > 0)
     {
       writtenDown += static_cast<size_t>(n);
@@ -33,9 +35,7 @@ void NormalWriter::append(const char *data, size_t len)
   }
 }
 
-void NormalWriter::writeDropMessage(char *msg, int len)
+void NormalWriter::writeDropMessage(const char *msg, int len)
 {
-  write(fd_, msg, static_cast<size_t>(len));
-  close(fd_);
-  delete[] msg;
+  ::write(fd_, msg, static_cast<size_t>(len));
 }
\ No newline at end of file
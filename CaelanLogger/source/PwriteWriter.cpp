@@ -0,0 +1,92 @@
+#include "PwriteWriter.h"
+#include <mutex>
+
+PwriteWriter::PwriteWriter(std::string dir, std::string prefix)
+    : FileUtil<PwriteWriter>(std::move(dir), std::move(prefix))
+{
+  // pwrite() on an O_APPEND fd ignores the offset on Linux.
+  openFlags_ &= ~O_APPEND;
+}
+
+void PwriteWriter::append(const char *data, size_t len, const TimeSpan *span)
+{
+  while (true)
+  {
+    {
+      std::shared_lock<std::shared_mutex> lock(rollMutex_);
+      if (fd_ >= 0)
+      {
+        uint64_t off = offset_.fetch_add(len, std::memory_order_relaxed);
+        // A buffer larger than a whole segment still goes out in one piece,
+        // same as NormalWriter.
+        if (off == 0 || off + len <= maxFileSize_)
+        {
+          writeAt(data, len, off);
+          recordIndex(span, off, len);
+          return;
+        }
+      }
+    }
+
+    // Reservations are handed out in increasing order, so once one overshoots
+    // every later one does too: nothing below the real end of file is skipped.
+    std::unique_lock<std::shared_mutex> lock(rollMutex_);
+    if (fd_ < 0)
+    {
+      if (!openFile(generateFileName()))
+      {
+        throw std::runtime_error(std::string("write() failed: ") + std::strerror(errno));
+      }
+      offset_.store(0, std::memory_order_relaxed);
+    }
+    else if (offset_.load(std::memory_order_relaxed) + len > maxFileSize_)
+    {
+      rollLocked();
+    }
+  }
+}
+
+void PwriteWriter::writeAt(const char *data, size_t len, uint64_t off)
+{
+  size_t writtenDown = 0;
+  while (writtenDown < len)
+  {
+    ssize_t n = ::pwrite(fd_, data + writtenDown, len - writtenDown, static_cast<off_t>(off + writtenDown));
+    writeCalls_.fetch_add(1, std::memory_order_relaxed);
+    if (n > 0)
+    {
+      writtenDown += static_cast<size_t>(n);
+      continue;
+    }
+    if (n < 0 && errno == EINTR)
+      continue;
+    throw std::runtime_error(std::string("pwrite() failed: ") + std::strerror(errno));
+  }
+}
+
+void PwriteWriter::roll()
+{
+  std::unique_lock<std::shared_mutex> lock(rollMutex_);
+  rollLocked();
+}
+
+void PwriteWriter::flushIndex()
+{
+  std::shared_lock<std::shared_mutex> lock(rollMutex_);
+  FileUtil<PwriteWriter>::flushIndex();
+}
+
+void PwriteWriter::rollLocked()
+{
+  FileUtil<PwriteWriter>::roll();
+  offset_.store(0, std::memory_order_relaxed);
+}
+
+// Called with rollMutex_ held exclusively, so no pwrite is in flight and the
+// end of file is exactly the end of the last successful reservation.
+void PwriteWriter::writeDropMessage(const char *msg, int len)
+{
+  off_t end = ::lseek(fd_, 0, SEEK_END);
+  if (end >= 0)
+    ::pwrite(fd_, msg, static_cast<size_t>(len), end);
+}
@@ -0,0 +1,182 @@
+#include "SegmentPreparer.h"
+#include "TimeIndex.h"
+#include <cstdio>
+#include <filesystem>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+SegmentPreparer::SegmentPreparer(std::string dir, std::function<std::string()> nextPath, int openFlags,
+																 size_t preallocBytes, bool withIndex, ThreadPlacement placement)
+		: dir_(std::move(dir)), nextPath_(std::move(nextPath)), openFlags_(openFlags), preallocBytes_(preallocBytes), withIndex_(withIndex),
+			placement_(std::move(placement))
+{
+	thread_ = std::thread(&SegmentPreparer::run, this);
+}
+
+SegmentPreparer::~SegmentPreparer()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stop_ = true;
+	}
+	cv_.notify_one();
+	if (thread_.joinable())
+		thread_.join();
+
+	for (int fd : retired_)
+		trimAndClose(fd);
+
+	// Never rolled into: don't leave an empty segment behind.
+	if (ready_.fd >= 0)
+	{
+		::close(ready_.fd);
+		::unlink(readyPath_.c_str());
+	}
+	if (ready_.idxFd >= 0)
+	{
+		::close(ready_.idxFd);
+		::unlink((readyPath_ + kTimeIndexSuffix).c_str());
+	}
+}
+
+// Naming happens here rather than in run(): a segment can sit prepared for a
+// long time, and its name should say when it started taking lines.
+PreparedSegment SegmentPreparer::take()
+{
+	PreparedSegment seg;
+	std::string placeholder;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		seg = ready_;
+		placeholder.swap(readyPath_);
+		ready_ = PreparedSegment{};
+	}
+	cv_.notify_one();
+	if (seg.fd < 0)
+		return seg;
+
+	const std::string path = nextPath_();
+	if (::rename(placeholder.c_str(), path.c_str()) != 0)
+	{
+		::close(seg.fd);
+		::unlink(placeholder.c_str());
+		if (seg.idxFd >= 0)
+		{
+			::close(seg.idxFd);
+			::unlink((placeholder + kTimeIndexSuffix).c_str());
+		}
+		return PreparedSegment{};
+	}
+	if (seg.idxFd >= 0 && ::rename((placeholder + kTimeIndexSuffix).c_str(), (path + kTimeIndexSuffix).c_str()) != 0)
+	{
+		// The segment is fine without its sidecar; readers fall back to a scan.
+		::close(seg.idxFd);
+		::unlink((placeholder + kTimeIndexSuffix).c_str());
+		seg.idxFd = -1;
+	}
+	return seg;
+}
+
+void SegmentPreparer::retire(int fd)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		retired_.push_back(fd);
+	}
+	cv_.notify_one();
+}
+
+void SegmentPreparer::setOpenFlags(int flags)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	openFlags_ = flags;
+	if (ready_.fd >= 0)
+		matchStatusFlags(ready_.fd, flags);
+}
+
+void SegmentPreparer::run()
+{
+	placementError_.store(applyThreadPlacement(placement_, "cae-segprep"), std::memory_order_relaxed);
+	std::vector<int> retired;
+	while (true)
+	{
+		bool needSegment;
+		int openFlags;
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			cv_.wait(lock, [this]
+							 { return stop_ || ready_.fd < 0 || !retired_.empty(); });
+			if (stop_)
+				return;
+			retired.swap(retired_);
+			needSegment = ready_.fd < 0;
+			openFlags = openFlags_;
+		}
+
+		for (int fd : retired)
+			trimAndClose(fd);
+		retired.clear();
+
+		if (!needSegment)
+			continue;
+
+		std::string path = placeholderPath();
+		std::error_code ec;
+		std::filesystem::create_directories(dir_, ec);
+		// A crashed run may have left one behind; don't append to it.
+		::unlink(path.c_str());
+		::unlink((path + kTimeIndexSuffix).c_str());
+		int fd = ::open(path.c_str(), openFlags, 0644);
+		if (fd < 0)
+		{
+			// Leave ready_ empty: take() returns -1 and the writer opens
+			// inline. Back off so a persistent error doesn't spin this thread.
+			std::unique_lock<std::mutex> lock(mutex_);
+			cv_.wait_for(lock, std::chrono::milliseconds(100), [this]
+									 { return stop_; });
+			continue;
+		}
+		// KEEP_SIZE reserves the extents without moving EOF, so O_APPEND writes
+		// still start at 0. Filesystems without fallocate just skip this.
+		::fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(preallocBytes_));
+		int idxFd = withIndex_ ? ::open((path + kTimeIndexSuffix).c_str(), O_CREAT | O_APPEND | O_WRONLY | O_CLOEXEC, 0644) : -1;
+
+		std::lock_guard<std::mutex> lock(mutex_);
+		// setOpenFlags() may have run while this segment was being opened.
+		if (openFlags_ != openFlags)
+			matchStatusFlags(fd, openFlags_);
+		ready_.fd = fd;
+		ready_.idxFd = idxFd;
+		readyPath_ = std::move(path);
+	}
+}
+
+// Hidden, and unique per process and preparer, so writers sharing a directory
+// never open each other's.
+std::string SegmentPreparer::placeholderPath()
+{
+	static std::atomic<unsigned> counter{0};
+	return (std::filesystem::path(dir_) / (".prepared_" + std::to_string(::getpid()) + "_" +
+																				 std::to_string(counter.fetch_add(1, std::memory_order_relaxed))))
+			.string();
+}
+
+// Only the status flags F_SETFL can change are synced; the rest only matter
+// at open().
+void SegmentPreparer::matchStatusFlags(int fd, int flags)
+{
+	int current = ::fcntl(fd, F_GETFL);
+	if (current >= 0 && (current & O_DIRECT) != (flags & O_DIRECT))
+		::fcntl(fd, F_SETFL, (current & ~O_DIRECT) | (flags & O_DIRECT));
+}
+
+// Truncating to the current size releases the extents fallocate() reserved
+// past EOF.
+void SegmentPreparer::trimAndClose(int fd)
+{
+	struct stat st;
+	if (::fstat(fd, &st) == 0)
+		::ftruncate(fd, st.st_size);
+	::close(fd);
+}
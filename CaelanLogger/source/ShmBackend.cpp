@@ -0,0 +1,123 @@
+#include "ShmBackend.h"
+#include <algorithm>
+#include <cstdio>
+
+ShmBackend::ShmBackend(size_t bufSize, size_t queueSize, std::string, BackendConfig cfg)
+		: cfg_(std::move(cfg)),
+			pattern_(cfg_.linePattern.empty() ? LinePattern::kDefault : cfg_.linePattern),
+			pool_(ShmPool::open(cfg_.shmName, static_cast<uint32_t>(queueSize), bufSize))
+{
+}
+
+std::unique_ptr<Buffer> ShmBackend::tryAcquire()
+{
+	int64_t i = pool_->claim();
+	if (i < 0)
+		return nullptr;
+	auto buf = std::make_unique<Buffer>(pool_->data(static_cast<uint32_t>(i)), pool_->slotSize());
+	buf->setIdx(static_cast<size_t>(i));
+	return buf;
+}
+
+void ShmBackend::submit(std::unique_ptr<Buffer> buf, Ring *)
+{
+	if (!buf)
+		return;
+	pool_->submit(static_cast<uint32_t>(buf->idx()), buf->size(), buf->lineCount(), buf->firstNs(), buf->lastNs());
+}
+
+MetricsSnapshot ShmBackend::metrics() const
+{
+	MetricsSnapshot s;
+	producers_.collect(s);
+	s.poolCapacity = pool_->slots();
+	s.freeDepth = pool_->header().freeSlots.load(std::memory_order_relaxed);
+	return s;
+}
+
+ShmCollector::ShmCollector(std::string dir, BackendConfig cfg, uint32_t slots, size_t slotSize)
+		: cfg_(std::move(cfg)), pool_(ShmPool::open(cfg_.shmName, slots, slotSize)), out_(std::move(dir))
+{
+	out_.setMaxFileSize(cfg_.maxFileSize);
+	if (cfg_.timeIndex)
+		out_.enableTimeIndex();
+	if (cfg_.preallocateSegments)
+	{
+		out_.setHelperPlacement(cfg_.helperPlacement);
+		out_.enablePreallocation();
+	}
+}
+
+ShmCollector::~ShmCollector()
+{
+	stop();
+}
+
+void ShmCollector::start()
+{
+	bool expected = false;
+	if (running_.compare_exchange_strong(expected, true))
+		thread_ = std::thread(&ShmCollector::run, this);
+}
+
+void ShmCollector::stop()
+{
+	if (running_.exchange(false))
+		pool_->wake();
+	if (thread_.joinable())
+		thread_.join();
+}
+
+void ShmCollector::run()
+{
+	ThreadPlacement placement = cfg_.writerPlacement;
+	applyThreadPlacement(placement, placement.name.empty() ? "cae-collector" : placement.name);
+	auto nextSweep = std::chrono::steady_clock::now();
+	while (running_.load(std::memory_order_acquire))
+	{
+		pool_->waitForSubmits(cfg_.shmReclaimInterval);
+		drainOnce();
+		if (std::chrono::steady_clock::now() >= nextSweep)
+		{
+			reclaim();
+			nextSweep = std::chrono::steady_clock::now() + cfg_.shmReclaimInterval;
+		}
+	}
+	drainOnce();
+	reclaim();
+	// Writes the "dropped: N" line.
+	out_.roll();
+}
+
+size_t ShmCollector::drainOnce()
+{
+	pool_->collectSubmitted(batch_);
+	for (uint32_t i : batch_)
+	{
+		const ShmPool::Slot &s = pool_->slot(i);
+		if (s.size)
+		{
+			TimeSpan span{s.firstNs, s.lastNs, static_cast<uint32_t>(s.lines)};
+			// The size is a dead or misbehaving producer's word; keep it in the slot.
+			out_.append(pool_->data(i), std::min<size_t>(s.size, pool_->slotSize()), &span);
+		}
+		pool_->release(i);
+	}
+	if (!batch_.empty())
+		out_.flushIndex();
+	if (uint64_t drops = pool_->header().drops.exchange(0, std::memory_order_relaxed))
+		out_.add_dropped(drops);
+	return batch_.size();
+}
+
+void ShmCollector::reclaim()
+{
+	if (size_t n = pool_->reclaimDead())
+	{
+		reclaimed_.fetch_add(n, std::memory_order_relaxed);
+		char msg[96];
+		int len = std::snprintf(msg, sizeof(msg), "reclaimed: %zu buffers from exited producers\n", n);
+		if (len > 0)
+			out_.append(msg, static_cast<size_t>(len));
+	}
+}
@@ -0,0 +1,235 @@
+#include "ShmPool.h"
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <ctime>
+#include <new>
+#include <system_error>
+#include <thread>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free,
+							"shared-memory atomics must be address-free");
+
+namespace
+{
+	constexpr size_t kPage = 4096;
+
+	size_t roundUp(size_t n, size_t to)
+	{
+		return (n + to - 1) / to * to;
+	}
+
+	uint64_t word(pid_t pid, ShmPool::State state)
+	{
+		return static_cast<uint64_t>(pid) << 32 | state;
+	}
+
+	long futex(std::atomic<uint32_t> *addr, int op, uint32_t val, const timespec *timeout)
+	{
+		return ::syscall(SYS_futex, reinterpret_cast<uint32_t *>(addr), op, val, timeout, nullptr, 0);
+	}
+
+	[[noreturn]] void fail(const char *what)
+	{
+		throw std::system_error(errno, std::generic_category(), what);
+	}
+}
+
+std::unique_ptr<ShmPool> ShmPool::open(const std::string &name, uint32_t slots, size_t slotSize)
+{
+	int fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+	const bool created = fd >= 0;
+	if (!created && errno == EEXIST)
+		fd = ::shm_open(name.c_str(), O_RDWR | O_CLOEXEC, 0600);
+	if (fd < 0)
+		fail("shm_open");
+
+	size_t bytes = 0;
+	if (created)
+	{
+		slotSize = roundUp(slotSize, kPage);
+		const size_t dataOffset = roundUp(sizeof(Header) + slots * sizeof(Slot), kPage);
+		bytes = dataOffset + slots * slotSize;
+		if (::ftruncate(fd, static_cast<off_t>(bytes)) != 0)
+		{
+			int err = errno;
+			::close(fd);
+			::shm_unlink(name.c_str());
+			errno = err;
+			fail("ftruncate");
+		}
+	}
+	else
+	{
+		// The creator sizes the object before it initializes the header.
+		struct stat st{};
+		for (int i = 0; i < 1000 && ::fstat(fd, &st) == 0 && st.st_size == 0; i++)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		bytes = static_cast<size_t>(st.st_size);
+		if (bytes < sizeof(Header))
+		{
+			::close(fd);
+			errno = EINVAL;
+			fail("shm pool not initialized");
+		}
+	}
+
+	void *p = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (p == MAP_FAILED)
+		fail("mmap");
+	std::unique_ptr<ShmPool> pool(new ShmPool(static_cast<char *>(p), bytes));
+
+	Header *h = pool->header_;
+	if (created)
+	{
+		// ftruncate() zero-fills, which is every slot Free.
+		new (h) Header{};
+		h->slots = slots;
+		h->slotSize = slotSize;
+		h->dataOffset = roundUp(sizeof(Header) + slots * sizeof(Slot), kPage);
+		h->freeSlots.store(slots, std::memory_order_relaxed);
+		for (uint32_t i = 0; i < slots; i++)
+			new (&pool->slots_[i]) Slot{};
+		h->magic.store(kMagic, std::memory_order_release);
+	}
+	else
+	{
+		for (int i = 0; i < 1000 && h->magic.load(std::memory_order_acquire) != kMagic; i++)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		if (h->magic.load(std::memory_order_acquire) != kMagic ||
+				h->dataOffset + static_cast<size_t>(h->slots) * h->slotSize > bytes)
+		{
+			errno = EINVAL;
+			fail("shm pool header");
+		}
+	}
+	pool->lastSubmits_ = h->submits.load(std::memory_order_relaxed);
+	return pool;
+}
+
+void ShmPool::unlink(const std::string &name)
+{
+	::shm_unlink(name.c_str());
+}
+
+ShmPool::ShmPool(char *base, size_t bytes)
+		: base_(base), bytes_(bytes), header_(reinterpret_cast<Header *>(base)),
+			slots_(reinterpret_cast<Slot *>(base + sizeof(Header)))
+{
+}
+
+ShmPool::~ShmPool()
+{
+	::munmap(base_, bytes_);
+}
+
+int64_t ShmPool::claim()
+{
+	if (header_->freeSlots.load(std::memory_order_relaxed) == 0)
+		return -1;
+	// Not cached: a process that forks after mapping the pool must claim
+	// under the child's pid, or reclaimDead() never sees its slots die.
+	const pid_t pid = ::getpid();
+	const uint32_t n = header_->slots;
+	const uint32_t start = header_->cursor.fetch_add(1, std::memory_order_relaxed);
+	for (uint32_t k = 0; k < n; k++)
+	{
+		const uint32_t i = (start + k) % n;
+		uint64_t expected = word(0, Free);
+		if (slots_[i].word.load(std::memory_order_relaxed) == expected &&
+				slots_[i].word.compare_exchange_strong(expected, word(pid, Held), std::memory_order_acquire))
+		{
+			header_->freeSlots.fetch_sub(1, std::memory_order_relaxed);
+			return i;
+		}
+	}
+	return -1;
+}
+
+void ShmPool::submit(uint32_t i, size_t size, size_t lines, int64_t firstNs, int64_t lastNs)
+{
+	Slot &s = slots_[i];
+	// acq_rel: a collector that sees this seq also sees this process's
+	// earlier submits (see collectSubmitted()).
+	s.seq = header_->nextSeq.fetch_add(1, std::memory_order_acq_rel);
+	s.size = size;
+	s.lines = lines;
+	s.firstNs = firstNs;
+	s.lastNs = lastNs;
+	// Keeps the owner claim() recorded.
+	const auto owner = static_cast<pid_t>(s.word.load(std::memory_order_relaxed) >> 32);
+	s.word.store(word(owner, Submitted), std::memory_order_release);
+	header_->submits.fetch_add(1, std::memory_order_release);
+	if (header_->collectorWaiting.load(std::memory_order_seq_cst))
+		futex(&header_->submits, FUTEX_WAKE, 1, nullptr);
+}
+
+void ShmPool::waitForSubmits(std::chrono::milliseconds timeout)
+{
+	header_->collectorWaiting.store(1, std::memory_order_seq_cst);
+	const uint32_t seen = header_->submits.load(std::memory_order_acquire);
+	if (seen == lastSubmits_)
+	{
+		timespec ts{static_cast<time_t>(timeout.count() / 1000), static_cast<long>(timeout.count() % 1000 * 1000000)};
+		futex(&header_->submits, FUTEX_WAIT, seen, &ts);
+	}
+	header_->collectorWaiting.store(0, std::memory_order_relaxed);
+	lastSubmits_ = header_->submits.load(std::memory_order_acquire);
+}
+
+void ShmPool::wake()
+{
+	header_->submits.fetch_add(1, std::memory_order_release);
+	futex(&header_->submits, FUTEX_WAKE, 1, nullptr);
+}
+
+// The scan is not atomic: a slot read as Held may be submitted, and the same
+// thread's next buffer submitted at a later index, before the scan gets
+// there. Only seqs handed out before the scan started are taken. A thread's
+// earlier submit finished before it took a later seq, so if that seq is
+// below the snapshot, the earlier slot is already Submitted.
+void ShmPool::collectSubmitted(std::vector<uint32_t> &out) const
+{
+	out.clear();
+	const uint64_t before = header_->nextSeq.load(std::memory_order_acquire);
+	for (uint32_t i = 0; i < header_->slots; i++)
+		if ((slots_[i].word.load(std::memory_order_acquire) & 0xffffffff) == Submitted && slots_[i].seq < before)
+			out.push_back(i);
+	std::sort(out.begin(), out.end(), [this](uint32_t a, uint32_t b)
+						{ return slots_[a].seq < slots_[b].seq; });
+}
+
+void ShmPool::release(uint32_t i)
+{
+	slots_[i].word.store(word(0, Free), std::memory_order_release);
+	header_->freeSlots.fetch_add(1, std::memory_order_relaxed);
+}
+
+// A pid reused by an unrelated process between the owner's death and the
+// sweep keeps its slots until that process exits too.
+size_t ShmPool::reclaimDead()
+{
+	size_t freed = 0;
+	for (uint32_t i = 0; i < header_->slots; i++)
+	{
+		uint64_t w = slots_[i].word.load(std::memory_order_acquire);
+		if ((w & 0xffffffff) != Held)
+			continue;
+		const auto owner = static_cast<pid_t>(w >> 32);
+		if (::kill(owner, 0) == 0 || errno != ESRCH)
+			continue;
+		if (slots_[i].word.compare_exchange_strong(w, word(0, Free), std::memory_order_acq_rel))
+		{
+			header_->freeSlots.fetch_add(1, std::memory_order_relaxed);
+			freed++;
+		}
+	}
+	return freed;
+}
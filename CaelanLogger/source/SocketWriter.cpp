@@ -0,0 +1,199 @@
+#include "SocketWriter.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/un.h>
+
+namespace
+{
+  constexpr std::chrono::milliseconds kFirstBackoff{10};
+}
+
+SocketWriter::SocketWriter(std::string dir, const BackendConfig &cfg)
+    : FileUtil<SocketWriter>(std::move(dir)), sendTimeout_(cfg.socketSendTimeout), maxBackoff_(cfg.socketMaxBackoff)
+{
+  const std::string &sink = cfg.socketSink;
+  std::string path;
+  if (sink.rfind("unix:", 0) == 0)
+    path = sink.substr(5);
+  else if (sink.rfind("unix-stream:", 0) == 0)
+  {
+    path = sink.substr(12);
+    type_ = SOCK_STREAM;
+  }
+  else if (sink.rfind("udp:", 0) == 0)
+  {
+    const size_t colon = sink.rfind(':');
+    auto *in = reinterpret_cast<sockaddr_in *>(&addr_);
+    in->sin_family = AF_INET;
+    const std::string host = sink.substr(4, colon - 4);
+    char *end = nullptr;
+    const unsigned long port = std::strtoul(sink.c_str() + colon + 1, &end, 10);
+    if (colon < 4 || *end || port == 0 || port > 65535 || ::inet_pton(AF_INET, host.c_str(), &in->sin_addr) != 1)
+      throw std::invalid_argument("bad udp socket sink: " + sink);
+    in->sin_port = htons(static_cast<uint16_t>(port));
+    addrLen_ = sizeof(sockaddr_in);
+    return;
+  }
+  else
+    throw std::invalid_argument("unknown socket sink: " + sink);
+
+  auto *un = reinterpret_cast<sockaddr_un *>(&addr_);
+  if (path.empty() || path.size() >= sizeof(un->sun_path))
+    throw std::invalid_argument("bad unix socket path: " + sink);
+  un->sun_family = AF_UNIX;
+  std::memcpy(un->sun_path, path.c_str(), path.size() + 1);
+  addrLen_ = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + path.size() + 1);
+}
+
+SocketWriter::~SocketWriter()
+{
+  disconnect();
+}
+
+bool SocketWriter::connect()
+{
+  if (LogTime::steadyNanos() < retryAtNs_)
+    return false;
+  sock_ = ::socket(addr_.ss_family, type_ | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (sock_ >= 0 && ::connect(sock_, reinterpret_cast<const sockaddr *>(&addr_), addrLen_) == 0)
+  {
+    backoff_ = std::chrono::milliseconds(0);
+    if (connectedOnce_)
+      reconnects_.fetch_add(1, std::memory_order_relaxed);
+    connectedOnce_ = true;
+    return true;
+  }
+  disconnect();
+  backoff_ = std::min(maxBackoff_, backoff_.count() ? backoff_ * 2 : kFirstBackoff);
+  retryAtNs_ = LogTime::steadyNanos() + std::chrono::duration_cast<std::chrono::nanoseconds>(backoff_).count();
+  return false;
+}
+
+void SocketWriter::disconnect()
+{
+  if (sock_ >= 0)
+  {
+    ::close(sock_);
+    sock_ = -1;
+  }
+}
+
+bool SocketWriter::waitWritable()
+{
+  pollfd p{sock_, POLLOUT, 0};
+  int n;
+  do
+    n = ::poll(&p, 1, static_cast<int>(sendTimeout_.count()));
+  while (n < 0 && errno == EINTR);
+  return n > 0 && (p.revents & POLLOUT);
+}
+
+void SocketWriter::append(const char *data, size_t len, const TimeSpan *)
+{
+  if (sock_ < 0 && !connect())
+  {
+    dropBytes(len);
+    return;
+  }
+  writtenBytes += len;
+  if (type_ == SOCK_STREAM)
+    sendStream(data, len);
+  else
+    sendDatagrams(data, len);
+}
+
+void SocketWriter::sendDatagrams(const char *data, size_t len)
+{
+  mmsghdr msgs[kBatch];
+  iovec iovs[kBatch];
+  size_t pos = 0;
+  while (pos < len)
+  {
+    size_t count = 0;
+    for (; count < kBatch && pos < len; count++)
+    {
+      size_t chunk = std::min(len - pos, kMaxDatagram);
+      // Cut after the window's last line; a line longer than a datagram is
+      // split.
+      if (pos + chunk < len)
+        if (const void *nl = ::memrchr(data + pos, '\n', chunk))
+          chunk = static_cast<size_t>(static_cast<const char *>(nl) - (data + pos)) + 1;
+      iovs[count] = {const_cast<char *>(data + pos), chunk};
+      msgs[count] = {};
+      msgs[count].msg_hdr.msg_iov = &iovs[count];
+      msgs[count].msg_hdr.msg_iovlen = 1;
+      pos += chunk;
+    }
+
+    size_t sent = 0;
+    while (sent < count)
+    {
+      int n = ::sendmmsg(sock_, msgs + sent, static_cast<unsigned>(count - sent), MSG_NOSIGNAL);
+      writeCalls_.fetch_add(1, std::memory_order_relaxed);
+      if (n > 0)
+      {
+        sent += static_cast<size_t>(n);
+        continue;
+      }
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n < 0 && (errno == EAGAIN || errno == ENOBUFS) && waitWritable())
+        continue;
+      // Full past the timeout, or the receiver is gone (ECONNREFUSED,
+      // ENOENT after it restarted): drop this buffer's rest.
+      if (n < 0 && errno != EAGAIN && errno != ENOBUFS)
+        disconnect();
+      size_t lost = len - pos;
+      for (size_t i = sent; i < count; i++)
+        lost += iovs[i].iov_len;
+      dropBytes(lost);
+      return;
+    }
+  }
+}
+
+void SocketWriter::sendStream(const char *data, size_t len)
+{
+  iovec iov{const_cast<char *>(data), len};
+  msghdr msg{};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  while (iov.iov_len > 0)
+  {
+    ssize_t n = ::sendmsg(sock_, &msg, MSG_NOSIGNAL);
+    writeCalls_.fetch_add(1, std::memory_order_relaxed);
+    if (n > 0)
+    {
+      iov.iov_base = static_cast<char *>(iov.iov_base) + n;
+      iov.iov_len -= static_cast<size_t>(n);
+      continue;
+    }
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0 && errno == EAGAIN && waitWritable())
+      continue;
+    // Whatever follows a cut line would be glued onto it: start over on a
+    // new connection instead.
+    dropBytes(iov.iov_len);
+    disconnect();
+    return;
+  }
+}
+
+void SocketWriter::writeDropMessage(const char *msg, int len)
+{
+  append(msg, static_cast<size_t>(len));
+}
+
+void SocketWriter::roll()
+{
+  size_t n = dropped_.exchange(0, std::memory_order_relaxed);
+  char msg[64];
+  int len = std::snprintf(msg, sizeof(msg), "dropped: %zu\n", n);
+  if (len > 0)
+    writeDropMessage(msg, len);
+}
@@ -0,0 +1,60 @@
+#include "ThreadPlacement.h"
+#include <cerrno>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace
+{
+	// From linux/ioprio.h, which not every libc ships.
+	constexpr int kIoprioWhoProcess = 1;
+	constexpr int kIoprioClassShift = 13;
+}
+
+int applyThreadPlacement(const ThreadPlacement &p, const std::string &defaultName)
+{
+	int err = 0;
+	auto fail = [&err](int e)
+	{
+		if (!err)
+			err = e;
+	};
+	const pid_t tid = static_cast<pid_t>(::syscall(SYS_gettid));
+
+	const std::string &name = p.name.empty() ? defaultName : p.name;
+	if (!name.empty())
+		if (int rc = ::pthread_setname_np(::pthread_self(), name.substr(0, 15).c_str()))
+			fail(rc);
+
+	if (!p.cpus.empty())
+	{
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		for (int cpu : p.cpus)
+			if (cpu >= 0 && cpu < CPU_SETSIZE)
+				CPU_SET(cpu, &set);
+		if (int rc = ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set))
+			fail(rc);
+	}
+
+	if (p.policy >= 0)
+	{
+		sched_param sp{};
+		sp.sched_priority = p.priority;
+		if (int rc = ::pthread_setschedparam(::pthread_self(), p.policy, &sp))
+			fail(rc);
+	}
+
+	if (p.nice && ::setpriority(PRIO_PROCESS, static_cast<id_t>(tid), *p.nice) != 0)
+		fail(errno);
+
+	if (p.ioprioClass > 0)
+	{
+		int prio = (p.ioprioClass << kIoprioClassShift) | (p.ioprioLevel & 7);
+		if (::syscall(SYS_ioprio_set, kIoprioWhoProcess, tid, prio) != 0)
+			fail(errno);
+	}
+	return err;
+}
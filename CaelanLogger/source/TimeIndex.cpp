@@ -0,0 +1,66 @@
+#include "TimeIndex.h"
+#include <algorithm>
+#include <fstream>
+
+namespace fs = std::filesystem;
+
+std::vector<TimeRangeHit> findTimeRange(const std::vector<fs::path> &segments, int64_t fromNs, int64_t toNs)
+{
+	std::vector<TimeRangeHit> hits;
+	std::vector<TimeIndexRecord> records;
+	for (const auto &segment : segments)
+	{
+		std::ifstream in(segment.string() + kTimeIndexSuffix, std::ios::binary);
+		if (!in)
+			continue;
+
+		in.seekg(0, std::ios::end);
+		// A record torn by a crash mid-write is ignored.
+		records.resize(static_cast<size_t>(in.tellg()) / sizeof(TimeIndexRecord));
+		in.seekg(0);
+		in.read(reinterpret_cast<char *>(records.data()), records.size() * sizeof(TimeIndexRecord));
+
+		bool open = false;
+		for (const auto &r : records)
+		{
+			if (r.lastNs < fromNs || r.firstNs > toNs)
+			{
+				open = false;
+				continue;
+			}
+			if (open && hits.back().offset + hits.back().length == r.offset)
+			{
+				hits.back().length += r.length;
+				hits.back().lines += r.lines;
+				continue;
+			}
+			hits.push_back({segment, r.offset, r.length, r.lines});
+			open = true;
+		}
+	}
+	return hits;
+}
+
+std::vector<TimeRangeHit> findTimeRange(const fs::path &dir, int64_t fromNs, int64_t toNs)
+{
+	std::vector<fs::path> segments;
+	std::error_code ec;
+	for (const auto &e : fs::directory_iterator(dir, ec))
+	{
+		if (e.is_regular_file() && e.path().extension() != kTimeIndexSuffix &&
+				fs::exists(e.path().string() + kTimeIndexSuffix))
+			segments.push_back(e.path());
+	}
+	std::sort(segments.begin(), segments.end());
+	return findTimeRange(segments, fromNs, toNs);
+}
+
+std::string readTimeRange(const TimeRangeHit &hit)
+{
+	std::string out(hit.length, '\0');
+	std::ifstream in(hit.segment, std::ios::binary);
+	in.seekg(static_cast<std::streamoff>(hit.offset));
+	in.read(out.data(), static_cast<std::streamsize>(out.size()));
+	out.resize(static_cast<size_t>(in.gcount()));
+	return out;
+}
@@ -105,4 +105,41 @@ namespace LogTime
         return std::string(buf, static_cast<size_t>(n));
     }
 
+    int64_t nowNanos()
+    {
+        timespec ts{};
+        ::clock_gettime(CLOCK_REALTIME, &ts);
+        return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+    }
+
+    int64_t steadyNanos()
+    {
+        timespec ts{};
+        ::clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+    }
+
+    int64_t coarseNowNanos()
+    {
+        timespec ts{};
+#if defined(CLOCK_REALTIME_COARSE)
+        ::clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+#else
+        ::clock_gettime(CLOCK_REALTIME, &ts);
+#endif
+        return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+    }
+
+    std::string dateString(int64_t epochNs)
+    {
+        const std::time_t sec = static_cast<std::time_t>(epochNs / 1000000000);
+        const int ms = static_cast<int>(epochNs % 1000000000 / 1000000);
+
+        const char *prefix = CachedDateTimePrefix(sec);
+
+        char buf[32];
+        const int n = std::snprintf(buf, sizeof(buf), "%s.%03d", prefix, ms);
+        return std::string(buf, static_cast<size_t>(n));
+    }
+
 } // namespace LogTime
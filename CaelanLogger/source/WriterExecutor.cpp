@@ -0,0 +1,136 @@
+#include "WriterExecutor.h"
+#include <algorithm>
+#include <string>
+
+WriterExecutor::WriterExecutor(size_t threads, ThreadPlacement placement)
+		: placement_(std::move(placement))
+{
+	if (placement_.name.empty())
+		placement_.name = "cae-exec";
+	for (size_t slot = 0; slot < std::max<size_t>(1, threads); slot++)
+		threads_.emplace_back(&WriterExecutor::run, this, slot);
+}
+
+WriterExecutor::~WriterExecutor()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		running_ = false;
+	}
+	cv_.notify_all();
+	for (auto &t : threads_)
+		t.join();
+}
+
+void WriterExecutor::registerTask(WriterTask *task)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		tasks_.push_back(task);
+	}
+	notify();
+}
+
+void WriterExecutor::unregisterTask(WriterTask *task)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		auto it = std::find(tasks_.begin(), tasks_.end(), task);
+		if (it == tasks_.end())
+			return;
+		tasks_.erase(it);
+	}
+	// Claims happen under mutex_, so no new one can start now.
+	while (task->busy_.test(std::memory_order_acquire))
+		std::this_thread::yield();
+}
+
+size_t WriterExecutor::taskCount() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return tasks_.size();
+}
+
+// Same handshake as SharedBackend::wakeWriter(): the producer's fence after
+// its push pairs with the one park() issues after raising parked_.
+bool WriterExecutor::notify()
+{
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (parked_.load(std::memory_order_relaxed) == 0)
+		return false;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+	}
+	cv_.notify_one();
+	return true;
+}
+
+WriterTask *WriterExecutor::claim(size_t &visited)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	while (running_ && visited < tasks_.size())
+	{
+		WriterTask *task = tasks_[cursor_++ % tasks_.size()];
+		visited++;
+		if (!task->busy_.test_and_set(std::memory_order_acquire))
+			return task;
+	}
+	return nullptr;
+}
+
+void WriterExecutor::park()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	parked_.fetch_add(1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	// A task another thread is serving does not count: that thread passes
+	// again before it parks.
+	auto predicate = [this]
+	{
+		return !running_ || std::any_of(tasks_.begin(), tasks_.end(), [](WriterTask *t)
+																		{ return !t->busy_.test(std::memory_order_acquire) && t->pending(); });
+	};
+	if (!predicate())
+	{
+		std::chrono::milliseconds timeout{0};
+		for (WriterTask *t : tasks_)
+		{
+			auto idle = t->idleTimeout();
+			if (idle.count() > 0 && (timeout.count() == 0 || idle < timeout))
+				timeout = idle;
+		}
+		if (timeout.count() > 0)
+			cv_.wait_for(lock, timeout, predicate);
+		else
+			cv_.wait(lock, predicate);
+	}
+	parked_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void WriterExecutor::run(size_t slot)
+{
+	ThreadPlacement placement = placement_;
+	placement.name += "-" + std::to_string(slot);
+	if (applyThreadPlacement(placement, placement.name) != 0)
+		placementFailures_.fetch_add(1, std::memory_order_relaxed);
+
+	while (true)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (!running_)
+				break;
+		}
+		size_t served = 0;
+		size_t visited = 0;
+		while (WriterTask *task = claim(visited))
+		{
+			served += task->pending();
+			task->serve();
+			task->busy_.clear(std::memory_order_release);
+		}
+		passes_.fetch_add(1, std::memory_order_relaxed);
+		if (served == 0)
+			park();
+	}
+}
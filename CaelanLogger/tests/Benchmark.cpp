@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <cctype>
 #include <chrono>
 #include <cmath>
 #include <cstdlib>
@@ -9,11 +10,14 @@
 #include <iostream>
 #include <mutex>
 #include <sstream>
+#include <stdexcept>
 #include <string>
 #include <thread>
 #include <vector>
 
 #include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
 #include <unistd.h>
 
 #include "AsyncLogger.h"
@@ -32,7 +36,14 @@ struct BenchConfig
     int workRounds = 512;
     int handoffEvery = 256;
     std::size_t asyncBufferSize = 128 * 1024;
+    std::size_t queueSize = 32;
     std::string payload = std::string(256, 'X');
+    // AsyncLogger only: producer t is pinned to producerCpus[t % size()];
+    // empty leaves producers unpinned.
+    std::vector<int> producerCpus;
+    // AsyncLogger only: every errorEvery-th line is logged at ERROR instead
+    // of INFO; 0 logs everything at INFO.
+    int errorEvery = 0;
 };
 
 struct BenchResult
@@ -43,6 +54,22 @@ struct BenchResult
     std::size_t logged = 0;
     std::size_t dropped = 0;
     std::uint64_t checksum = 0;
+    // AsyncLogger only: writer-side view from logger.metrics().
+    std::uint64_t rolls = 0;
+    double cycleMaxUs = 0.0;
+    double rollMaxUs = 0.0;
+    // Log bytes still resident in the page cache right after shutdown; < 0
+    // when not measured.
+    double cachedKB = -1.0;
+    double wakeupsPerHandoff = 0.0;
+    double handoffAvgNs = 0.0;
+    // AsyncLogger only: p99 of the per-call latency across producers; 0 when
+    // not measured.
+    double producerP99Ns = 0.0;
+    // Buffer age from first line to handoff, writer pickup and write.
+    AgeStats handoffAge;
+    AgeStats pickupAge;
+    AgeStats writeAge;
 };
 
 static void reset_dir(const fs::path &dir)
@@ -70,6 +97,35 @@ static std::vector<fs::path> files_in_dir(const fs::path &dir)
     return files;
 }
 
+// Sums the page-cache-resident part of every file in dir (mmap + mincore).
+// Must run before anything reads the files back.
+static double page_cache_kb(const fs::path &dir)
+{
+    const long page = ::sysconf(_SC_PAGESIZE);
+    std::size_t resident = 0;
+    for (const auto &p : files_in_dir(dir))
+    {
+        int fd = ::open(p.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            continue;
+        const std::size_t size = static_cast<std::size_t>(fs::file_size(p));
+        if (size > 0)
+        {
+            void *map = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+            if (map != MAP_FAILED)
+            {
+                std::vector<unsigned char> vec((size + page - 1) / page);
+                if (::mincore(map, size, vec.data()) == 0)
+                    for (unsigned char v : vec)
+                        resident += v & 1;
+                ::munmap(map, size);
+            }
+        }
+        ::close(fd);
+    }
+    return static_cast<double>(resident) * page / 1024.0;
+}
+
 static std::string read_all_files(const fs::path &dir)
 {
     std::string out;
@@ -222,8 +278,9 @@ static BenchResult run_sync(const BenchConfig &cfg, const fs::path &dir, const s
     return r;
 }
 
+template <typename BackendT = SharedBackend>
 static BenchResult run_async(const BenchConfig &cfg, const fs::path &dir, const std::string &token,
-                             bool verbose = true)
+                             bool verbose = true, const BackendConfig &backendCfg = {})
 {
     reset_dir(dir);
 
@@ -236,7 +293,7 @@ static BenchResult run_async(const BenchConfig &cfg, const fs::path &dir, const
     const std::size_t attempted =
         static_cast<std::size_t>(cfg.threads) * static_cast<std::size_t>(cfg.linesPerThread);
 
-    AsyncLogger<SharedBackend> logger(cfg.asyncBufferSize, 32, dir.string());
+    AsyncLogger<BackendT> logger(cfg.asyncBufferSize, cfg.queueSize, dir.string(), backendCfg);
 
     std::vector<std::thread> threads;
     std::vector<std::uint64_t> checksums(cfg.threads, 0);
@@ -250,16 +307,24 @@ static BenchResult run_async(const BenchConfig &cfg, const fs::path &dir, const
                              {
             std::uint64_t local = 0;
             threadLats[t].reserve(cfg.linesPerThread);
+            if (!cfg.producerCpus.empty())
+            {
+                ThreadPlacement pin;
+                pin.cpus = {cfg.producerCpus[t % cfg.producerCpus.size()]};
+                applyThreadPlacement(pin, "");
+            }
 
             for (int i = 0; i < cfg.linesPerThread; ++i)
             {
                 local ^= do_work(cfg.workRounds, static_cast<std::uint64_t>(t) << 32 | static_cast<std::uint64_t>(i));
 
+                const auto level = cfg.errorEvery && i % cfg.errorEvery == 0 ? CaelanLogger::ERROR
+                                                                             : CaelanLogger::INFO;
                 auto t0 = std::chrono::steady_clock::now();
-                LOG_TO(logger, INFO) << token
-                                     << " T=" << t
-                                     << " I=" << i
-                                     << " " << cfg.payload;
+                LogStream(logger.tls(), level) << token
+                                               << " T=" << t
+                                               << " I=" << i
+                                               << " " << cfg.payload;
                 auto t1 = std::chrono::steady_clock::now();
                 threadLats[t].push_back(
                     std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
@@ -275,22 +340,30 @@ static BenchResult run_async(const BenchConfig &cfg, const fs::path &dir, const
 
     auto producersDone = std::chrono::steady_clock::now();
 
-    if (verbose)
-    {
-        std::vector<long long> allLat;
-        allLat.reserve(static_cast<std::size_t>(cfg.threads) * cfg.linesPerThread);
-        for (auto &v : threadLats)
-            allLat.insert(allLat.end(), v.begin(), v.end());
-        std::sort(allLat.begin(), allLat.end());
+    std::vector<long long> allLat;
+    allLat.reserve(static_cast<std::size_t>(cfg.threads) * cfg.linesPerThread);
+    for (auto &v : threadLats)
+        allLat.insert(allLat.end(), v.begin(), v.end());
+    std::sort(allLat.begin(), allLat.end());
+    auto pct = [&](double p) {
+        return allLat.empty() ? 0 : allLat[static_cast<std::size_t>(p / 100.0 * (allLat.size() - 1))];
+    };
 
-        auto pct = [&](double p) {
-            return allLat[static_cast<std::size_t>(p / 100.0 * (allLat.size() - 1))];
-        };
+    if (verbose && !allLat.empty())
+    {
         std::cout << "\n[AsyncLogger per-call latency (ns)]\n"
                   << "  p50=" << pct(50) << "  p95=" << pct(95)
                   << "  p99=" << pct(99) << "  max=" << allLat.back() << "\n";
     }
 
+    // Let the writer finish the backlog so the snapshot covers every roll.
+    MetricsSnapshot m = logger.metrics();
+    for (int i = 0; i < 2000 && (m.submittedDepth != 0 || m.freeDepth != m.poolCapacity); ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        m = logger.metrics();
+    }
+
     logger.shutdownAll();
 
     auto end = std::chrono::steady_clock::now();
@@ -299,6 +372,7 @@ static BenchResult run_async(const BenchConfig &cfg, const fs::path &dir, const
     for (auto x : checksums)
         checksum ^= x;
 
+    const double cachedKB = page_cache_kb(dir);
     const std::string logs = read_all_files(dir);
 
     // CAELAN_LOG_DIR overrides every FileUtil-derived logger's dir_ regardless
@@ -318,6 +392,16 @@ static BenchResult run_async(const BenchConfig &cfg, const fs::path &dir, const
     r.logged = count_occurrences(logs, token);
     r.dropped = count_dropped_delta(logs);
     r.checksum = checksum;
+    r.rolls = m.rolls;
+    r.cycleMaxUs = m.cycleNsMax / 1000.0;
+    r.rollMaxUs = m.rollNsMax / 1000.0;
+    r.cachedKB = cachedKB;
+    r.wakeupsPerHandoff = m.wakeupsPerHandoff();
+    r.handoffAvgNs = m.avgHandoffNs();
+    r.producerP99Ns = static_cast<double>(pct(99));
+    r.handoffAge = m.handoffAge;
+    r.pickupAge = m.pickupAge;
+    r.writeAge = m.writeAge;
     return r;
 }
 
@@ -444,12 +528,38 @@ static void print_stats(const std::string &label, const RunStats &s, const std::
               << "  max=" << std::setw(12) << s.max << unit << "\n";
 }
 
+static void add_ages(AgeStats &into, const AgeStats &from)
+{
+    for (std::size_t i = 0; i < kAgeBuckets; ++i)
+        into.buckets[i] += from.buckets[i];
+}
+
+// One row per stage: percentiles (bucket upper edges) over every run's buffers.
+static void print_ages(const AgeStats &handoff, const AgeStats &pickup, const AgeStats &write)
+{
+    auto row = [](const char *label, const AgeStats &a)
+    {
+        std::cout << "  " << std::left << std::setw(22) << label << std::right
+                  << "p50<=" << std::setw(9) << a.percentileUs(50) << " us"
+                  << "  p90<=" << std::setw(9) << a.percentileUs(90) << " us"
+                  << "  p99<=" << std::setw(9) << a.percentileUs(99) << " us"
+                  << "  max<=" << std::setw(9) << a.percentileUs(100) << " us"
+                  << "  (" << a.count() << " buffers)\n";
+    };
+    row("buffer age at handoff", handoff);
+    row("buffer age at pickup", pickup);
+    row("buffer age at write", write);
+}
+
 // Runs `fn` `runs` times, resetting its own log dir each time, and prints
 // mean/stddev/min/max across the runs instead of one noisy line per run.
 static void run_many(const std::string &name, int runs, const std::function<BenchResult()> &fn)
 {
     std::vector<double> producerMs, endToEndMs, dropPct, producerLps, endToEndLps;
+    std::vector<double> cycleMaxUs, rollMaxUs, cachedKB, wakeups, handoffNs, producerP99;
     std::size_t attempted = 0;
+    std::uint64_t rolls = 0;
+    AgeStats handoffAge, pickupAge, writeAge;
 
     for (int i = 0; i < runs; ++i)
     {
@@ -467,6 +577,18 @@ static void run_many(const std::string &name, int runs, const std::function<Benc
         dropPct.push_back(100.0 * static_cast<double>(r.dropped) / static_cast<double>(r.attempted));
         producerLps.push_back(r.attempted / (r.producerMs / 1000.0));
         endToEndLps.push_back(r.attempted / (r.endToEndMs / 1000.0));
+        cycleMaxUs.push_back(r.cycleMaxUs);
+        rollMaxUs.push_back(r.rollMaxUs);
+        if (r.cachedKB >= 0)
+            cachedKB.push_back(r.cachedKB);
+        wakeups.push_back(r.wakeupsPerHandoff);
+        handoffNs.push_back(r.handoffAvgNs);
+        if (r.producerP99Ns > 0)
+            producerP99.push_back(r.producerP99Ns);
+        rolls += r.rolls;
+        add_ages(handoffAge, r.handoffAge);
+        add_ages(pickupAge, r.pickupAge);
+        add_ages(writeAge, r.writeAge);
     }
 
     std::cout << "\n[" << name << "]  (n=" << runs << ", attempted/run=" << attempted << ")\n";
@@ -475,10 +597,258 @@ static void run_many(const std::string &name, int runs, const std::function<Benc
     print_stats("dropped", summarize(dropPct), " %");
     print_stats("producer lines/sec", summarize(producerLps), "");
     print_stats("end-to-end lines/sec", summarize(endToEndLps), "");
+    if (!producerP99.empty())
+        print_stats("producer call p99", summarize(producerP99), " ns");
+    // Only meaningful when the scenario actually rolls mid-run.
+    if (rolls > static_cast<std::uint64_t>(runs))
+    {
+        print_stats("writer cycle max", summarize(cycleMaxUs), " us");
+        print_stats("roll max", summarize(rollMaxUs), " us");
+    }
+    if (!cachedKB.empty())
+    {
+        print_stats("page cache after run", summarize(cachedKB), " KB");
+        print_stats("notifies per handoff", summarize(wakeups), "");
+        print_stats("handoff avg", summarize(handoffNs), " ns");
+        print_ages(handoffAge, pickupAge, writeAge);
+    }
+}
+
+// Resident set size of this process, from /proc/self/statm.
+static double rss_kb()
+{
+    std::ifstream in("/proc/self/statm");
+    std::size_t size = 0, resident = 0;
+    in >> size >> resident;
+    return static_cast<double>(resident) * ::sysconf(_SC_PAGESIZE) / 1024.0;
+}
+
+// RSS of one logger's life: constructed, after a burst of logging, then while
+// it sits idle. Shows what lazyBuffers and idleRelease give back.
+static void run_rss_timeline(const std::string &name, const BenchConfig &cfg, std::size_t poolSize,
+                             const fs::path &dir, const std::string &token, const BackendConfig &backendCfg)
+{
+    reset_dir(dir);
+    const double before = rss_kb();
+    std::vector<std::pair<std::string, double>> points;
+    {
+        AsyncLogger<SharedBackend> logger(cfg.asyncBufferSize, poolSize, dir.string(), backendCfg);
+        points.emplace_back("constructed", rss_kb() - before);
+
+        std::vector<std::thread> threads;
+        for (int t = 0; t < cfg.threads; ++t)
+            threads.emplace_back([&, t]
+                                 {
+                for (int i = 0; i < cfg.linesPerThread; ++i)
+                    LOG_TO(logger, INFO) << token << " T=" << t << " I=" << i << " " << cfg.payload;
+                logger.shutdownTL(); });
+        for (auto &th : threads)
+            th.join();
+        points.emplace_back("burst", rss_kb() - before);
+
+        auto idleStart = std::chrono::steady_clock::now();
+        for (int ms : {100, 250, 500, 1000})
+        {
+            std::this_thread::sleep_until(idleStart + std::chrono::milliseconds(ms));
+            points.emplace_back("idle " + std::to_string(ms) + "ms", rss_kb() - before);
+        }
+        logger.shutdownAll();
+    }
+
+    std::cout << "\n[RSS over time: " << name << "]  (" << poolSize << " x "
+              << (cfg.asyncBufferSize / 1024) << " KB pool, KB above start)\n ";
+    for (const auto &[label, kb] : points)
+        std::cout << " " << label << "=" << std::fixed << std::setprecision(0) << kb;
+    std::cout << "\n";
+}
+
+// Sweep mode: the AsyncLogger scenario over a grid of thread counts, payload
+// sizes, buffer sizes and pool sizes, one CSV row per point (medians over
+// --runs). Each point logs the same total line count, split across threads.
+struct SweepConfig
+{
+    std::vector<int> threads; // empty: 1, 2, 4, ... up to 2x cores
+    std::vector<std::size_t> payloads{64, 256, 1024};
+    std::vector<std::size_t> bufferSizes{32 * 1024, 128 * 1024, 512 * 1024};
+    std::vector<std::size_t> poolSizes{8, 32, 128};
+    std::size_t totalLines = 400'000;
+    int runs = 3;
+    std::string csvPath; // empty: stdout
+};
+
+static const char *kSweepUsage =
+    "usage: caelogger_bench --sweep [--config file] [--threads 1,2,4] [--payload 64,256]\n"
+    "                       [--buffer 32K,128K] [--pool 8,32] [--lines N] [--runs N] [--csv path]\n"
+    "A config file holds the same keys without dashes, one \"key = value\" per line.\n";
+
+// "64", "32K", "1M" -> bytes.
+static std::size_t parse_size(const std::string &s)
+{
+    std::size_t pos = 0;
+    std::size_t n = std::stoull(s, &pos);
+    if (pos < s.size())
+    {
+        char unit = static_cast<char>(std::toupper(static_cast<unsigned char>(s[pos])));
+        if (unit == 'K')
+            n *= 1024;
+        else if (unit == 'M')
+            n *= 1024 * 1024;
+        else
+            throw std::invalid_argument("bad size: " + s);
+    }
+    return n;
+}
+
+static std::vector<std::size_t> parse_size_list(const std::string &s)
+{
+    std::vector<std::size_t> out;
+    std::stringstream ss(s);
+    std::string item;
+    while (std::getline(ss, item, ','))
+        if (!item.empty())
+            out.push_back(parse_size(item));
+    return out;
+}
+
+static void apply_sweep_option(SweepConfig &sc, const std::string &key, const std::string &value)
+{
+    if (key == "threads")
+    {
+        sc.threads.clear();
+        for (std::size_t n : parse_size_list(value))
+            sc.threads.push_back(static_cast<int>(n));
+    }
+    else if (key == "payload")
+        sc.payloads = parse_size_list(value);
+    else if (key == "buffer")
+        sc.bufferSizes = parse_size_list(value);
+    else if (key == "pool")
+        sc.poolSizes = parse_size_list(value);
+    else if (key == "lines")
+        sc.totalLines = parse_size(value);
+    else if (key == "runs")
+        sc.runs = std::max(1, std::stoi(value));
+    else if (key == "csv")
+        sc.csvPath = value;
+    else
+        throw std::invalid_argument("unknown sweep option: " + key);
+}
+
+static void load_sweep_file(SweepConfig &sc, const std::string &path)
+{
+    std::ifstream in(path);
+    if (!in)
+        throw std::invalid_argument("cannot read " + path);
+    std::string line;
+    while (std::getline(in, line))
+    {
+        line = line.substr(0, line.find('#'));
+        auto eq = line.find('=');
+        if (eq == std::string::npos)
+            continue;
+        auto trim = [](std::string s)
+        {
+            s.erase(0, s.find_first_not_of(" \t"));
+            s.erase(s.find_last_not_of(" \t\r") + 1);
+            return s;
+        };
+        apply_sweep_option(sc, trim(line.substr(0, eq)), trim(line.substr(eq + 1)));
+    }
+}
+
+static double median(std::vector<double> v)
+{
+    std::sort(v.begin(), v.end());
+    return v.empty() ? 0.0 : v[v.size() / 2];
 }
 
-int main()
+static int run_sweep(SweepConfig sc)
 {
+    if (sc.threads.empty())
+    {
+        const int maxThreads = 2 * static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+        for (int t = 1; t < maxThreads; t *= 2)
+            sc.threads.push_back(t);
+        sc.threads.push_back(maxThreads);
+    }
+
+    std::ofstream file;
+    if (!sc.csvPath.empty())
+        file.open(sc.csvPath);
+    std::ostream &csv = sc.csvPath.empty() ? std::cout : file;
+    csv << "threads,payload_bytes,buffer_bytes,pool,lines,runs,"
+           "producer_lines_sec,end_to_end_lines_sec,end_to_end_ms,drop_pct\n";
+
+    const fs::path dir = "/tmp/caelan_bench_sweep";
+    const std::string token = "<<SWEEP_BENCH_TOKEN>>";
+    const std::size_t points = sc.threads.size() * sc.payloads.size() * sc.bufferSizes.size() * sc.poolSizes.size();
+    std::size_t done = 0;
+
+    for (std::size_t pool : sc.poolSizes)
+        for (std::size_t buffer : sc.bufferSizes)
+            for (std::size_t payload : sc.payloads)
+                for (int threads : sc.threads)
+                {
+                    BenchConfig cfg;
+                    cfg.threads = threads;
+                    cfg.linesPerThread = static_cast<int>(sc.totalLines / threads);
+                    cfg.payload = std::string(payload, 'X');
+                    cfg.asyncBufferSize = buffer;
+                    cfg.queueSize = pool;
+
+                    std::vector<double> producerLps, endToEndLps, endToEndMs, dropPct;
+                    for (int r = 0; r < sc.runs; ++r)
+                    {
+                        BenchResult res = run_async(cfg, dir, token, /*verbose=*/false);
+                        producerLps.push_back(res.attempted / (res.producerMs / 1000.0));
+                        endToEndLps.push_back(res.attempted / (res.endToEndMs / 1000.0));
+                        endToEndMs.push_back(res.endToEndMs);
+                        dropPct.push_back(100.0 * static_cast<double>(res.dropped) / static_cast<double>(res.attempted));
+                    }
+                    csv << threads << "," << payload << "," << buffer << "," << pool << ","
+                        << static_cast<std::size_t>(cfg.threads) * cfg.linesPerThread << "," << sc.runs << ","
+                        << std::fixed << std::setprecision(1) << median(producerLps) << ","
+                        << median(endToEndLps) << "," << std::setprecision(2) << median(endToEndMs) << ","
+                        << std::setprecision(3) << median(dropPct) << std::endl;
+                    std::cerr << "[" << ++done << "/" << points << "] threads=" << threads
+                              << " payload=" << payload << " buffer=" << buffer << " pool=" << pool << "\n";
+                }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1)
+    {
+        if (std::string(argv[1]) != "--sweep")
+        {
+            std::cerr << kSweepUsage;
+            return 2;
+        }
+        SweepConfig sc;
+        try
+        {
+            for (int i = 2; i < argc; i += 2)
+            {
+                std::string key = argv[i];
+                if (key.rfind("--", 0) != 0 || i + 1 >= argc)
+                    throw std::invalid_argument("bad argument: " + key);
+                key = key.substr(2);
+                if (key == "config")
+                    load_sweep_file(sc, argv[i + 1]);
+                else
+                    apply_sweep_option(sc, key, argv[i + 1]);
+            }
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << e.what() << "\n"
+                      << kSweepUsage;
+            return 2;
+        }
+        return run_sweep(sc);
+    }
+
     const BenchConfig cfg;
     constexpr int kRuns = 20;
 
@@ -516,6 +886,167 @@ int main()
              [&] { return run_sync(cfg, syncDir, syncToken); });
     run_many("AsyncLogger (CaelanLogger, SharedBackend)", kRuns,
              [&] { return run_async(cfg, asyncDir, asyncToken, /*verbose=*/false); });
+    {
+        BackendConfig pool;
+        pool.writerThreads = 4;
+        run_many("AsyncLogger (4 pwrite writers)", kRuns,
+                 [&] { return run_async(cfg, asyncDir, asyncToken, /*verbose=*/false, pool); });
+    }
+    {
+        BackendConfig ordered;
+        ordered.orderedOutput = true;
+        run_many("AsyncLogger (ordered output)", kRuns,
+                 [&] { return run_async(cfg, asyncDir, asyncToken, /*verbose=*/false, ordered); });
+    }
+    {
+        // Roll every 4 MB so each run crosses several segment boundaries.
+        BackendConfig inlineRoll;
+        inlineRoll.maxFileSize = 4 * 1024 * 1024;
+        BackendConfig preopened = inlineRoll;
+        preopened.preallocateSegments = true;
+        run_many("AsyncLogger (4 MB segments, inline roll)", kRuns,
+                 [&] { return run_async(cfg, asyncDir, asyncToken, /*verbose=*/false, inlineRoll); });
+        run_many("AsyncLogger (4 MB segments, preallocated roll)", kRuns,
+                 [&] { return run_async(cfg, asyncDir, asyncToken, /*verbose=*/false, preopened); });
+    }
+    {
+        BackendConfig direct;
+        direct.directIO = true;
+        run_many("AsyncLogger (O_DIRECT writer)", kRuns,
+                 [&] { return run_async(cfg, asyncDir, asyncToken, /*verbose=*/false, direct); });
+    }
+    {
+        BackendConfig spin;
+        spin.writerSpin = std::chrono::microseconds(50);
+        BackendConfig poll;
+        poll.writerBusyPoll = true;
+        run_many("AsyncLogger (writer spins 50 us before parking)", kRuns,
+                 [&] { return run_async(cfg, asyncDir, asyncToken, /*verbose=*/false, spin); });
+        run_many("AsyncLogger (busy-poll writer)", kRuns,
+                 [&] { return run_async(cfg, asyncDir, asyncToken, /*verbose=*/false, poll); });
+    }
+    // Handoff contention: the same total line count from 8 to 64 producers,
+    // shared MPSC queue vs. one SPSC ring per producer. Fewer runs each.
+    for (int threads : {8, 32, 64})
+    {
+        BenchConfig wide = cfg;
+        wide.threads = threads;
+        wide.linesPerThread = cfg.threads * cfg.linesPerThread / threads;
+        BackendConfig rings;
+        rings.perProducerRings = true;
+        const std::string tag = "AsyncLogger (" + std::to_string(threads) + " threads, ";
+        run_many(tag + "shared MPSC queue)", kRuns / 4,
+                 [&] { return run_async(wide, asyncDir, asyncToken, /*verbose=*/false); });
+        run_many(tag + "per-producer SPSC rings)", kRuns / 4,
+                 [&] { return run_async(wide, asyncDir, asyncToken, /*verbose=*/false, rings); });
+    }
+    // Deliberate overload: no work between lines and a two-buffer pool, so
+    // nearly every call is a drop. Measures what the drop path costs when
+    // the system is already behind.
+    for (int threads : {4, 16})
+    {
+        BenchConfig flood = cfg;
+        flood.threads = threads;
+        flood.linesPerThread = 200'000;
+        flood.workRounds = 0;
+        flood.asyncBufferSize = 16 * 1024;
+        flood.queueSize = 2;
+        run_many("AsyncLogger (overloaded, " + std::to_string(threads) + " threads, 2 x 16 KB pool)", kRuns / 4,
+                 [&] { return run_async(flood, asyncDir, asyncToken, /*verbose=*/false); });
+    }
+    // Freshness vs. throughput: smaller buffers reach the file sooner but
+    // cost more handoffs and writes.
+    for (std::size_t kb : {16, 128, 1024})
+    {
+        BenchConfig sized = cfg;
+        sized.asyncBufferSize = kb * 1024;
+        run_many("AsyncLogger (" + std::to_string(kb) + " KB buffers)", kRuns / 4,
+                 [&] { return run_async(sized, asyncDir, asyncToken, /*verbose=*/false); });
+    }
+    // Writer placement: sharing a core with a producer vs. a core of its own.
+    // The producers get every allowed CPU but the last in both cases.
+    {
+        cpu_set_t allowed;
+        std::vector<int> cpus;
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0)
+            for (int c = 0; c < CPU_SETSIZE; ++c)
+                if (CPU_ISSET(c, &allowed))
+                    cpus.push_back(c);
+        if (cpus.size() < 2)
+        {
+            std::cout << "\n[AsyncLogger writer placement] skipped: needs at least 2 CPUs\n";
+        }
+        else
+        {
+            BenchConfig pinned = cfg;
+            pinned.producerCpus.assign(cpus.begin(), cpus.end() - 1);
+            BackendConfig shared;
+            shared.writerPlacement.cpus = {cpus.front()};
+            BackendConfig isolated;
+            isolated.writerPlacement.cpus = {cpus.back()};
+            run_many("AsyncLogger (writer on a producer's CPU)", kRuns / 4,
+                     [&] { return run_async(pinned, asyncDir, asyncToken, /*verbose=*/false, shared); });
+            run_many("AsyncLogger (writer on its own CPU)", kRuns / 4,
+                     [&] { return run_async(pinned, asyncDir, asyncToken, /*verbose=*/false, isolated); });
+        }
+    }
+    // Urgent ERROR handoff: throughput as the share of ERROR lines grows, and
+    // with an fdatasync() per urgent cycle.
+    {
+        BackendConfig urgent;
+        urgent.urgentHandoff = true;
+        BackendConfig synced = urgent;
+        synced.syncUrgent = true;
+        for (int every : {0, 1000, 100, 10})
+        {
+            BenchConfig mix = cfg;
+            mix.errorEvery = every;
+            std::ostringstream rate;
+            if (every)
+                rate << 100.0 / every << "% ERROR";
+            else
+                rate << "no ERROR";
+            run_many("AsyncLogger urgent handoff (" + rate.str() + ")", kRuns / 4,
+                     [&] { return run_async(mix, asyncDir, asyncToken, /*verbose=*/false, urgent); });
+        }
+        BenchConfig mix = cfg;
+        mix.errorEvery = 100;
+        run_many("AsyncLogger urgent handoff + fdatasync (1% ERROR)", kRuns / 4,
+                 [&] { return run_async(mix, asyncDir, asyncToken, /*verbose=*/false, synced); });
+    }
+    // Idle memory: the same burst with eager buffers, lazy buffers, and lazy
+    // buffers released after 200 ms idle.
+    {
+        BenchConfig burst = cfg;
+        burst.linesPerThread = 5'000;
+        constexpr std::size_t kPool = 128;
+        BackendConfig lazy;
+        lazy.lazyBuffers = true;
+        BackendConfig released = lazy;
+        released.idleRelease = std::chrono::milliseconds(200);
+        run_rss_timeline("eager buffers", burst, kPool, asyncDir, asyncToken, {});
+        run_rss_timeline("lazy buffers", burst, kPool, asyncDir, asyncToken, lazy);
+        run_rss_timeline("lazy buffers, 200 ms idle release", burst, kPool, asyncDir, asyncToken, released);
+    }
+    // Compile-time policy matrix: each BasicSharedBackend combination is a
+    // separately instantiated pipeline. Fewer runs each.
+    {
+        using LockFree = BasicSharedBackend<LockFreeQueues>;
+        using FixedWriter = BasicSharedBackend<SpinLockQueues, NormalWriter>;
+        using Coarse = BasicSharedBackend<SpinLockQueues, ConfiguredWriter, CoarseRealtimeClock>;
+        using Waiting = BasicSharedBackend<SpinLockQueues, ConfiguredWriter, RealtimeClock, WaitWhenFull>;
+        using AllNonDefault = BasicSharedBackend<LockFreeQueues, NormalWriter, CoarseRealtimeClock, WaitWhenFull>;
+        run_many("AsyncLogger policies (lock-free queues)", kRuns / 4,
+                 [&] { return run_async<LockFree>(cfg, asyncDir, asyncToken, /*verbose=*/false); });
+        run_many("AsyncLogger policies (fixed NormalWriter)", kRuns / 4,
+                 [&] { return run_async<FixedWriter>(cfg, asyncDir, asyncToken, /*verbose=*/false); });
+        run_many("AsyncLogger policies (coarse clock)", kRuns / 4,
+                 [&] { return run_async<Coarse>(cfg, asyncDir, asyncToken, /*verbose=*/false); });
+        run_many("AsyncLogger policies (wait when full)", kRuns / 4,
+                 [&] { return run_async<Waiting>(cfg, asyncDir, asyncToken, /*verbose=*/false); });
+        run_many("AsyncLogger policies (lock-free, NormalWriter, coarse clock, wait)", kRuns / 4,
+                 [&] { return run_async<AllNonDefault>(cfg, asyncDir, asyncToken, /*verbose=*/false); });
+    }
     run_many("spdlog async (1 thread, overrun_oldest)", kRuns,
              [&] { return run_spdlog_async(cfg, spdlogDir, spdlogToken, spdlogQueue, /*verbose=*/false); });
 
@@ -0,0 +1,480 @@
+// Component microbenchmarks: each hot piece of the pipeline timed on its own,
+// so a change can be pinned to Buffer, LogStream formatting, the clock, a
+// queue or the backend handoff. Whole-pipeline numbers live in Benchmark.cpp.
+//
+//   caelogger_microbench [--filter substr] [--reps N] [--json out.json] [--csv out.csv]
+//
+// compare_microbench.py diffs two JSON/CSV outputs and flags regressions.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "AsyncLogger.h"
+#include "Buffer.h"
+#include "LocalQueue.h"
+#include "MPMCQueue.h"
+#include "MPSCSpinLockQueue.h"
+#include "SPMCSpinLockQueue.h"
+#include "SPSCQueue.h"
+#include "SharedBackend.h"
+#include "TimeUtil.h"
+
+namespace fs = std::filesystem;
+
+struct MicroResult
+{
+    std::string name;
+    int threads = 1;
+    std::uint64_t ops = 0;
+    double nsPerOp = 0.0;    // median over reps
+    double minNsPerOp = 0.0; // best rep
+};
+
+struct MicroOptions
+{
+    std::string filter;
+    int reps = 7;
+    std::string jsonPath;
+    std::string csvPath;
+};
+
+// Keeps the compiler from dropping a computation whose result is unused.
+template <typename T>
+static void keep(const T &v)
+{
+    asm volatile("" : : "r,m"(v) : "memory");
+}
+
+// A user type logged through its formatter, and the std::string it would
+// otherwise be converted to.
+enum class BenchSide
+{
+    Buy,
+    Sell,
+};
+
+struct BenchQuote
+{
+    std::uint64_t id;
+    long long cents;
+    BenchSide side;
+};
+
+namespace CaelanLogger
+{
+    template <>
+    struct formatter<BenchQuote>
+    {
+        static constexpr size_t max_size = 2 * formatter<long long>::max_size + formatter<BenchSide>::max_size + 3;
+
+        template <typename Out>
+        static void format(Out &out, const BenchQuote &q)
+        {
+            formatValue(out, q.id);
+            out.put(' ');
+            formatValue(out, q.side);
+            out.put(' ');
+            formatValue(out, q.cents / 100);
+            out.put('.');
+            out.put(static_cast<char>('0' + q.cents % 100 / 10));
+            out.put(static_cast<char>('0' + q.cents % 10));
+        }
+    };
+}
+
+static std::string to_string(const BenchQuote &q)
+{
+    return std::to_string(q.id) + ' ' + (q.side == BenchSide::Buy ? "Buy" : "Sell") + ' ' +
+           std::to_string(q.cents / 100) + '.' + std::to_string(q.cents % 100 / 10) + std::to_string(q.cents % 10);
+}
+
+// Producer-side stand-in for SharedBackend: submit() recycles the buffer on
+// the spot and nothing is written, so LogStream and ThreadLogger are timed
+// without the writer.
+class SinkBackend
+{
+public:
+    using Ring = SubmitRing;
+    using Clock = RealtimeClock;
+    static constexpr bool kWaitForBuffers = false;
+
+    SinkBackend(size_t bufSize, size_t, std::string = "", BackendConfig = {})
+    {
+        for (size_t i = 0; i < 2; i++)
+        {
+            auto buf = std::make_unique<Buffer>(bufSize);
+            buf->setIdx(i);
+            free_.push_back(std::move(buf));
+        }
+    }
+
+    std::unique_ptr<Buffer> acquire() { return tryAcquire(); }
+    std::unique_ptr<Buffer> tryAcquire()
+    {
+        if (free_.empty())
+            return nullptr;
+        auto buf = std::move(free_.back());
+        free_.pop_back();
+        return buf;
+    }
+    std::unique_ptr<Buffer> acquireOverflow(size_t) { return nullptr; }
+    bool growOverflow(Buffer &, size_t) { return false; }
+    void submit(std::unique_ptr<Buffer> buf, Ring * = nullptr)
+    {
+        if (!buf)
+            return;
+        buf->reset();
+        free_.push_back(std::move(buf));
+    }
+    int urgentLevel() const { return CaelanLogger::FATAL + 1; }
+    uint64_t submitUrgent(std::unique_ptr<Buffer> buf, Ring *ring = nullptr)
+    {
+        submit(std::move(buf), ring);
+        return 0;
+    }
+    bool awaitWritten(size_t, uint64_t) const { return false; }
+    void record_drop() {}
+    Ring *registerRing() { return nullptr; }
+    void unregisterRing(Ring *) {}
+    ProducerCounters *registerProducer() { return &counters_; }
+    void unregisterProducer(ProducerCounters *) {}
+    MetricsSnapshot metrics() const { return {}; }
+    bool orderedOutput() const { return false; }
+    const LinePattern &linePattern() const { return pattern_; }
+    const std::string &loggerName() const { return name_; }
+
+private:
+    std::vector<std::unique_ptr<Buffer>> free_;
+    ProducerCounters counters_;
+    LinePattern pattern_;
+    std::string name_;
+};
+
+// Times body() reps times; body performs ops operations per call.
+static MicroResult measure(const std::string &name, int threads, std::uint64_t ops, int reps,
+                           const std::function<void()> &body)
+{
+    body(); // warm-up
+    std::vector<double> perOp;
+    for (int r = 0; r < reps; ++r)
+    {
+        auto start = std::chrono::steady_clock::now();
+        body();
+        auto end = std::chrono::steady_clock::now();
+        perOp.push_back(std::chrono::duration<double, std::nano>(end - start).count() / static_cast<double>(ops));
+    }
+    std::sort(perOp.begin(), perOp.end());
+
+    MicroResult res;
+    res.name = name;
+    res.threads = threads;
+    res.ops = ops;
+    res.nsPerOp = perOp[perOp.size() / 2];
+    res.minNsPerOp = perOp.front();
+    return res;
+}
+
+// Single-threaded push+pop pairs; one op is one pair.
+template <typename Q>
+static std::function<void()> queue_pairs(std::uint64_t ops)
+{
+    return [ops]
+    {
+        Q q(64);
+        for (std::uint64_t i = 0; i < ops; ++i)
+        {
+            q.push(static_cast<size_t>(i));
+            keep(q.pop());
+        }
+    };
+}
+
+// producers push ops items in total, consumers pop them all; one op is one
+// item through the queue. A full or empty queue is retried after a yield, so
+// the numbers stay meaningful when threads outnumber cores.
+template <typename Q>
+static std::function<void()> queue_contended(int producers, int consumers, std::uint64_t ops)
+{
+    return [=]
+    {
+        Q q(1024);
+        std::atomic<std::uint64_t> popped{0};
+        std::vector<std::thread> threads;
+        const std::uint64_t perProducer = ops / producers;
+        const std::uint64_t total = perProducer * producers;
+        for (int p = 0; p < producers; ++p)
+            threads.emplace_back([&]
+                                 {
+                for (std::uint64_t i = 0; i < perProducer; ++i)
+                    while (!q.push(static_cast<size_t>(i)))
+                        std::this_thread::yield(); });
+        for (int c = 0; c < consumers; ++c)
+            threads.emplace_back([&]
+                                 {
+                while (popped.load(std::memory_order_relaxed) < total)
+                {
+                    if (q.pop())
+                        popped.fetch_add(1, std::memory_order_relaxed);
+                    else
+                        std::this_thread::yield();
+                } });
+        for (auto &t : threads)
+            t.join();
+    };
+}
+
+// acquire + submit of an empty buffer per op, with the real writer thread
+// recycling them; producers retry while the pool is empty.
+static std::function<void()> backend_roundtrip(int producers, std::uint64_t ops, const fs::path &dir)
+{
+    return [=]
+    {
+        SharedBackend backend(4096, 32, dir.string());
+        std::vector<std::thread> threads;
+        const std::uint64_t perProducer = ops / producers;
+        for (int p = 0; p < producers; ++p)
+            threads.emplace_back([&]
+                                 {
+                for (std::uint64_t i = 0; i < perProducer; ++i)
+                {
+                    std::unique_ptr<Buffer> buf;
+                    while (!(buf = backend.tryAcquire()))
+                        std::this_thread::yield();
+                    backend.submit(std::move(buf));
+                } });
+        for (auto &t : threads)
+            t.join();
+    };
+}
+
+template <typename F>
+static std::function<void()> logstream_lines(std::uint64_t ops, F &&line)
+{
+    return [ops, line]
+    {
+        SinkBackend backend(64 * 1024, 2);
+        ThreadLogger<SinkBackend> tl(64 * 1024, &backend);
+        for (std::uint64_t i = 0; i < ops; ++i)
+            line(&tl, i);
+    };
+}
+
+static void write_json(const std::string &path, const std::vector<MicroResult> &results)
+{
+    std::ofstream out(path);
+    out << "{\n  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const MicroResult &r = results[i];
+        out << "    {\"name\": \"" << r.name << "\", \"threads\": " << r.threads
+            << ", \"ops\": " << r.ops << std::fixed << std::setprecision(3)
+            << ", \"ns_per_op\": " << r.nsPerOp << ", \"min_ns_per_op\": " << r.minNsPerOp << "}"
+            << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n}\n";
+}
+
+static void write_csv(const std::string &path, const std::vector<MicroResult> &results)
+{
+    std::ofstream out(path);
+    out << "name,threads,ops,ns_per_op,min_ns_per_op\n";
+    for (const MicroResult &r : results)
+        out << r.name << "," << r.threads << "," << r.ops << "," << std::fixed << std::setprecision(3)
+            << r.nsPerOp << "," << r.minNsPerOp << "\n";
+}
+
+static MicroOptions parse_args(int argc, char **argv)
+{
+    MicroOptions opt;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        auto next = [&]() -> std::string
+        {
+            if (i + 1 >= argc)
+            {
+                std::cerr << arg << " needs a value\n";
+                std::exit(2);
+            }
+            return argv[++i];
+        };
+        if (arg == "--filter")
+            opt.filter = next();
+        else if (arg == "--reps")
+            opt.reps = std::max(1, std::stoi(next()));
+        else if (arg == "--json")
+            opt.jsonPath = next();
+        else if (arg == "--csv")
+            opt.csvPath = next();
+        else
+        {
+            std::cerr << "usage: " << argv[0] << " [--filter substr] [--reps N] [--json path] [--csv path]\n";
+            std::exit(2);
+        }
+    }
+    return opt;
+}
+
+int main(int argc, char **argv)
+{
+    const MicroOptions opt = parse_args(argc, argv);
+    const fs::path backendDir = "/tmp/caelan_microbench";
+    fs::create_directories(backendDir);
+
+    struct Case
+    {
+        std::string name;
+        int threads;
+        std::uint64_t ops;
+        std::function<void()> body;
+    };
+    std::vector<Case> cases;
+    const std::string payload16(16, 'x');
+    const std::string payload64(64, 'x');
+
+    constexpr std::uint64_t kSmall = 1'000'000;
+    constexpr std::uint64_t kQueue = 2'000'000;
+    constexpr std::uint64_t kContended = 500'000;
+
+    cases.push_back({"buffer/add_16B", 1, kSmall, [&]
+                     {
+                         Buffer buf(64 * 1024);
+                         for (std::uint64_t i = 0; i < kSmall; ++i)
+                         {
+                             if (buf.remaining() < payload16.size())
+                                 buf.reset();
+                             buf.add(payload16.data(), payload16.size());
+                         }
+                         keep(buf.size());
+                     }});
+    cases.push_back({"buffer/add_char", 1, kSmall, []
+                     {
+                         Buffer buf(64 * 1024);
+                         for (std::uint64_t i = 0; i < kSmall; ++i)
+                         {
+                             if (buf.remaining() == 0)
+                                 buf.reset();
+                             buf.add('x');
+                         }
+                         keep(buf.size());
+                     }});
+
+    cases.push_back({"time/nowNanos", 1, kSmall, []
+                     {
+                         for (std::uint64_t i = 0; i < kSmall; ++i)
+                             keep(LogTime::nowNanos());
+                     }});
+    cases.push_back({"time/coarseNowNanos", 1, kSmall, []
+                     {
+                         for (std::uint64_t i = 0; i < kSmall; ++i)
+                             keep(LogTime::coarseNowNanos());
+                     }});
+    cases.push_back({"time/nowDateString", 1, kSmall, []
+                     {
+                         for (std::uint64_t i = 0; i < kSmall; ++i)
+                             keep(LogTime::nowDateString());
+                     }});
+    cases.push_back({"time/dateString", 1, kSmall, []
+                     {
+                         const int64_t base = LogTime::nowNanos();
+                         for (std::uint64_t i = 0; i < kSmall; ++i)
+                             keep(LogTime::dateString(base + static_cast<int64_t>(i) * 1000));
+                     }});
+
+    // Compiled prefixes rendered into a scratch buffer: the default pattern,
+    // one with every per-thread field, and the callsite fields as text and as
+    // an id.
+    for (const auto &[tag, pattern] : {std::pair<std::string, std::string>{"default", LinePattern::kDefault},
+                                       {"thread_fields", "%L %D %T.%u [%t %N] %n pid=%P "},
+                                       {"source_function", "%L %D %T.%f %s %F "},
+                                       {"callsite_id", "%L %D %T.%f #%i "}})
+    {
+        cases.push_back({"prefix/" + tag, 1, kSmall, [pattern]
+                         {
+                             PrefixRenderer prefix(LinePattern(pattern), "bench");
+                             const Callsite *site = CAELAN_CALLSITE();
+                             std::vector<char> out(prefix.maxSize(site));
+                             const int64_t base = LogTime::nowNanos();
+                             for (std::uint64_t i = 0; i < kSmall; ++i)
+                                 keep(prefix.render(out.data(), CaelanLogger::INFO, base + static_cast<int64_t>(i) * 1000, site));
+                         }});
+    }
+
+    // Level + timestamp only; subtract from the cases below for the cost of
+    // the inserted values.
+    cases.push_back({"logstream/empty_line", 1, kSmall, logstream_lines(kSmall, [](ThreadLogger<SinkBackend> *tl, std::uint64_t)
+                                                                        { LogStream<SinkBackend>(tl, CaelanLogger::INFO); })});
+    cases.push_back({"logstream/int", 1, kSmall, logstream_lines(kSmall, [](ThreadLogger<SinkBackend> *tl, std::uint64_t i)
+                                                                 { LogStream<SinkBackend>(tl, CaelanLogger::INFO) << static_cast<int>(i); })});
+    cases.push_back({"logstream/int_x8", 1, kSmall, logstream_lines(kSmall, [](ThreadLogger<SinkBackend> *tl, std::uint64_t i)
+                                                                    {
+                         int v = static_cast<int>(i);
+                         LogStream<SinkBackend>(tl, CaelanLogger::INFO) << v << v << v << v << v << v << v << v; })});
+    cases.push_back({"logstream/double", 1, kSmall, logstream_lines(kSmall, [](ThreadLogger<SinkBackend> *tl, std::uint64_t i)
+                                                                    { LogStream<SinkBackend>(tl, CaelanLogger::INFO) << static_cast<double>(i) * 0.25; })});
+    cases.push_back({"logstream/string_64B", 1, kSmall, logstream_lines(kSmall, [payload64](ThreadLogger<SinkBackend> *tl, std::uint64_t)
+                                                                        { LogStream<SinkBackend>(tl, CaelanLogger::INFO) << payload64; })});
+
+    // The same quote through its formatter and through a std::string.
+    cases.push_back({"logstream/quote_formatter", 1, kSmall, logstream_lines(kSmall, [](ThreadLogger<SinkBackend> *tl, std::uint64_t i)
+                                                                            { LogStream<SinkBackend>(tl, CaelanLogger::INFO) << BenchQuote{i, 12345, BenchSide::Sell}; })});
+    cases.push_back({"logstream/quote_to_string", 1, kSmall, logstream_lines(kSmall, [](ThreadLogger<SinkBackend> *tl, std::uint64_t i)
+                                                                             { LogStream<SinkBackend>(tl, CaelanLogger::INFO) << to_string(BenchQuote{i, 12345, BenchSide::Sell}); })});
+
+    cases.push_back({"queue/local_pair", 1, kQueue, queue_pairs<LocalQueue<size_t>>(kQueue)});
+    cases.push_back({"queue/spsc_pair", 1, kQueue, queue_pairs<SPSCQueue<size_t>>(kQueue)});
+    cases.push_back({"queue/mpsc_spinlock_pair", 1, kQueue, queue_pairs<MPSCSpinLockQueue<size_t>>(kQueue)});
+    cases.push_back({"queue/spmc_spinlock_pair", 1, kQueue, queue_pairs<SPMCSpinLockQueue<size_t>>(kQueue)});
+    cases.push_back({"queue/mpmc_pair", 1, kQueue, queue_pairs<MPMCQueue<size_t>>(kQueue)});
+
+    cases.push_back({"queue/spsc_1p1c", 2, kContended, queue_contended<SPSCQueue<size_t>>(1, 1, kContended)});
+    for (int p : {2, 4, 8})
+    {
+        const std::string tag = std::to_string(p) + "p1c";
+        cases.push_back({"queue/mpsc_spinlock_" + tag, p + 1, kContended, queue_contended<MPSCSpinLockQueue<size_t>>(p, 1, kContended)});
+        cases.push_back({"queue/mpmc_" + tag, p + 1, kContended, queue_contended<MPMCQueue<size_t>>(p, 1, kContended)});
+    }
+    cases.push_back({"queue/spmc_spinlock_1p4c", 5, kContended, queue_contended<SPMCSpinLockQueue<size_t>>(1, 4, kContended)});
+    cases.push_back({"queue/mpmc_1p4c", 5, kContended, queue_contended<MPMCQueue<size_t>>(1, 4, kContended)});
+
+    constexpr std::uint64_t kBackend = 200'000;
+    for (int p : {1, 4})
+        cases.push_back({"backend/acquire_submit_" + std::to_string(p) + "p", p + 1, kBackend,
+                         backend_roundtrip(p, kBackend, backendDir)});
+
+    std::vector<MicroResult> results;
+    std::cout << std::left << std::setw(32) << "benchmark" << std::right << std::setw(8) << "threads"
+              << std::setw(14) << "ns/op" << std::setw(14) << "min ns/op" << "\n";
+    for (const Case &c : cases)
+    {
+        if (!opt.filter.empty() && c.name.find(opt.filter) == std::string::npos)
+            continue;
+        MicroResult r = measure(c.name, c.threads, c.ops, opt.reps, c.body);
+        std::cout << std::left << std::setw(32) << r.name << std::right << std::setw(8) << r.threads
+                  << std::fixed << std::setprecision(2) << std::setw(14) << r.nsPerOp
+                  << std::setw(14) << r.minNsPerOp << std::endl;
+        results.push_back(std::move(r));
+    }
+
+    if (!opt.jsonPath.empty())
+        write_json(opt.jsonPath, results);
+    if (!opt.csvPath.empty())
+        write_csv(opt.csvPath, results);
+
+    std::error_code ec;
+    fs::remove_all(backendDir, ec);
+    return 0;
+}
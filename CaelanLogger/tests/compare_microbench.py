@@ -0,0 +1,79 @@
+#!/usr/bin/env python3
+"""Compare two caelogger_microbench outputs (JSON or CSV) and flag regressions.
+
+    caelogger_microbench --json current.json
+    python3 compare_microbench.py baseline.json current.json --threshold 10
+
+Exits 1 when any benchmark's median ns/op rose by more than --threshold
+percent over the baseline. With --update the current results replace the
+baseline file afterwards.
+"""
+
+import argparse
+import csv
+import json
+import shutil
+import sys
+from pathlib import Path
+
+
+def load_results(path: Path) -> dict:
+    if path.suffix == ".csv":
+        with path.open(newline="") as f:
+            rows = list(csv.DictReader(f))
+    else:
+        rows = json.loads(path.read_text())["results"]
+    return {
+        row["name"]: {
+            "ns_per_op": float(row["ns_per_op"]),
+            "min_ns_per_op": float(row["min_ns_per_op"]),
+        }
+        for row in rows
+    }
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("baseline", type=Path)
+    parser.add_argument("current", type=Path)
+    parser.add_argument("--threshold", type=float, default=10.0,
+                        help="regression threshold in percent of median ns/op (default 10)")
+    parser.add_argument("--use-min", action="store_true",
+                        help="compare the best rep instead of the median (steadier on noisy hosts)")
+    parser.add_argument("--update", action="store_true",
+                        help="overwrite the baseline with the current results when done")
+    args = parser.parse_args()
+
+    baseline = load_results(args.baseline)
+    current = load_results(args.current)
+    key = "min_ns_per_op" if args.use_min else "ns_per_op"
+
+    regressions = []
+    print(f"{'benchmark':32} {'baseline':>12} {'current':>12} {'delta':>9}")
+    for name, cur in current.items():
+        base = baseline.get(name)
+        if base is None:
+            print(f"{name:32} {'-':>12} {cur[key]:12.2f} {'new':>9}")
+            continue
+        delta = (cur[key] - base[key]) / base[key] * 100.0 if base[key] > 0 else 0.0
+        flag = ""
+        if delta > args.threshold:
+            flag = "  REGRESSION"
+            regressions.append(name)
+        elif delta < -args.threshold:
+            flag = "  improved"
+        print(f"{name:32} {base[key]:12.2f} {cur[key]:12.2f} {delta:+8.1f}%{flag}")
+    for name in baseline.keys() - current.keys():
+        print(f"{name:32} {baseline[name][key]:12.2f} {'-':>12} {'missing':>9}")
+
+    if args.update:
+        shutil.copyfile(args.current, args.baseline)
+
+    if regressions:
+        print(f"\n{len(regressions)} regression(s) over {args.threshold:.0f}%: {', '.join(regressions)}")
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -3,7 +3,9 @@
 import argparse
 import csv
 import re
+import shlex
 import statistics
+from collections import defaultdict
 import subprocess
 import sys
 from pathlib import Path
@@ -193,12 +195,99 @@ def write_summary(results_csv: Path, summary_csv: Path):
             ])
 
 
+def load_sweep(sweep_csv: Path) -> list:
+    with sweep_csv.open(newline="") as f:
+        rows = list(csv.DictReader(f))
+    for r in rows:
+        for k in ("threads", "payload_bytes", "buffer_bytes", "pool", "lines", "runs"):
+            r[k] = int(r[k])
+        for k in ("producer_lines_sec", "end_to_end_lines_sec", "end_to_end_ms", "drop_pct"):
+            r[k] = float(r[k])
+    return rows
+
+
+def find_knee(curve: list, min_gain: float, max_drop_pct: float):
+    """First thread count after which adding threads stops paying off: the
+    next point gains less than min_gain (relative), or drops appear."""
+    for prev, cur in zip(curve, curve[1:]):
+        if cur["drop_pct"] > max_drop_pct:
+            return prev["threads"], f"drops {cur['drop_pct']:.2f}% at {cur['threads']} threads"
+        gain = cur["end_to_end_lines_sec"] / prev["end_to_end_lines_sec"] - 1.0
+        if gain < min_gain:
+            return prev["threads"], f"{gain * 100:+.0f}% from {prev['threads']} to {cur['threads']} threads"
+    return curve[-1]["threads"], "still scaling at the largest thread count"
+
+
+def summarize_sweep(sweep_csv: Path, out_dir: Path, plot: bool, min_gain: float, max_drop_pct: float):
+    rows = load_sweep(sweep_csv)
+    curves = defaultdict(list)
+    for r in rows:
+        curves[(r["payload_bytes"], r["buffer_bytes"], r["pool"])].append(r)
+
+    summary_csv = out_dir / "sweep_summary.csv"
+    with summary_csv.open("w", newline="") as f:
+        writer = csv.writer(f)
+        writer.writerow(["payload_bytes", "buffer_bytes", "pool", "knee_threads", "peak_lines_sec",
+                         "peak_threads", "max_drop_pct", "reason"])
+        for (payload, buffer, pool), curve in sorted(curves.items()):
+            curve.sort(key=lambda r: r["threads"])
+            base = curve[0]["end_to_end_lines_sec"]
+            print(f"\npayload={payload}B buffer={buffer // 1024}KB pool={pool}")
+            print(f"  {'threads':>7} {'e2e lines/s':>14} {'x base':>7} {'drop %':>8}")
+            for r in curve:
+                print(f"  {r['threads']:7d} {r['end_to_end_lines_sec']:14.0f} "
+                      f"{r['end_to_end_lines_sec'] / base:7.2f} {r['drop_pct']:8.3f}")
+            knee, reason = find_knee(curve, min_gain, max_drop_pct)
+            peak = max(curve, key=lambda r: r["end_to_end_lines_sec"])
+            print(f"  knee: {knee} threads ({reason})")
+            writer.writerow([payload, buffer, pool, knee, f"{peak['end_to_end_lines_sec']:.0f}",
+                             peak["threads"], max(r["drop_pct"] for r in curve), reason])
+    print(f"\nWrote sweep summary to: {summary_csv}")
+
+    if not plot:
+        return
+    try:
+        import matplotlib
+        matplotlib.use("Agg")
+        import matplotlib.pyplot as plt
+    except ImportError:
+        print("matplotlib not available; skipping plots", file=sys.stderr)
+        return
+    for pool in sorted({k[2] for k in curves}):
+        fig, ax = plt.subplots(figsize=(8, 5))
+        for (payload, buffer, p), curve in sorted(curves.items()):
+            if p != pool:
+                continue
+            ax.plot([r["threads"] for r in curve], [r["end_to_end_lines_sec"] for r in curve],
+                    marker="o", label=f"payload {payload}B, buffer {buffer // 1024}KB")
+        ax.set_xscale("log", base=2)
+        ax.set_xlabel("producer threads")
+        ax.set_ylabel("end-to-end lines/sec")
+        ax.set_title(f"pool = {pool} buffers")
+        ax.legend(fontsize="small")
+        path = out_dir / f"sweep_pool{pool}.png"
+        fig.savefig(path, dpi=120, bbox_inches="tight")
+        plt.close(fig)
+        print(f"Wrote plot: {path}")
+
+
 def main():
     ap = argparse.ArgumentParser()
     ap.add_argument("--runs", type=int, default=100)
     ap.add_argument("--build-dir", default="build")
     ap.add_argument("--out-dir", default="bench_runs")
     ap.add_argument("--no-build", action="store_true")
+    ap.add_argument("--sweep", action="store_true",
+                    help="run caelogger_bench --sweep once and summarize the scaling curves")
+    ap.add_argument("--sweep-args", default="",
+                    help='extra arguments for the sweep, e.g. "--threads 1,2,4,8 --pool 8,32"')
+    ap.add_argument("--sweep-csv", type=Path,
+                    help="summarize an existing sweep CSV instead of running one")
+    ap.add_argument("--plot", action="store_true", help="write throughput-vs-threads PNGs (needs matplotlib)")
+    ap.add_argument("--knee-gain", type=float, default=0.10,
+                    help="relative gain below which another thread step counts as the knee (default 0.10)")
+    ap.add_argument("--knee-drop-pct", type=float, default=0.5,
+                    help="drop rate above which a point counts as past the knee (default 0.5)")
     args = ap.parse_args()
 
     repo = Path.cwd()
@@ -212,6 +301,10 @@ def main():
     results_csv = out_dir / "bench_results.csv"
     summary_csv = out_dir / "bench_summary.csv"
 
+    if args.sweep_csv:
+        summarize_sweep(args.sweep_csv, out_dir, args.plot, args.knee_gain, args.knee_drop_pct)
+        return
+
     if not args.no_build:
         print(f"Building target caelogger_bench in {build_dir}...")
         build = run_cmd(["cmake", "--build", str(build_dir), "--target", "caelogger_bench"])
@@ -224,6 +317,16 @@ def main():
         print(f"Benchmark executable not found: {bench_exe}", file=sys.stderr)
         sys.exit(1)
 
+    if args.sweep:
+        sweep_csv = out_dir / "sweep.csv"
+        cmd = [str(bench_exe), "--sweep", "--csv", str(sweep_csv)] + shlex.split(args.sweep_args)
+        print("Running " + " ".join(cmd), flush=True)
+        p = subprocess.run(cmd, text=True)
+        if p.returncode != 0:
+            sys.exit(p.returncode)
+        summarize_sweep(sweep_csv, out_dir, args.plot, args.knee_gain, args.knee_drop_pct)
+        return
+
     rows = []
 
     for i in range(1, args.runs + 1):
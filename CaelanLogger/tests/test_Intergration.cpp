@@ -2,15 +2,34 @@
 
 #include <algorithm>
 #include <chrono>
+#include <cstdlib>
 #include <filesystem>
 #include <fstream>
+#include <limits>
+#include <regex>
 #include <sstream>
 #include <string>
 #include <thread>
 #include <vector>
+#include <pthread.h>
+#include <sched.h>
+#include <spawn.h>
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 #include "AsyncLogger.h"
+#include "LogContext.h"
 #include "SharedBackend.h"
+#include "ShmBackend.h"
+#include "SocketWriter.h"
+#include "TimeIndex.h"
+#include "WriterExecutor.h"
 
 namespace fs = std::filesystem;
 
@@ -112,6 +131,100 @@ static std::string make_unique_token(const char *tag)
     return std::string("<<") + tag + "_" + std::to_string(now) + ">>";
 }
 
+// Stand-in collector: reads fd until a "dropped: " line (the writer sends
+// one at shutdown) or timeoutMs of silence. Each read is one datagram on a
+// datagram socket.
+static std::vector<std::string> receive_until_drop_line(int fd, int timeoutMs)
+{
+    std::vector<std::string> reads;
+    std::vector<char> buf(1 << 17);
+    pollfd p{fd, POLLIN, 0};
+    while (::poll(&p, 1, timeoutMs) > 0)
+    {
+        ssize_t n = ::recv(fd, buf.data(), buf.size(), 0);
+        if (n <= 0)
+            break;
+        reads.emplace_back(buf.data(), static_cast<size_t>(n));
+        if (reads.back().find("dropped: ") != std::string::npos)
+            break;
+    }
+    return reads;
+}
+
+static int bind_unix(const fs::path &path, int type)
+{
+    fs::remove(path);
+    int fd = ::socket(AF_UNIX, type | SOCK_CLOEXEC, 0);
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    if (fd < 0 || ::bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0)
+        return -1;
+    return fd;
+}
+
+namespace
+{
+    enum class Side
+    {
+        Buy,
+        Sell,
+    };
+
+    struct Cents
+    {
+        long long value;
+    };
+
+    struct Tags
+    {
+        std::vector<std::string> names;
+    };
+}
+
+namespace CaelanLogger
+{
+    // Bounded: written with one reservation.
+    template <>
+    struct formatter<Cents>
+    {
+        static constexpr size_t max_size = formatter<unsigned long long>::max_size + 4;
+
+        template <typename Out>
+        static void format(Out &out, Cents c)
+        {
+            unsigned long long mag = static_cast<unsigned long long>(c.value);
+            if (c.value < 0)
+            {
+                out.put('-');
+                mag = 0 - mag;
+            }
+            formatValue(out, mag / 100);
+            out.put('.');
+            out.put(static_cast<char>('0' + mag % 100 / 10));
+            out.put(static_cast<char>('0' + mag % 10));
+        }
+    };
+
+    // Unbounded: every write is checked.
+    template <>
+    struct formatter<Tags>
+    {
+        template <typename Out>
+        static void format(Out &out, const Tags &t)
+        {
+            out.put('[');
+            for (size_t i = 0; i < t.names.size(); i++)
+            {
+                if (i)
+                    out.put(',');
+                out.write(t.names[i]);
+            }
+            out.put(']');
+        }
+    };
+}
+
 // ----------------------- tests -----------------------
 
 TEST(LoggerIntegration, SingleThread_LoggedPlusDroppedEqualsAttempted)
@@ -211,6 +324,44 @@ TEST(LoggerIntegration, MultiThread_LoggedPlusDroppedEqualsAttempted)
         << "logged=" << logged << " dropped=" << dropped;
 }
 
+TEST(LoggerIntegration, Overload_SkipsAcquireAndStillCountsEveryDrop)
+{
+    const fs::path logDir = fs::current_path() / "log";
+    purge_log_dir(logDir);
+
+    const std::string token = make_unique_token("OVERLOAD");
+    const int kThreads = 4;
+    const int kLinesPerThread = 20000;
+    const std::string payload(200, 'X');
+    // Two small buffers: nearly every line finds the pool empty.
+    AsyncLogger<SharedBackend> logger(4096, 2, logDir.string());
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t)
+        threads.emplace_back([&, t]
+                             {
+            for (int i = 0; i < kLinesPerThread; ++i)
+                LOG_TO(logger, INFO) << token << " T=" << t << " I=" << i << " " << payload;
+            logger.shutdownTL(); });
+    for (auto &th : threads)
+        th.join();
+
+    MetricsSnapshot m = logger.metrics();
+    EXPECT_GT(m.acquireSkips, 0u);
+    EXPECT_GT(m.drops(), 0u);
+
+    // Once buffers come back the next line gets one.
+    for (int i = 0; i < 2000 && logger.metrics().freeDepth != 2; ++i)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    LOG_TO(logger, INFO) << token << " after";
+    logger.shutdownAll();
+
+    const std::string logs = read_all_logs(logDir);
+    EXPECT_EQ(count_occurrences(logs, token + " after"), 1u);
+    EXPECT_EQ(count_occurrences(logs, token) + count_dropped_delta(logs),
+              static_cast<std::size_t>(kThreads * kLinesPerThread + 1));
+}
+
 TEST(LeakCheck, SharedBackendDestroysCleanly)
 {
     {
@@ -220,3 +371,1487 @@ TEST(LeakCheck, SharedBackendDestroysCleanly)
     SUCCEED();
 }
 
+
+TEST(LoggerMetrics, CountersMatchWorkload)
+{
+    const fs::path logDir = fs::current_path() / "log";
+    purge_log_dir(logDir);
+
+    const int kThreads = 4;
+    const int kLinesPerThread = 2000;
+
+    BackendConfig cfg;
+    cfg.metricsInterval = std::chrono::milliseconds(5);
+    AsyncLogger<SharedBackend> logger(64 * 1024, 32, logDir.string(), cfg);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t)
+    {
+        threads.emplace_back([&, t]
+                             {
+            for (int i = 0; i < kLinesPerThread; ++i)
+                LOG_TO(logger, INFO) << "T=" << t << " I=" << i;
+            logger.shutdownTL(); });
+    }
+    for (auto &th : threads)
+        th.join();
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    const MetricsSnapshot m = logger.metrics();
+    logger.shutdownAll();
+
+    EXPECT_EQ(m.producers, 0u);
+    EXPECT_EQ(m.lines + m.drops(), static_cast<uint64_t>(kThreads * kLinesPerThread));
+    EXPECT_EQ(m.dropsByLevel[CaelanLogger::INFO], m.drops());
+    EXPECT_GE(m.handoffs, static_cast<uint64_t>(kThreads));
+    EXPECT_EQ(m.bytesWritten, m.bytes);
+    EXPECT_EQ(m.submittedDepth, 0u);
+    EXPECT_EQ(m.freeDepth, m.poolCapacity);
+    EXPECT_GE(m.writerCycles, 1u);
+
+    const std::string logs = read_all_logs(logDir);
+    EXPECT_GE(count_occurrences(logs, "metrics: producers="), 1u);
+}
+
+TEST(LoggerMetrics, WriterWakeupsOnlyWhenParked)
+{
+    const fs::path logDir = fs::current_path() / "log";
+
+    auto run = [&](const BackendConfig &cfg)
+    {
+        purge_log_dir(logDir);
+        AsyncLogger<SharedBackend> logger(4 * 1024, 32, logDir.string(), cfg);
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t)
+        {
+            threads.emplace_back([&, t]
+                                 {
+                for (int i = 0; i < 5000; ++i)
+                    LOG_TO(logger, INFO) << "T=" << t << " I=" << i;
+                logger.shutdownTL(); });
+        }
+        for (auto &th : threads)
+            th.join();
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        const MetricsSnapshot m = logger.metrics();
+        logger.shutdownAll();
+        EXPECT_EQ(m.lines + m.drops(), 20000u);
+        EXPECT_EQ(m.bytesWritten, m.bytes);
+        return m;
+    };
+
+    const MetricsSnapshot parked = run(BackendConfig{});
+    EXPECT_LE(parked.wakeups, parked.handoffs);
+    EXPECT_GE(parked.parks, 1u);
+
+    BackendConfig poll;
+    poll.writerBusyPoll = true;
+    const MetricsSnapshot polled = run(poll);
+    EXPECT_EQ(polled.wakeups, 0u);
+    EXPECT_EQ(polled.parks, 0u);
+}
+
+TEST(LoggerMetrics, FormattedLineAlwaysEndsInNewline)
+{
+    // Every counter at its widest, every average over a single sample.
+    const uint64_t kMax = std::numeric_limits<uint64_t>::max();
+    MetricsSnapshot s;
+    s.producers = s.lines = s.bytes = s.spills = s.largeRecords = s.truncated = kMax;
+    s.urgentHandoffs = s.acquireSkips = s.wakeups = s.parks = s.syncs = kMax;
+    s.handoffNsTotal = s.handoffNsMax = s.cycleNsTotal = s.cycleNsMax = kMax;
+    s.buffersWritten = s.batchMax = s.bytesWritten = s.rollNsTotal = s.rollNsMax = kMax;
+    s.sinkDroppedBytes = s.sinkReconnects = s.flightDumps = kMax;
+    for (uint64_t &d : s.dropsByLevel)
+        d = kMax / kLevelCount;
+    s.poolCapacity = s.freeDepth = s.submittedDepth = std::numeric_limits<size_t>::max();
+    s.handoffs = s.writerCycles = s.writeCalls = s.rolls = 1;
+
+    char line[kMetricsLineMax];
+    const size_t len = formatMetrics(s, line, sizeof(line));
+    ASSERT_GT(len, 0u);
+    EXPECT_LT(len, sizeof(line) - 1);
+    EXPECT_EQ(line[len - 1], '\n');
+
+    char shortLine[64];
+    EXPECT_EQ(formatMetrics(s, shortLine, sizeof(shortLine)), sizeof(shortLine) - 1);
+    EXPECT_EQ(shortLine[sizeof(shortLine) - 2], '\n');
+}
+
+TEST(LoggerMetrics, BufferAgesCoverHandoffPickupAndWrite)
+{
+    const fs::path logDir = fs::current_path() / "log";
+    purge_log_dir(logDir);
+
+    const int kBuffers = 3;
+    AsyncLogger<SharedBackend> logger(64 * 1024, 8, logDir.string());
+    for (int b = 0; b < kBuffers; ++b)
+    {
+        for (int i = 0; i < 10; ++i)
+            LOG_TO(logger, INFO) << "age " << b << " " << i;
+        // Each buffer is at least this old when it is handed off.
+        std::this_thread::sleep_for(std::chrono::milliseconds(30));
+        logger.flush();
+    }
+    logger.shutdownTL();
+
+    MetricsSnapshot m = logger.metrics();
+    for (int i = 0; i < 2000 && m.writeAge.count() < kBuffers; ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        m = logger.metrics();
+    }
+    logger.shutdownAll();
+
+    // The empty buffer handed off at shutdownTL() is not counted.
+    EXPECT_EQ(m.handoffAge.count(), static_cast<uint64_t>(kBuffers));
+    EXPECT_EQ(m.pickupAge.count(), static_cast<uint64_t>(kBuffers));
+    EXPECT_EQ(m.writeAge.count(), static_cast<uint64_t>(kBuffers));
+    EXPECT_GE(m.handoffAge.percentileUs(50), 30'000u);
+    EXPECT_LE(m.handoffAge.percentileUs(99), m.pickupAge.percentileUs(99));
+    EXPECT_LE(m.pickupAge.percentileUs(99), m.writeAge.percentileUs(99));
+}
+
+// Thread id of the first thread in this process named name, or -1.
+static pid_t find_thread(const std::string &name)
+{
+    for (const auto &e : fs::directory_iterator("/proc/self/task"))
+    {
+        std::ifstream in(e.path() / "comm");
+        std::string comm;
+        std::getline(in, comm);
+        if (comm == name)
+            return static_cast<pid_t>(std::stoi(e.path().filename().string()));
+    }
+    return -1;
+}
+
+TEST(ThreadPlacement, WriterAndHelperAreNamedAndPinned)
+{
+    const fs::path logDir = fs::current_path() / "log";
+    purge_log_dir(logDir);
+
+    cpu_set_t allowed;
+    ASSERT_EQ(sched_getaffinity(0, sizeof(allowed), &allowed), 0);
+    int cpu = 0;
+    while (!CPU_ISSET(cpu, &allowed))
+        ++cpu;
+
+    BackendConfig cfg;
+    cfg.writerPlacement.cpus = {cpu};
+    cfg.preallocateSegments = true;
+    cfg.helperPlacement.cpus = {cpu};
+    cfg.helperPlacement.name = "test-segprep";
+    AsyncLogger<SharedBackend> logger(4096, 8, logDir.string(), cfg);
+    LOG_TO(logger, INFO) << "placed";
+    logger.flush();
+
+    pid_t writer = -1, helper = -1;
+    for (int i = 0; i < 2000 && (writer < 0 || helper < 0); ++i)
+    {
+        writer = find_thread("cae-writer");
+        helper = find_thread("test-segprep");
+        if (writer < 0 || helper < 0)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    ASSERT_GT(writer, 0);
+    ASSERT_GT(helper, 0);
+
+    for (pid_t tid : {writer, helper})
+    {
+        cpu_set_t set;
+        ASSERT_EQ(sched_getaffinity(tid, sizeof(set), &set), 0);
+        EXPECT_EQ(CPU_COUNT(&set), 1);
+        EXPECT_TRUE(CPU_ISSET(cpu, &set));
+    }
+    EXPECT_EQ(logger.metrics().placementFailures, 0u);
+    logger.shutdownAll();
+}
+
+TEST(WriterExecutor, ManyLoggersShareTwoWriterThreads)
+{
+    const fs::path logDir = fs::current_path() / "log";
+    purge_log_dir(logDir);
+
+    auto executor = std::make_shared<WriterExecutor>(2);
+    BackendConfig cfg;
+    cfg.executor = executor;
+    const int kLoggers = 50, kThreads = 4, kLines = 200;
+    std::vector<std::unique_ptr<AsyncLogger<SharedBackend>>> loggers;
+    std::vector<std::string> tokens;
+    for (int i = 0; i < kLoggers; ++i)
+    {
+        loggers.push_back(std::make_unique<AsyncLogger<SharedBackend>>(4096, 8, logDir.string(), cfg));
+        tokens.push_back(make_unique_token(("EXEC" + std::to_string(i) + "_").c_str()));
+    }
+    EXPECT_EQ(executor->taskCount(), static_cast<size_t>(kLoggers));
+    EXPECT_EQ(find_thread("cae-writer"), -1);
+    // Each thread names itself as it starts.
+    pid_t exec = -1;
+    for (int i = 0; i < 2000 && exec < 0; ++i)
+    {
+        exec = find_thread("cae-exec-1");
+        if (exec < 0)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    EXPECT_GT(exec, 0);
+
+    std::vector<std::thread> producers;
+    for (int t = 0; t < kThreads; ++t)
+        producers.emplace_back([&, t]
+                               {
+            for (int n = 0; n < kLines; ++n)
+                for (int i = 0; i < kLoggers; ++i)
+                    LOG_TO(*loggers[i], INFO) << tokens[i] << " t" << t << " n" << n;
+            for (auto &l : loggers)
+                l->shutdownTL(); });
+    for (auto &p : producers)
+        p.join();
+
+    std::vector<uint64_t> drops;
+    for (auto &l : loggers)
+    {
+        drops.push_back(l->metrics().drops());
+        l->shutdownAll();
+    }
+    loggers.clear();
+    EXPECT_EQ(executor->taskCount(), 0u);
+
+    const std::string logs = read_all_logs(logDir);
+    for (int i = 0; i < kLoggers; ++i)
+        EXPECT_EQ(count_occurrences(logs, tokens[i] + " ") + drops[i], static_cast<size_t>(kThreads * kLines)) << i;
+}
+
+TEST(WriterExecutor, RefusedPlacementIsCounted)
+{
+    const fs::path logDir = fs::current_path() / "log";
+    purge_log_dir(logDir);
+
+    // A CPU no machine here has: the affinity call fails, the thread runs on.
+    ThreadPlacement placement;
+    placement.cpus = {CPU_SETSIZE - 1};
+    auto executor = std::make_shared<WriterExecutor>(2, placement);
+    for (int i = 0; i < 2000 && executor->placementFailures() < 2; ++i)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    EXPECT_EQ(executor->placementFailures(), 2u);
+
+    BackendConfig cfg;
+    cfg.executor = executor;
+    AsyncLogger<SharedBackend> logger(4096, 8, logDir.string(), cfg);
+    LOG_TO(logger, INFO) << "placed anyway";
+    EXPECT_EQ(logger.metrics().placementFailures, 2u);
+    logger.shutdownAll();
+}
+
+TEST(LoggerMemory, LazyBuffersAreReleasedWhenIdleAndReused)
+{
+    const fs::path logDir = fs::current_path() / "log";
+    purge_log_dir(logDir);
+
+    const int kLines = 200;
+    const std::string token = make_unique_token("IDLE");
+    BackendConfig cfg;
+    cfg.lazyBuffers = true;
+    cfg.idleRelease = std::chrono::milliseconds(20);
+    AsyncLogger<SharedBackend> logger(4096, 16, logDir.string(), cfg);
+    EXPECT_EQ(logger.metrics().residentBuffers, 0u);
+
+    auto burst = [&]
+    {
+        std::thread([&]
+                    {
+            for (int i = 0; i < kLines; ++i)
+                LOG_TO(logger, INFO) << token << " " << i;
+            logger.shutdownTL(); })
+            .join();
+    };
+
+    burst();
+    MetricsSnapshot m = logger.metrics();
+    EXPECT_GT(m.residentBuffers, 0u);
+    // The burst fills a few 4 KB buffers, nowhere near the pool's 16.
+    EXPECT_LT(m.residentBuffers, 16u);
+    for (int i = 0; i < 2000 && (m.residentBuffers != 0 || m.submittedDepth != 0); ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        m = logger.metrics();
+    }
+    EXPECT_EQ(m.residentBuffers, 0u);
+    EXPECT_GT(m.idleReleases, 0u);
+    EXPECT_EQ(m.freeDepth, m.poolCapacity);
+
+    burst();
+    logger.shutdownAll();
+    EXPECT_EQ(count_occurrences(read_all_logs(logDir), token), static_cast<std::size_t>(2 * kLines));
+}
+
+// Reaches into a backend's free lists, for pool states the public API cannot
+// set up on cue.
+class BackendLoggerTestAccess
+{
+public:
+    // Takes every free pool buffer, as a sweep in progress does for a moment.
+    // The writer's own sweep may hold one briefly; wait for it.
+    template <typename Backend>
+    static std::vector<size_t> takeFree(Backend &b)
+    {
+        std::vector<size_t> idxes;
+        while (idxes.size() < b.poolCapacity_)
+        {
+            if (auto idx = b.freeIdxes_->pop())
+                idxes.push_back(*idx);
+            else if (auto cold = b.coldIdxes_->pop())
+                idxes.push_back(*cold);
+        }
+        return idxes;
+    }
+    // Puts them back without telling producers, as releaseIdle() pushes.
+    template <typename Backend>
+    static void putFree(Backend &b, const std::vector<size_t> &idxes)
+    {
+        for (size_t idx : idxes)
+            b.freeIdxes_->push(idx);
+    }
+};
+
+TEST(LoggerMemory, IdleSweepWakesProducersThatFoundThePoolEmpty)
+{
+    const fs::path logDir = fs::current_path() / "log";
+    purge_log_dir(logDir);
+
+    const std::string token = make_unique_token("SWEEP");
+    BackendConfig cfg;
+    cfg.idleRelease = std::chrono::milliseconds(10);
+    MetricsSnapshot m;
+    {
+        SharedBackend backend(4096, 4, logDir.string(), cfg);
+        ThreadLogger<SharedBackend> producer(4096, &backend, /*acquireNow=*/false);
+        const std::vector<size_t> held = BackendLoggerTestAccess::takeFree(backend);
+        LogStream(&producer, CaelanLogger::INFO) << token << " dropped";
+        const uint64_t gen = backend.freeGeneration();
+        BackendLoggerTestAccess::putFree(backend, held);
+
+        // Nothing is in flight, so only the sweep can tell the producer.
+        for (int i = 0; i < 2000 && backend.freeGeneration() == gen; ++i)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        EXPECT_NE(backend.freeGeneration(), gen);
+        LogStream(&producer, CaelanLogger::INFO) << token << " after";
+        producer.release();
+        m = backend.metrics();
+    }
+
+    EXPECT_EQ(m.drops(), 1u);
+    const std::string logs = read_all_logs(logDir);
+    EXPECT_EQ(count_occurrences(logs, token + " dropped"), 0u);
+    EXPECT_EQ(count_occurrences(logs, token + " after\n"), 1u);
+}
+
+TEST(LoggerIntegration, UrgentLines_ReachTheFileWithoutAFlush)
+{
+    const fs::path logDir = fs::current_path() / "log";
+    purge_log_dir(logDir);
+
+    const std::string token = make_unique_token("URGENT");
+    BackendConfig cfg;
+    cfg.urgentHandoff = true;
+    cfg.syncUrgent = true;
+    cfg.fatalWait = std::chrono::milliseconds(5000);
+    AsyncLogger<SharedBackend> logger(64 * 1024, 8, logDir.string(), cfg);
+
+    for (int i = 0; i < 5; ++i)
+        LOG_TO(logger, INFO) << token << " info " << i;
+    LOG_TO(logger, ERROR) << token << " error";
+    std::string logs;
+    for (int i = 0; i < 2000 && count_occurrences(logs, token) < 6; ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        logs = read_all_logs(logDir);
+    }
+    // The INFO lines shared the ERROR line's buffer.
+    EXPECT_EQ(count_occurrences(logs, token), 6u);
+
+    LOG_TO(logger, INFO) << token << " batched";
+    LOG_TO(logger, FATAL) << token << " fatal";
+    // No polling: the FATAL line returned only once it was written.
+    EXPECT_EQ(count_occurrences(read_all_logs(logDir), token), 8u);
+
+    MetricsSnapshot m = logger.metrics();
+    EXPECT_EQ(m.urgentHandoffs, 2u);
+    EXPECT_GE(m.syncs, 2u);
+    logger.shutdownAll();
+}
+
+TEST(LinePattern, DefaultPrefixKeepsLevelDateAndMillis)
+{
+    const fs::path logDir = fs::current_path() / "log";
+    purge_log_dir(logDir);
+
+    const std::string token = make_unique_token("PREFIX");
+    {
+        AsyncLogger<SharedBackend> logger(4096, 8, logDir.string());
+        LOG_TO(logger, INFO) << token;
+        LOG_TO(logger, ERROR) << token;
+        logger.shutdownAll();
+    }
+    const std::string logs = read_all_logs(logDir);
+    const std::string stamp = R"(\d{4}-\d\d-\d\d \d\d:\d\d:\d\d\.\d{3} )";
+    EXPECT_TRUE(std::regex_search(logs, std::regex("INFO " + stamp + token + "\n")));
+    EXPECT_TRUE(std::regex_search(logs, std::regex("ERROR " + stamp + token + "\n")));
+}
+
+TEST(LinePattern, ThreadAndLoggerFieldsAreRendered)
+{
+    const fs::path logDir = fs::current_path() / "log";
+    purge_log_dir(logDir);
+
+    EXPECT_THROW(LinePattern("%Q"), std::invalid_argument);
+    EXPECT_THROW(LinePattern("trailing %"), std::invalid_argument);
+
+    const std::string token = make_unique_token("PATTERN");
+    BackendConfig cfg;
+    cfg.linePattern = "[%L|%t|%N|%P|%n] %T.%u 100%% ";
+    cfg.loggerName = "orders";
+    AsyncLogger<SharedBackend> logger(4096, 8, logDir.string(), cfg);
+    long tid = 0;
+    std::thread([&]
+                {
+        ::pthread_setname_np(::pthread_self(), "pattern-test");
+        tid = ::syscall(SYS_gettid);
+        LOG_TO(logger, WARNING) << token;
+        logger.shutdownTL(); })
+        .join();
+    logger.shutdownAll();
+
+    const std::string expected = "\\[WARNING\\|" + std::to_string(tid) + "\\|pattern-test\\|" +
+                                 std::to_string(::getpid()) + R"(\|orders\] \d\d:\d\d:\d\d\.\d{6} 100% )" + token;
+    EXPECT_TRUE(std::regex_search(read_all_logs(logDir), std::regex(expected)));
+}
+
+TEST(Callsite, LinesCarrySourceAndIdsResolveInTheDictionary)
+{
+    const fs::path logDir = fs::current_path() / "log";
+    purge_log_dir(logDir);
+
+    const std::string token = make_unique_token("CALLSITE");
+    BackendConfig cfg;
+    cfg.linePattern = "%L %s %F #%i ";
+    AsyncLogger<SharedBackend> logger(4096, 8, logDir.string(), cfg);
+    const Callsite *first = nullptr;
+    int line = 0;
+    for (int i = 0; i < 3; i++)
+    {
+        // One statement, so one record however often it runs.
+        const Callsite *site = CAELAN_CALLSITE(); line = __LINE__;
+        EXPECT_TRUE(first == nullptr || site == first);
+        first = site;
+        LogStream(logger.tls(), CaelanLogger::INFO, site) << token;
+    }
+    LogStream(logger.tls(), CaelanLogger::INFO) << token << "-bare";
+    logger.shutdownAll();
+
+    const std::string id = std::to_string(first->id);
+    const std::string logs = read_all_logs(logDir);
+    const std::string expected = "INFO test_Intergration.cpp:" + std::to_string(line) + " " + first->function + " #" + id + " " + token + "\n";
+    EXPECT_EQ(count_occurrences(logs, expected), 3u);
+    EXPECT_NE(logs.find("INFO - - #- " + token + "-bare\n"), std::string::npos);
+
+    std::ifstream dict(logDir / "caelogger.callsites");
+    std::stringstream ss;
+    ss << dict.rdbuf();
+    EXPECT_NE(ss.str().find(id + "\t" + first->file + ":" + std::to_string(line) + "\t"), std::string::npos);
+}
+
+TEST(Callsite, DictionaryStartsOverOnRestart)
+{
+    const fs::path logDir = fs::current_path() / "log";
+    purge_log_dir(logDir);
+    // What a different build, with other ids, left in the same directory.
+    fs::create_directories(logDir);
+    std::ofstream(logDir / "caelogger.callsites") << "1\tstale.cpp:1\tstale\n";
+
+    const std::string token = make_unique_token("RESTART");
+    BackendConfig cfg;
+    cfg.linePattern = "%L #%i ";
+    const Callsite *site = CAELAN_CALLSITE();
+    for (int run = 0; run < 2; run++)
+    {
+        AsyncLogger<SharedBackend> logger(4096, 8, logDir.string(), cfg);
+        LogStream(logger.tls(), CaelanLogger::INFO, site) << token << ' ' << run;
+        logger.shutdownAll();
+    }
+
+    std::ifstream dict(logDir / "caelogger.callsites");
+    std::stringstream ss;
+    ss << dict.rdbuf();
+    const std::string entries = "\n" + ss.str();
+    EXPECT_EQ(entries.find("stale.cpp"), std::string::npos);
+    EXPECT_EQ(count_occurrences(entries, "\n" + std::to_string(site->id) + "\t" + site->file + ":"), 1u);
+}
+
+TEST(Formatter, UserTypesAndEnumsWriteIntoTheBuffer)
+{
+    static_assert(CaelanLogger::enumName(Side::Sell) == "Sell");
+    static_assert(CaelanLogger::BoundedFormattable<Side> && CaelanLogger::BoundedFormattable<Cents>);
+    static_assert(!CaelanLogger::BoundedFormattable<Tags>);
+
+    const fs::path logDir = fs::current_path() / "log";
+    purge_log_dir(logDir);
+
+    const std::string token = make_unique_token("FORMAT");
+    // Longer than a buffer, so the checked writes have to spill.
+    const Tags tags{{std::string(1500, 'a'), "b", std::string(700, 'c')}};
+    const std::string tagsText = "[" + tags.names[0] + ",b," + tags.names[2] + "]";
+
+    // Small buffers, so bounded values also land at buffer ends; enough of
+    // them that nothing is dropped.
+    AsyncLogger<SharedBackend> logger(1024, 64, logDir.string());
+    for (int i = 0; i < 100; ++i)
+        LOG_TO(logger, INFO) << token << ' ' << Side::Sell << ' ' << static_cast<Side>(7) << ' '
+                             << Cents{-105} << ' ' << Cents{12345} << ' ' << std::string_view("view");
+    LOG_TO(logger, INFO) << token << ' ' << tags;
+    logger.shutdownAll();
+
+    const std::string logs = read_all_logs(logDir);
+    EXPECT_EQ(count_occurrences(logs, token + " Sell 7 -1.05 123.45 view\n"), 100u);
+    EXPECT_EQ(count_occurrences(logs, token + " " + tagsText + "\n"), 1u);
+}
+
+TEST(SocketSink, DatagramsCarryWholeLines)
+{
+    const fs::path sock = fs::temp_directory_path() / ("cae-dgram-" + std::to_string(::getpid()));
+    int rx = bind_unix(sock, SOCK_DGRAM);
+    ASSERT_GE(rx, 0);
+
+    const std::string token = make_unique_token("SOCKDGRAM");
+    const int lines = 3000;
+    std::vector<std::string> reads;
+    std::thread receiver([&]
+                         { reads = receive_until_drop_line(rx, 5000); });
+    {
+        BackendConfig cfg;
+        cfg.socketSink = "unix:" + sock.string();
+        cfg.socketSendTimeout = std::chrono::milliseconds(1000);
+        // Buffers several datagrams long, so each goes out as a batch.
+        AsyncLogger<SharedBackend> logger(256 * 1024, 4, "./log", cfg);
+        for (int i = 0; i < lines; ++i)
+            LOG_TO(logger, INFO) << token << " line " << i;
+        logger.shutdownTL();
+        EXPECT_EQ(logger.metrics().sinkDroppedBytes, 0u);
+        logger.shutdownAll();
+    }
+    receiver.join();
+    ::close(rx);
+    fs::remove(sock);
+
+    std::string all;
+    for (const auto &d : reads)
+    {
+        EXPECT_LE(d.size(), SocketWriter::kMaxDatagram);
+        EXPECT_EQ(d.back(), '\n');
+        all += d;
+    }
+    EXPECT_GT(reads.size(), 3u);
+    EXPECT_EQ(count_occurrences(all, token), static_cast<size_t>(lines));
+    EXPECT_EQ(count_occurrences(all, token + " line 2999\n"), 1u);
+}
+
+TEST(SocketSink, StreamDropsWhileTheCollectorIsDownThenReconnects)
+{
+    const fs::path sock = fs::temp_directory_path() / ("cae-stream-" + std::to_string(::getpid()));
+    fs::remove(sock);
+    const std::string token = make_unique_token("SOCKSTREAM");
+
+    BackendConfig cfg;
+    cfg.socketSink = "unix-stream:" + sock.string();
+    cfg.socketMaxBackoff = std::chrono::milliseconds(20);
+    AsyncLogger<SharedBackend> logger(4096, 8, "./log", cfg);
+
+    // Nothing listens yet: the writer drops the buffer and backs off
+    // instead of waiting.
+    LOG_TO(logger, INFO) << token << " lost";
+    logger.flush();
+    for (int i = 0; i < 2000 && logger.metrics().sinkDroppedBytes == 0; ++i)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    EXPECT_GT(logger.metrics().sinkDroppedBytes, 0u);
+
+    int listener = bind_unix(sock, SOCK_STREAM);
+    ASSERT_GE(listener, 0);
+    ASSERT_EQ(::listen(listener, 1), 0);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50)); // past the backoff
+
+    LOG_TO(logger, INFO) << token << " delivered";
+    logger.flush();
+    int conn = ::accept(listener, nullptr, nullptr);
+    ASSERT_GE(conn, 0);
+    std::string all;
+    std::thread receiver([&]
+                         {
+        for (const auto &r : receive_until_drop_line(conn, 5000))
+            all += r; });
+    logger.shutdownAll();
+    receiver.join();
+    ::close(conn);
+    ::close(listener);
+    fs::remove(sock);
+
+    EXPECT_EQ(count_occurrences(all, token + " delivered\n"), 1u);
+    EXPECT_EQ(count_occurrences(all, token + " lost"), 0u);
+}
+
+static std::vector<std::string> read_flight_dumps(const fs::path &logDir)
+{
+    std::vector<std::string> dumps;
+    for (const auto &p : log_files(logDir))
+    {
+        if (p.filename().string().find("_flight_") == std::string::npos)
+            continue;
+        std::ifstream in(p, std::ios::binary);
+        std::ostringstream ss;
+        ss << in.rdbuf();
+        dumps.push_back(ss.str());
+    }
+    return dumps;
+}
+
+static bool wait_for_dumps(AsyncLogger<SharedBackend> &logger, uint64_t n)
+{
+    for (int i = 0; i < 2000 && logger.metrics().flightDumps < n; ++i)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    return logger.metrics().flightDumps == n;
+}
+
+TEST(FlightRecorder, DumpsOnlyOnTriggersWithOtherThreadsPartialBuffers)
+{
+    const fs::path logDir = fs::current_path() / "log";
+    purge_log_dir(logDir);
+
+    const std::string token = make_unique_token("FLIGHT");
+    BackendConfig cfg;
+    cfg.flightRecorder = 64 * 1024;
+    cfg.flightRecorderSignal = SIGUSR2;
+    AsyncLogger<SharedBackend> logger(4096, 16, logDir.string(), cfg);
+
+    // Holds its buffer, never handed off, across all three dumps.
+    std::atomic<bool> logged{false}, done{false};
+    std::thread holder([&]
+                       {
+        LOG_TO(logger, DEBUG) << token << " partial";
+        logged = true;
+        while (!done)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        logger.shutdownTL(); });
+    while (!logged)
+        std::this_thread::yield();
+
+    // Several times the ring: the oldest lines are recycled.
+    const int lines = 5000;
+    for (int i = 0; i < lines; ++i)
+    {
+        LOG_TO(logger, DEBUG) << token << " line " << i;
+        if (i % 32 == 0)
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+    logger.flush();
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_TRUE(read_flight_dumps(logDir).empty());
+    EXPECT_EQ(count_occurrences(read_all_logs(logDir), token), 0u);
+
+    logger.dumpFlightRecorder();
+    ASSERT_TRUE(wait_for_dumps(logger, 1));
+    std::vector<std::string> dumps = read_flight_dumps(logDir);
+    ASSERT_EQ(dumps.size(), 1u);
+    EXPECT_EQ(dumps[0].rfind("flight recorder dump: request", 0), 0u);
+    EXPECT_LE(dumps[0].size(), cfg.flightRecorder + 1024);
+    EXPECT_EQ(count_occurrences(dumps[0], token + " line 0\n"), 0u);
+    EXPECT_EQ(count_occurrences(dumps[0], token + " line 4999\n"), 1u);
+    EXPECT_EQ(count_occurrences(dumps[0], token + " partial\n"), 1u);
+    // Every line in the dump is whole.
+    std::istringstream in(dumps[0]);
+    std::string line;
+    std::getline(in, line);
+    while (std::getline(in, line))
+        EXPECT_TRUE(line.find(token) != std::string::npos || line.rfind("dropped:", 0) == 0) << line;
+
+    LOG_TO(logger, ERROR) << token << " failure";
+    ASSERT_TRUE(wait_for_dumps(logger, 2));
+    ::raise(SIGUSR2);
+    ASSERT_TRUE(wait_for_dumps(logger, 3));
+
+    done = true;
+    holder.join();
+    logger.shutdownAll();
+
+    dumps = read_flight_dumps(logDir);
+    ASSERT_EQ(dumps.size(), 3u);
+    size_t errorDumps = 0, signalDumps = 0;
+    for (const auto &d : dumps)
+    {
+        if (d.rfind("flight recorder dump: error line", 0) == 0)
+        {
+            errorDumps++;
+            EXPECT_EQ(count_occurrences(d, token + " failure\n"), 1u);
+            EXPECT_EQ(count_occurrences(d, token + " line "), 0u);
+        }
+        if (d.rfind("flight recorder dump: signal", 0) == 0)
+            signalDumps++;
+        EXPECT_EQ(count_occurrences(d, token + " partial\n"), 1u);
+    }
+    EXPECT_EQ(errorDumps, 1u);
+    EXPECT_EQ(signalDumps, 1u);
+}
+
+TEST(FlightRecorder, OrderedOutputPartialsCarryNoStamps)
+{
+    const fs::path logDir = fs::current_path() / "log";
+    purge_log_dir(logDir);
+
+    const std::string token = make_unique_token("FLIGHTORD");
+    BackendConfig cfg;
+    cfg.flightRecorder = 64 * 1024;
+    cfg.orderedOutput = true;
+    cfg.linePattern = "%L ";
+    AsyncLogger<SharedBackend> logger(4096, 16, logDir.string(), cfg);
+
+    std::atomic<bool> logged{false}, done{false};
+    std::thread holder([&]
+                       {
+        for (int i = 0; i < 3; ++i)
+            LOG_TO(logger, DEBUG) << token << " partial " << i;
+        logged = true;
+        while (!done)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        logger.shutdownTL(); });
+    while (!logged)
+        std::this_thread::yield();
+    LOG_TO(logger, DEBUG) << token << " written";
+    logger.flush();
+
+    logger.dumpFlightRecorder();
+    ASSERT_TRUE(wait_for_dumps(logger, 1));
+    done = true;
+    holder.join();
+    logger.shutdownAll();
+
+    std::vector<std::string> dumps = read_flight_dumps(logDir);
+    ASSERT_EQ(dumps.size(), 1u);
+    // Header, the written line, then the holder's lines, all plain text.
+    std::istringstream in(dumps[0]);
+    std::string line;
+    std::getline(in, line);
+    std::string lines;
+    while (std::getline(in, line))
+    {
+        EXPECT_TRUE(line.rfind("DEBUG " + token, 0) == 0 || line.rfind("dropped:", 0) == 0) << line;
+        lines += line + "\n";
+    }
+    for (int i = 0; i < 3; ++i)
+        EXPECT_EQ(count_occurrences(lines, "DEBUG " + token + " partial " + std::to_string(i) + "\n"), 1u);
+    EXPECT_EQ(count_occurrences(lines, "DEBUG " + token + " written\n"), 1u);
+}
+
+// Runs this test binary again, as a fresh process, with only filter selected
+// and env added to the environment. Unlike a fork() of this process it starts
+// with no other threads. Its gtest output goes to /dev/null. -1 on failure.
+static pid_t spawn_self(const std::string &filter, const std::vector<std::string> &env)
+{
+    std::vector<std::string> vars = env;
+    for (char **e = environ; *e; ++e)
+        vars.emplace_back(*e);
+    std::vector<char *> envp;
+    for (std::string &v : vars)
+        envp.push_back(v.data());
+    envp.push_back(nullptr);
+    std::string self = fs::read_symlink("/proc/self/exe").string();
+    std::string filterArg = "--gtest_filter=" + filter;
+    char *argv[] = {self.data(), filterArg.data(), nullptr};
+
+    posix_spawn_file_actions_t actions;
+    ::posix_spawn_file_actions_init(&actions);
+    ::posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+    pid_t pid = -1;
+    const int rc = ::posix_spawn(&pid, self.c_str(), &actions, nullptr, argv, envp.data());
+    ::posix_spawn_file_actions_destroy(&actions);
+    return rc == 0 ? pid : -1;
+}
+
+constexpr int kShmChildLines = 500;
+
+// Producer half of ProducerProcessesShareOneCollector, in a process that
+// test spawned. CAE_SHM_CHILD < 0 dies holding a buffer with a line in it.
+TEST(SharedMemoryPool, SpawnedProducer)
+{
+    const char *shmName = std::getenv("CAE_SHM_NAME");
+    if (!shmName)
+        GTEST_SKIP() << "only runs spawned by ProducerProcessesShareOneCollector";
+    const std::string token = std::getenv("CAE_SHM_TOKEN");
+    const int child = std::atoi(std::getenv("CAE_SHM_CHILD"));
+
+    BackendConfig cfg;
+    cfg.shmName = shmName;
+    // ERROR lines are submitted one by one, so a child's submits come back
+    // to back while the collector scans.
+    cfg.urgentHandoff = true;
+    AsyncLogger<ShmBackend> logger(4096, 16, "", cfg);
+    if (child < 0)
+    {
+        LOG_TO(logger, INFO) << token << " crashed";
+        ::kill(::getpid(), SIGKILL);
+    }
+    for (int i = 0; i < kShmChildLines; ++i)
+    {
+        if (i % 8 == 0)
+            LOG_TO(logger, ERROR) << token << " child " << child << " line " << i;
+        else
+            LOG_TO(logger, INFO) << token << " child " << child << " line " << i;
+    }
+    logger.shutdownAll();
+}
+
+TEST(SharedMemoryPool, ProducerProcessesShareOneCollector)
+{
+    const fs::path logDir = fs::current_path() / "log";
+    purge_log_dir(logDir);
+
+    BackendConfig cfg;
+    cfg.shmName = "/cae-test-" + std::to_string(::getpid());
+    cfg.shmReclaimInterval = std::chrono::milliseconds(10);
+    ShmPool::unlink(cfg.shmName);
+    ShmCollector collector(logDir.string(), cfg, 16, 4096);
+    collector.start();
+
+    const std::string token = make_unique_token("SHM");
+    constexpr int kChildren = 4;
+    constexpr int kLines = kShmChildLines;
+    const auto spawn = [&](int child)
+    {
+        return spawn_self("SharedMemoryPool.SpawnedProducer", {"CAE_SHM_NAME=" + cfg.shmName,
+                                                               "CAE_SHM_TOKEN=" + token,
+                                                               "CAE_SHM_CHILD=" + std::to_string(child)});
+    };
+    // Dies holding a buffer with a line in it, before the others can use up
+    // the pool.
+    pid_t crashed = spawn(-1);
+    ASSERT_GT(crashed, 0);
+    int status = 0;
+    ::waitpid(crashed, &status, 0);
+    EXPECT_TRUE(WIFSIGNALED(status));
+    std::vector<pid_t> children;
+    for (int c = 0; c < kChildren; ++c)
+    {
+        pid_t pid = spawn(c);
+        ASSERT_GT(pid, 0);
+        children.push_back(pid);
+    }
+    for (pid_t pid : children)
+    {
+        ::waitpid(pid, &status, 0);
+        EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    }
+
+    for (int i = 0; i < 2000 && collector.reclaimed() == 0; ++i)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    collector.stop();
+    EXPECT_EQ(collector.reclaimed(), 1u);
+    EXPECT_EQ(collector.pool().header().freeSlots.load(), collector.pool().slots());
+    ShmPool::unlink(cfg.shmName);
+
+    const std::string logs = read_all_logs(logDir);
+    const size_t logged = count_occurrences(logs, token + " child ");
+    EXPECT_GT(logged, 0u);
+    EXPECT_EQ(logged + count_dropped_delta(logs), static_cast<size_t>(kChildren * kLines));
+    EXPECT_EQ(count_occurrences(logs, token + " crashed"), 0u);
+    EXPECT_EQ(count_occurrences(logs, "reclaimed: 1 buffers"), 1u);
+    // Slots are written in submit order, so each child's lines keep theirs.
+    for (int c = 0; c < kChildren; ++c)
+    {
+        const std::string prefix = token + " child " + std::to_string(c) + " line ";
+        int prev = -1;
+        for (size_t pos = logs.find(prefix); pos != std::string::npos; pos = logs.find(prefix, pos + 1))
+        {
+            const int line = std::stoi(logs.substr(pos + prefix.size(), 8));
+            EXPECT_GT(line, prev);
+            prev = line;
+        }
+    }
+}
+
+TEST(LoggerIntegration, PwriteWriterPool_LoggedPlusDroppedEqualsAttempted)
+{
+    const fs::path logDir = fs::current_path() / "log";
+    purge_log_dir(logDir);
+
+    const int kThreads = 6;
+    const int kLinesPerThread = 5000;
+    const std::string token = make_unique_token("POOL");
+    const std::string payload(120, 'X');
+
+    BackendConfig cfg;
+    cfg.writerThreads = 4;
+    AsyncLogger<SharedBackend> logger(2000, 32, logDir.string(), cfg);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t)
+    {
+        threads.emplace_back([&, t]
+                             {
+            for (int i = 0; i < kLinesPerThread; ++i)
+                LOG_TO(logger, INFO) << "T=" << t << " I=" << i << " " << token << " " << payload;
+            logger.shutdownTL(); });
+    }
+    for (auto &th : threads)
+        th.join();
+    logger.shutdownAll();
+
+    const std::string logs = read_all_logs(logDir);
+    const std::size_t logged = count_occurrences(logs, token);
+    const std::size_t dropped = count_dropped_delta(logs);
+
+    // Parallel pwrite() reservations must tile the file without holes.
+    EXPECT_EQ(logs.find('\0'), std::string::npos);
+    EXPECT_EQ(logged + dropped, static_cast<std::size_t>(kThreads * kLinesPerThread))
+        << "logged=" << logged << " dropped=" << dropped;
+}
+
+TEST(LoggerIntegration, PolicyBackend_WaitWhenFullLosesNothing)
+{
+    const fs::path logDir = fs::current_path() / "log";
+    purge_log_dir(logDir);
+
+    using Backend = BasicSharedBackend<LockFreeQueues, NormalWriter, CoarseRealtimeClock, WaitWhenFull>;
+    const int kThreads = 8;
+    const int kLinesPerThread = 5000;
+    const std::string token = make_unique_token("POLICY");
+
+    // Fewer buffers than threads, so producers routinely find the pool empty.
+    AsyncLogger<Backend> logger(2000, 4, logDir.string());
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t)
+    {
+        threads.emplace_back([&, t]
+                             {
+            for (int i = 0; i < kLinesPerThread; ++i)
+                LOG_TO(logger, INFO) << token << " T=" << t << " I=" << i;
+            logger.shutdownTL(); });
+    }
+    for (auto &th : threads)
+        th.join();
+    MetricsSnapshot m = logger.metrics();
+    logger.shutdownAll();
+
+    EXPECT_EQ(m.drops(), 0u);
+    const std::string logs = read_all_logs(logDir);
+    EXPECT_EQ(count_dropped_delta(logs), 0u);
+    EXPECT_EQ(count_occurrences(logs, token), static_cast<std::size_t>(kThreads * kLinesPerThread));
+}
+
+TEST(LoggerIntegration, PerProducerRings_LoggedPlusDroppedEqualsAttempted)
+{
+    const fs::path logDir = fs::current_path() / "log";
+    purge_log_dir(logDir);
+
+    const int kWaves = 3;
+    const int kThreads = 16;
+    const int kLinesPerThread = 2000;
+    const std::string token = make_unique_token("RING");
+
+    BackendConfig cfg;
+    cfg.perProducerRings = true;
+    AsyncLogger<SharedBackend> logger(8 * 1024, 32, logDir.string(), cfg);
+
+    MetricsSnapshot m;
+    for (int wave = 0; wave < kWaves; ++wave)
+    {
+        std::vector<std::thread> threads;
+        for (int t = 0; t < kThreads; ++t)
+        {
+            threads.emplace_back([&, t]
+                                 {
+                for (int i = 0; i < kLinesPerThread; ++i)
+                    LOG_TO(logger, INFO) << token << " W=" << wave << " T=" << t << " I=" << i;
+                logger.shutdownTL(); });
+        }
+        for (auto &th : threads)
+            th.join();
+        m = logger.metrics();
+    }
+    logger.shutdownAll();
+
+    // Rings of exited threads are drained and reused, not accumulated.
+    EXPECT_LE(m.rings, static_cast<std::size_t>(kThreads));
+
+    const std::string logs = read_all_logs(logDir);
+    EXPECT_EQ(count_occurrences(logs, token) + count_dropped_delta(logs),
+              static_cast<std::size_t>(kWaves * kThreads * kLinesPerThread));
+}
+
+TEST(LoggerIntegration, OversizedLines_ReachTheFileIntact)
+{
+    const fs::path logDir = fs::current_path() / "log";
+    purge_log_dir(logDir);
+
+    const std::string token = make_unique_token("BIG");
+    // One line several buffers long, and one that only overflows the space
+    // left in a partly filled buffer.
+    const std::string huge(40 * 1024, 'h');
+    const std::string wide(3 * 1024, 'w');
+
+    AsyncLogger<SharedBackend> logger(8 * 1024, 8, logDir.string());
+    for (int i = 0; i < 40; ++i)
+        LOG_TO(logger, INFO) << token << " small " << i;
+    LOG_TO(logger, INFO) << token << " huge " << huge << " end";
+    for (int i = 0; i < 3; ++i)
+        LOG_TO(logger, INFO) << token << " wide " << wide << " end";
+    for (int i = 0; i < 40; ++i)
+        LOG_TO(logger, INFO) << token << " tail " << i;
+    logger.shutdownTL();
+    MetricsSnapshot m = logger.metrics();
+    logger.shutdownAll();
+
+    EXPECT_GE(m.largeRecords, 1u);
+    EXPECT_GE(m.spills, 1u);
+    EXPECT_EQ(m.truncated, 0u);
+
+    const std::string logs = read_all_logs(logDir);
+    EXPECT_EQ(count_dropped_delta(logs), 0u);
+    EXPECT_EQ(count_occurrences(logs, token), 84u);
+    EXPECT_EQ(count_occurrences(logs, token + " huge " + huge + " end\n"), 1u);
+    EXPECT_EQ(count_occurrences(logs, token + " wide " + wide + " end\n"), 3u);
+}
+
+TEST(LoggerIntegration, LineLongerThanMaxRecordSize_IsCutThere)
+{
+    const fs::path logDir = fs::current_path() / "log";
+    purge_log_dir(logDir);
+
+    const std::string token = make_unique_token("CUT");
+    BackendConfig cfg;
+    cfg.maxRecordSize = 64 * 1024;
+    cfg.linePattern = "%L ";
+
+    AsyncLogger<SharedBackend> logger(8 * 1024, 8, logDir.string(), cfg);
+    LOG_TO(logger, INFO) << token << ' ' << std::string(3 * cfg.maxRecordSize, 'x');
+    LOG_TO(logger, INFO) << token << " after";
+    logger.shutdownTL();
+    MetricsSnapshot m = logger.metrics();
+    logger.shutdownAll();
+
+    EXPECT_EQ(m.truncated, 1u);
+    EXPECT_EQ(m.largeRecords, 1u);
+
+    const std::string logs = read_all_logs(logDir);
+    const std::size_t start = logs.find("INFO " + token + " x");
+    ASSERT_NE(start, std::string::npos);
+    const std::size_t end = logs.find('\n', start);
+    ASSERT_NE(end, std::string::npos);
+    // The record, '\n' included, is exactly cfg.maxRecordSize bytes.
+    EXPECT_EQ(end + 1 - start, cfg.maxRecordSize);
+    EXPECT_EQ(count_occurrences(logs, "INFO " + token + " after\n"), 1u);
+}
+
+TEST(LoggerIntegration, MaxRecordSizeBelowBufSize_IsRaisedToIt)
+{
+    constexpr std::size_t kBufSize = 64 * 1024;
+    for (bool ordered : {false, true})
+    {
+        const fs::path logDir = fs::current_path() / "log";
+        purge_log_dir(logDir);
+
+        const std::string token = make_unique_token("RAISED");
+        BackendConfig cfg;
+        cfg.maxRecordSize = 16 * 1024;
+        cfg.orderedOutput = ordered;
+        cfg.linePattern = "%L ";
+
+        AsyncLogger<SharedBackend> logger(kBufSize, 8, logDir.string(), cfg);
+        LOG_TO(logger, INFO) << token << " before";
+        LOG_TO(logger, INFO) << token << ' ' << std::string(3 * kBufSize, 'x');
+        LOG_TO(logger, INFO) << token << " after";
+        logger.shutdownTL();
+        MetricsSnapshot m = logger.metrics();
+        logger.shutdownAll();
+
+        EXPECT_EQ(m.truncated, 1u);
+        const std::string logs = read_all_logs(logDir);
+        const std::size_t start = logs.find("INFO " + token + " x");
+        ASSERT_NE(start, std::string::npos);
+        const std::size_t end = logs.find('\n', start);
+        ASSERT_NE(end, std::string::npos);
+        // Cut at one pool buffer, less the ordered-output stamp.
+        EXPECT_LE(end + 1 - start, kBufSize);
+        EXPECT_GT(end + 1 - start, kBufSize - 64);
+        if (!ordered)
+        {
+            EXPECT_EQ(end + 1 - start, kBufSize);
+        }
+        EXPECT_EQ(count_occurrences(logs, "INFO " + token + " before\n"), 1u);
+        EXPECT_EQ(count_occurrences(logs, "INFO " + token + " after\n"), 1u);
+    }
+}
+
+TEST(LoggerIntegration, PreallocatedRoll_SegmentsTrimmedAndComplete)
+{
+    const fs::path logDir = fs::current_path() / "log";
+    purge_log_dir(logDir);
+
+    const int kLines = 20'000;
+    const std::string token = make_unique_token("ROLL");
+    const std::string payload(180, 'X');
+
+    BackendConfig cfg;
+    cfg.maxFileSize = 256 * 1024;
+    cfg.preallocateSegments = true;
+    AsyncLogger<SharedBackend> logger(16 * 1024, 32, logDir.string(), cfg);
+
+    for (int i = 0; i < kLines; ++i)
+    {
+        LOG_TO(logger, INFO) << "L=" << i << " " << token << " " << payload;
+        if ((i + 1) % 50 == 0)
+            logger.flush();
+    }
+    logger.shutdownAll();
+
+    const auto files = log_files(logDir);
+    EXPECT_GT(files.size(), 4u);
+    for (const auto &f : files)
+        EXPECT_LE(fs::file_size(f), cfg.maxFileSize + 64) << f;
+
+    const std::string logs = read_all_logs(logDir);
+    EXPECT_EQ(logs.find('\0'), std::string::npos);
+    EXPECT_EQ(count_occurrences(logs, token) + count_dropped_delta(logs),
+              static_cast<std::size_t>(kLines));
+}
+
+TEST(LoggerIntegration, PreallocatedRoll_SegmentNamedWhenRolledInto)
+{
+    const fs::path logDir = fs::current_path() / "log";
+    purge_log_dir(logDir);
+
+    const std::string token = make_unique_token("RENAME");
+    std::string rolledAfter;
+    {
+        BackendConfig cfg;
+        cfg.maxFileSize = 64 * 1024;
+        cfg.preallocateSegments = true;
+        AsyncLogger<SharedBackend> logger(16 * 1024, 32, logDir.string(), cfg);
+
+        LOG_TO(logger, INFO) << token << " first";
+        logger.flush();
+        // The next segment is prepared by now; it must not be named for this.
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        rolledAfter = LogTime::nowDateString();
+
+        const std::string payload(1000, 'X');
+        for (int i = 0; i < 100; ++i)
+            LOG_TO(logger, INFO) << token << " " << payload;
+        logger.shutdownAll();
+    }
+    // The logger is gone, so the segment prepared after the roll is too.
+
+    std::vector<std::string> written;
+    for (const auto &f : log_files(logDir))
+    {
+        const std::string name = f.filename().string();
+        EXPECT_NE(name[0], '.') << "placeholder left behind: " << name;
+        if (fs::file_size(f) > 0)
+            written.push_back(name);
+    }
+    ASSERT_GE(written.size(), 2u);
+    // Names start with the date, so they sort by it.
+    EXPECT_GE(written.back().substr(0, rolledAfter.size()), rolledAfter);
+}
+
+TEST(LoggerIntegration, DirectWriter_SegmentsExactAndComplete)
+{
+    const fs::path logDir = fs::current_path() / "log";
+    purge_log_dir(logDir);
+
+    const int kLines = 20'000;
+    const std::string token = make_unique_token("DIRECT");
+    const std::string payload(173, 'X'); // odd line length: never block-aligned
+
+    BackendConfig cfg;
+    cfg.directIO = true;
+    cfg.maxFileSize = 256 * 1024;
+    AsyncLogger<SharedBackend> logger(16 * 1024, 32, logDir.string(), cfg);
+
+    for (int i = 0; i < kLines; ++i)
+    {
+        LOG_TO(logger, INFO) << "L=" << i << " " << token << " " << payload;
+        if ((i + 1) % 50 == 0)
+            logger.flush();
+    }
+    logger.shutdownAll();
+
+    const auto files = log_files(logDir);
+    EXPECT_GT(files.size(), 4u);
+    const std::string logs = read_all_logs(logDir);
+    // Carried-over tails are neither padded nor lost at a roll.
+    EXPECT_EQ(logs.find('\0'), std::string::npos);
+    EXPECT_EQ(count_occurrences(logs, token) + count_dropped_delta(logs),
+              static_cast<std::size_t>(kLines));
+}
+
+TEST(LogContext, LinesFollowTheContextAcrossThreads)
+{
+    const fs::path logDir = fs::current_path() / "log";
+    purge_log_dir(logDir);
+
+    const int kSteps = 50;
+    const std::string token = make_unique_token("REQ");
+    AsyncLogger<SharedBackend> logger(64 * 1024, 32, logDir.string());
+
+    {
+        LogContext<SharedBackend> ctx(logger);
+
+        // The "task" hops between two workers that also log on their own.
+        for (int step = 0; step < kSteps; ++step)
+        {
+            std::thread worker([&]
+                               {
+                LOG_TO(logger, INFO) << "worker noise " << step;
+                {
+                    LogContext<SharedBackend>::Scope scope(ctx);
+                    LOG_TO(logger, INFO) << token << " step=" << step;
+                }
+                LOG_TO(logger, INFO) << "worker noise " << step;
+                logger.shutdownTL(); });
+            worker.join();
+        }
+        LOG_CTX(ctx, INFO) << token << " done";
+    }
+    logger.shutdownAll();
+
+    // One buffer held the whole request: its lines are contiguous and in order.
+    std::string expected;
+    for (int step = 0; step < kSteps; ++step)
+        expected += token + " step=" + std::to_string(step) + "\n";
+    expected += token + " done\n";
+
+    const std::string logs = read_all_logs(logDir);
+    std::string request;
+    std::istringstream in(logs);
+    std::string line;
+    while (std::getline(in, line))
+    {
+        const auto pos = line.find(token);
+        if (pos != std::string::npos)
+            request += line.substr(pos) + "\n";
+    }
+    EXPECT_EQ(request, expected);
+
+    const auto first = logs.find(token);
+    const auto last = logs.rfind(token);
+    ASSERT_NE(first, std::string::npos);
+    EXPECT_EQ(logs.substr(first, last - first).find("worker noise"), std::string::npos);
+    EXPECT_EQ(count_occurrences(logs, "worker noise"), static_cast<std::size_t>(2 * kSteps));
+}
+
+TEST(LogContext, ThreadFieldsNameTheAttachingThread)
+{
+    const fs::path logDir = fs::current_path() / "log";
+    purge_log_dir(logDir);
+
+    const std::string token = make_unique_token("CTXTID");
+    BackendConfig cfg;
+    cfg.linePattern = "%t %N ";
+    AsyncLogger<SharedBackend> logger(4096, 8, logDir.string(), cfg);
+
+    std::vector<std::string> prefixes;
+    {
+        // Built here, attached only on the workers.
+        LogContext<SharedBackend> ctx(logger);
+        for (int w = 0; w < 2; ++w)
+        {
+            std::thread worker([&, w]
+                               {
+                const std::string name = "ctx-worker-" + std::to_string(w);
+                ::pthread_setname_np(::pthread_self(), name.c_str());
+                prefixes.push_back(std::to_string(::syscall(SYS_gettid)) + " " + name + " ");
+                LogContext<SharedBackend>::Scope scope(ctx);
+                LOG_TO(logger, INFO) << token << " worker=" << w; });
+            worker.join();
+        }
+    }
+    logger.shutdownAll();
+
+    const std::string logs = read_all_logs(logDir);
+    for (int w = 0; w < 2; ++w)
+        EXPECT_EQ(count_occurrences(logs, prefixes[w] + token + " worker=" + std::to_string(w) + "\n"), 1u);
+}
+
+TEST(OrderedOutput, MergerEmitsLinesInStampOrder)
+{
+    auto frame = [](std::string &buf, uint64_t stamp, const std::string &body)
+    {
+        char hdr[kLineStampSize];
+        storeLineStamp(hdr, stamp, static_cast<uint32_t>(body.size()));
+        buf.append(hdr, kLineStampSize);
+        buf += body;
+    };
+
+    std::string a, b, c;
+    frame(a, 10, "a10\n");
+    frame(a, 40, "a40\n");
+    frame(b, 20, "b20\n");
+    frame(b, 40, "b40\n");
+    frame(b, 50, "b50\n");
+    frame(c, 5, "c05\n");
+    frame(c, 30, "c30\n");
+
+    OrderedMerger merger(8); // smaller than the output: forces several chunks
+    merger.add(a.data(), a.size());
+    merger.add(b.data(), b.size());
+    merger.add(c.data(), c.size());
+
+    std::string out;
+    merger.merge([&](const char *data, size_t size)
+                 { out.append(data, size); });
+
+    EXPECT_EQ(out, "c05\na10\nb20\nc30\na40\nb40\nb50\n");
+}
+
+TEST(OrderedOutput, StampsAreStrippedAndNothingIsLost)
+{
+    const fs::path logDir = fs::current_path() / "log";
+    purge_log_dir(logDir);
+
+    const int kThreads = 4;
+    const int kLinesPerThread = 3000;
+    const std::string token = make_unique_token("ORDERED");
+
+    BackendConfig cfg;
+    cfg.orderedOutput = true;
+    AsyncLogger<SharedBackend> logger(4000, 32, logDir.string(), cfg);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t)
+    {
+        threads.emplace_back([&, t]
+                             {
+            for (int i = 0; i < kLinesPerThread; ++i)
+                LOG_TO(logger, INFO) << "T=" << t << " I=" << i << " " << token;
+            logger.shutdownTL(); });
+    }
+    for (auto &th : threads)
+        th.join();
+    logger.shutdownAll();
+
+    const std::string logs = read_all_logs(logDir);
+    EXPECT_EQ(count_occurrences(logs, token) + count_dropped_delta(logs),
+              static_cast<std::size_t>(kThreads * kLinesPerThread));
+
+    // Every line must be a plain "LEVEL time ..." line with no header bytes.
+    std::istringstream in(logs);
+    std::string line;
+    while (std::getline(in, line))
+    {
+        if (line.empty() || line.rfind("dropped: ", 0) == 0)
+            continue;
+        EXPECT_EQ(line.rfind("INFO ", 0), 0u) << line;
+    }
+}
+
+TEST(OrderedOutput, PerThreadOrderHoldsWhenWriterThreadsAreRequested)
+{
+    const fs::path logDir = fs::current_path() / "log";
+    purge_log_dir(logDir);
+
+    const int kThreads = 4;
+    const int kLinesPerThread = 5000;
+    const std::string token = make_unique_token("ORDERPOOL");
+
+    BackendConfig cfg;
+    cfg.orderedOutput = true;
+    cfg.writerThreads = 4;
+    AsyncLogger<SharedBackend> logger(2000, 32, logDir.string(), cfg);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t)
+    {
+        threads.emplace_back([&, t]
+                             {
+            for (int i = 0; i < kLinesPerThread; ++i)
+                LOG_TO(logger, INFO) << token << " T=" << t << " I=" << i;
+            logger.shutdownTL(); });
+    }
+    for (auto &th : threads)
+        th.join();
+    logger.shutdownAll();
+
+    const std::string logs = read_all_logs(logDir);
+    std::vector<int> last(kThreads, -1);
+    std::size_t seen = 0;
+    const std::regex re(token + " T=(\\d+) I=(\\d+)");
+    std::istringstream in(logs);
+    std::string line;
+    while (std::getline(in, line))
+    {
+        std::smatch m;
+        if (!std::regex_search(line, m, re))
+            continue;
+        const int t = std::stoi(m[1]);
+        const int i = std::stoi(m[2]);
+        EXPECT_GT(i, last[t]) << line;
+        last[t] = i;
+        seen++;
+    }
+    EXPECT_EQ(seen + count_dropped_delta(logs), static_cast<std::size_t>(kThreads * kLinesPerThread));
+}
+
+TEST(TimeIndex, FindTimeRangeReturnsOnlyTheMiddleWindow)
+{
+    const fs::path logDir = fs::current_path() / "log";
+    purge_log_dir(logDir);
+
+    const int kLines = 4000;
+    const std::string before = make_unique_token("BEFORE");
+    const std::string inside = make_unique_token("INSIDE");
+    const std::string after = make_unique_token("AFTER");
+    const std::string payload(100, 'X');
+
+    BackendConfig cfg;
+    cfg.timeIndex = true;
+    cfg.maxFileSize = 128 * 1024; // several segments per phase
+    AsyncLogger<SharedBackend> logger(8 * 1024, 64, logDir.string(), cfg);
+
+    // Each phase ends with a flush and a pause, so no buffer spans two phases.
+    int64_t from = 0, to = 0;
+    auto phase = [&](const std::string &token)
+    {
+        for (int i = 0; i < kLines; ++i)
+        {
+            LOG_TO(logger, INFO) << token << " " << i << " " << payload;
+            if ((i + 1) % 40 == 0)
+                logger.flush();
+        }
+        logger.flush();
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    };
+    phase(before);
+    from = LogTime::nowNanos();
+    phase(inside);
+    to = LogTime::nowNanos();
+    phase(after);
+    logger.shutdownAll();
+
+    const auto hits = findTimeRange(logDir, from, to);
+    ASSERT_FALSE(hits.empty());
+
+    std::string found;
+    std::size_t lines = 0;
+    for (const auto &h : hits)
+    {
+        found += readTimeRange(h);
+        lines += h.lines;
+    }
+    const std::size_t insideCount = count_occurrences(found, inside);
+    EXPECT_EQ(count_occurrences(found, before), 0u);
+    EXPECT_EQ(count_occurrences(found, after), 0u);
+    EXPECT_EQ(insideCount, lines);
+
+    // Every inside line that was logged at all is in the hits.
+    const std::string logs = read_all_logs(logDir);
+    EXPECT_EQ(insideCount, count_occurrences(logs, inside));
+    EXPECT_EQ(count_occurrences(logs, before) + insideCount + count_occurrences(logs, after) +
+                  count_dropped_delta(logs),
+              static_cast<std::size_t>(3 * kLines));
+}
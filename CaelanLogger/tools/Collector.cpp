@@ -0,0 +1,72 @@
+// Standalone collector for ShmBackend producers: owns the shared-memory pool
+// and writes every producer process's lines until SIGINT or SIGTERM.
+//
+//     caelogger_collector --shm /caelogger --dir /var/log/app --slots 256 --slot-size 65536
+
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <pthread.h>
+
+#include "ShmBackend.h"
+
+int main(int argc, char **argv)
+{
+    BackendConfig cfg;
+    std::string dir = "./log";
+    uint32_t slots = 256;
+    size_t slotSize = 64 * 1024;
+    bool unlinkOnExit = false;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        auto next = [&]() -> std::string
+        {
+            if (i + 1 >= argc)
+            {
+                std::cerr << arg << " needs a value\n";
+                std::exit(2);
+            }
+            return argv[++i];
+        };
+        if (arg == "--shm")
+            cfg.shmName = next();
+        else if (arg == "--dir")
+            dir = next();
+        else if (arg == "--slots")
+            slots = static_cast<uint32_t>(std::stoul(next()));
+        else if (arg == "--slot-size")
+            slotSize = std::stoull(next());
+        else if (arg == "--max-file-size")
+            cfg.maxFileSize = std::stoull(next());
+        else if (arg == "--preallocate")
+            cfg.preallocateSegments = true;
+        else if (arg == "--unlink")
+            unlinkOnExit = true;
+        else
+        {
+            std::cerr << "usage: " << argv[0]
+                      << " [--shm name] [--dir path] [--slots N] [--slot-size bytes] [--max-file-size bytes]"
+                         " [--preallocate] [--unlink]\n";
+            std::exit(2);
+        }
+    }
+
+    // Blocked before the collector thread starts, so only sigwait() sees them.
+    sigset_t stopSignals;
+    sigemptyset(&stopSignals);
+    sigaddset(&stopSignals, SIGINT);
+    sigaddset(&stopSignals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stopSignals, nullptr);
+
+    ShmCollector collector(dir, cfg, slots, slotSize);
+    collector.start();
+    int sig = 0;
+    sigwait(&stopSignals, &sig);
+    collector.stop();
+    if (unlinkOnExit)
+        ShmPool::unlink(cfg.shmName);
+    std::cerr << "collector: stopped, reclaimed " << collector.reclaimed() << " buffers\n";
+    return 0;
+}